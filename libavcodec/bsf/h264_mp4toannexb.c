@@ -32,6 +32,7 @@
 #include "h264.h"
 
 typedef struct H264BSFContext {
+    AVPacket *in;
     uint8_t *sps;
     uint8_t *pps;
     int      sps_size;
@@ -67,7 +68,8 @@ static void count_or_copy(uint8_t **out, uint64_t *out_size,
         start_code_size = 3;
 
     if (copy) {
-        memcpy(*out + start_code_size, in, in_size);
+        /* out and in may overlap when filtering in place */
+        memmove(*out + start_code_size, in, in_size);
         if (start_code_size == 4) {
             AV_WB32(*out, 1);
         } else if (start_code_size) {
@@ -253,8 +255,13 @@ static int h264_mp4toannexb_filter_ps(H264BSFContext *s,
 
 static int h264_mp4toannexb_init(AVBSFContext *ctx)
 {
+    H264BSFContext *s = ctx->priv_data;
     int extra_size = ctx->par_in->extradata_size;
 
+    s->in = av_packet_alloc();
+    if (!s->in)
+        return AVERROR(ENOMEM);
+
     /* retrieve sps and pps NAL units from extradata */
     if (!extra_size                                               ||
         (extra_size >= 3 && AV_RB24(ctx->par_in->extradata) == 1) ||
@@ -276,17 +283,18 @@ static int h264_mp4toannexb_init(AVBSFContext *ctx)
 static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
 {
     H264BSFContext *s = ctx->priv_data;
-    AVPacket *in;
-    uint8_t unit_type, new_idr, sps_seen, pps_seen;
+    AVPacket *in = s->in;
+    uint8_t unit_type, new_idr, sps_seen, pps_seen, ps_inserted;
     const uint8_t *buf;
     const uint8_t *buf_end;
     uint8_t *out;
     uint64_t out_size;
+    int in_place = 0;
     int ret;
     size_t extradata_size;
     uint8_t *extradata;
 
-    ret = ff_bsf_get_packet(ctx, &in);
+    ret = ff_bsf_get_packet_ref(ctx, in);
     if (ret < 0)
         return ret;
 
@@ -301,7 +309,6 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
     /* nothing to filter */
     if (!s->extradata_parsed) {
         av_packet_move_ref(opkt, in);
-        av_packet_free(&in);
         return 0;
     }
 
@@ -319,6 +326,7 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
         sps_seen = s->idr_sps_seen;
         pps_seen = s->idr_pps_seen;
         out_size = 0;
+        ps_inserted = 0;
 
         do {
             uint32_t nal_size = 0;
@@ -352,7 +360,7 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
                         LOG_ONCE(ctx, AV_LOG_WARNING, "SPS not present in the stream, nor in AVCC, stream may be unreadable\n");
                     } else {
                         count_or_copy(&out, &out_size, s->sps, s->sps_size, PS_OUT_OF_BAND, j);
-                        sps_seen = 1;
+                        sps_seen = ps_inserted = 1;
                     }
                 }
             }
@@ -369,6 +377,7 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
                     count_or_copy(&out, &out_size, s->sps, s->sps_size, PS_OUT_OF_BAND, j);
                 if (s->pps_size)
                     count_or_copy(&out, &out_size, s->pps, s->pps_size, PS_OUT_OF_BAND, j);
+                ps_inserted |= s->sps_size || s->pps_size;
                 new_idr = 0;
             /* if only SPS has been seen, also insert PPS */
             } else if (new_idr && unit_type == H264_NAL_IDR_SLICE && sps_seen && !pps_seen) {
@@ -376,6 +385,7 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
                     LOG_ONCE(ctx, AV_LOG_WARNING, "PPS not present in the stream, nor in AVCC, stream may be unreadable\n");
                 } else {
                     count_or_copy(&out, &out_size, s->pps, s->pps_size, PS_OUT_OF_BAND, j);
+                    ps_inserted = 1;
                 }
             }
 
@@ -398,20 +408,40 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
                 ret = AVERROR_INVALIDDATA;
                 goto fail;
             }
-            ret = av_new_packet(opkt, out_size);
-            if (ret < 0)
-                goto fail;
-            out = opkt->data;
+            /* With 4-byte length prefixes and no parameter sets to insert,
+             * every start code fits in the place of the length it replaces,
+             * so the packet can be rewritten without a new buffer. */
+            in_place = s->length_size == 4 && !ps_inserted;
+            if (in_place) {
+                ret = av_packet_make_writable(in);
+                if (ret < 0)
+                    goto fail;
+                buf_end = in->data + in->size;
+                out     = in->data;
+            } else {
+                ret = av_new_packet(opkt, out_size);
+                if (ret < 0)
+                    goto fail;
+                out = opkt->data;
+            }
         }
     }
 #undef LOG_ONCE
 
-    av_assert1(out_size == opkt->size);
-
     s->new_idr      = new_idr;
     s->idr_sps_seen = sps_seen;
     s->idr_pps_seen = pps_seen;
 
+    if (in_place) {
+        av_assert1(out_size <= in->size);
+        in->size = out_size;
+        memset(in->data + in->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        av_packet_move_ref(opkt, in);
+        return 0;
+    }
+
+    av_assert1(out_size == opkt->size);
+
     ret = av_packet_copy_props(opkt, in);
     if (ret < 0)
         goto fail;
@@ -419,7 +449,7 @@ static int h264_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *opkt)
 fail:
     if (ret < 0)
         av_packet_unref(opkt);
-    av_packet_free(&in);
+    av_packet_unref(in);
 
     return ret;
 }
@@ -428,6 +458,7 @@ static void h264_mp4toannexb_close(AVBSFContext *ctx)
 {
     H264BSFContext *s = ctx->priv_data;
 
+    av_packet_free(&s->in);
     av_freep(&s->sps);
     av_freep(&s->pps);
 }
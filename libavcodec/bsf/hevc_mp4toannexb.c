@@ -28,11 +28,13 @@
 #include "bsf_internal.h"
 #include "bytestream.h"
 #include "defs.h"
+#include "h2645_mp4toannexb.h"
 #include "hevc.h"
 
 #define MIN_HEVCC_LENGTH 23
 
 typedef struct HEVCBSFContext {
+    AVPacket *in;
     uint8_t  length_size;
     int      extradata_parsed;
 } HEVCBSFContext;
@@ -102,6 +104,10 @@ static int hevc_mp4toannexb_init(AVBSFContext *ctx)
     HEVCBSFContext *s = ctx->priv_data;
     int ret;
 
+    s->in = av_packet_alloc();
+    if (!s->in)
+        return AVERROR(ENOMEM);
+
     if (ctx->par_in->extradata_size < MIN_HEVCC_LENGTH ||
         AV_RB24(ctx->par_in->extradata) == 1           ||
         AV_RB32(ctx->par_in->extradata) == 1) {
@@ -118,80 +124,39 @@ static int hevc_mp4toannexb_init(AVBSFContext *ctx)
     return 0;
 }
 
+static int hevc_add_extradata(void *opaque, const uint8_t *nal)
+{
+    int nalu_type = (nal[0] >> 1) & 0x3f;
+
+    /* prepend extradata to IRAP frames */
+    return nalu_type >= HEVC_NAL_BLA_W_LP &&
+           nalu_type <= HEVC_NAL_RSV_IRAP_VCL23;
+}
+
 static int hevc_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *out)
 {
     HEVCBSFContext *s = ctx->priv_data;
-    AVPacket *in;
-    GetByteContext gb;
-
-    int got_irap = 0;
-    int i, ret = 0;
+    AVPacket *in = s->in;
+    int ret;
 
-    ret = ff_bsf_get_packet(ctx, &in);
+    ret = ff_bsf_get_packet_ref(ctx, in);
     if (ret < 0)
         return ret;
 
     if (!s->extradata_parsed) {
         av_packet_move_ref(out, in);
-        av_packet_free(&in);
         return 0;
     }
 
-    bytestream2_init(&gb, in->data, in->size);
-
-    while (bytestream2_get_bytes_left(&gb)) {
-        uint32_t nalu_size = 0;
-        int      nalu_type;
-        int is_irap, add_extradata, extra_size, prev_size;
-
-        if (bytestream2_get_bytes_left(&gb) < s->length_size) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-        for (i = 0; i < s->length_size; i++)
-            nalu_size = (nalu_size << 8) | bytestream2_get_byte(&gb);
-
-        if (nalu_size < 2 || nalu_size > bytestream2_get_bytes_left(&gb)) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-
-        nalu_type = (bytestream2_peek_byte(&gb) >> 1) & 0x3f;
-
-        /* prepend extradata to IRAP frames */
-        is_irap = nalu_type >= HEVC_NAL_BLA_W_LP &&
-                  nalu_type <= HEVC_NAL_RSV_IRAP_VCL23;
-        add_extradata = is_irap && !got_irap;
-        extra_size    = add_extradata * ctx->par_out->extradata_size;
-        got_irap     |= is_irap;
-
-        if (FFMIN(INT_MAX, SIZE_MAX) < 4ULL + nalu_size + extra_size) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-
-        prev_size = out->size;
-
-        ret = av_grow_packet(out, 4 + nalu_size + extra_size);
-        if (ret < 0)
-            goto fail;
-
-        if (extra_size)
-            memcpy(out->data + prev_size, ctx->par_out->extradata, extra_size);
-        AV_WB32(out->data + prev_size + extra_size, 1);
-        bytestream2_get_buffer(&gb, out->data + prev_size + 4 + extra_size, nalu_size);
-    }
-
-    ret = av_packet_copy_props(out, in);
-    if (ret < 0)
-        goto fail;
+    return ff_h2645_mp4toannexb_filter(ctx, in, out, s->length_size,
+                                       hevc_add_extradata, NULL);
+}
 
-fail:
-    if (ret < 0)
-        av_packet_unref(out);
-    av_packet_free(&in);
+static void hevc_mp4toannexb_close(AVBSFContext *ctx)
+{
+    HEVCBSFContext *s = ctx->priv_data;
 
-    return ret;
+    av_packet_free(&s->in);
 }
 
 static const enum AVCodecID codec_ids[] = {
@@ -204,4 +169,5 @@ const FFBitStreamFilter ff_hevc_mp4toannexb_bsf = {
     .priv_data_size = sizeof(HEVCBSFContext),
     .init           = hevc_mp4toannexb_init,
     .filter         = hevc_mp4toannexb_filter,
+    .close          = hevc_mp4toannexb_close,
 };
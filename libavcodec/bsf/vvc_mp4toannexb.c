@@ -28,11 +28,13 @@
 #include "bsf_internal.h"
 #include "bytestream.h"
 #include "defs.h"
+#include "h2645_mp4toannexb.h"
 #include "vvc.h"
 
 #define MIN_VVCC_LENGTH 23
 
 typedef struct VVCBSFContext {
+    AVPacket *in;
     uint8_t length_size;
     int extradata_parsed;
 } VVCBSFContext;
@@ -195,6 +197,10 @@ static int vvc_mp4toannexb_init(AVBSFContext *ctx)
     VVCBSFContext *s = ctx->priv_data;
     int ret;
 
+    s->in = av_packet_alloc();
+    if (!s->in)
+        return AVERROR(ENOMEM);
+
     if (ctx->par_in->extradata_size < MIN_VVCC_LENGTH ||
         AV_RB24(ctx->par_in->extradata) == 1 ||
         AV_RB32(ctx->par_in->extradata) == 1) {
@@ -211,23 +217,30 @@ static int vvc_mp4toannexb_init(AVBSFContext *ctx)
     return 0;
 }
 
+static int vvc_add_extradata(void *opaque, const uint8_t *nal)
+{
+    const int *is_irap = opaque;
+    int nalu_type = (AV_RB16(nal) >> 3) & 0x1f;
+
+    /* prepend extradata to IRAP frames */
+    return *is_irap && nalu_type != VVC_AUD_NUT;
+}
+
 static int vvc_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *out)
 {
     VVCBSFContext *s = ctx->priv_data;
-    AVPacket *in;
+    AVPacket *in = s->in;
     GetByteContext gb;
 
     int is_irap = 0;
-    int added_extra = 0;
     int i, ret = 0;
 
-    ret = ff_bsf_get_packet(ctx, &in);
+    ret = ff_bsf_get_packet_ref(ctx, in);
     if (ret < 0)
         return ret;
 
     if (!s->extradata_parsed) {
         av_packet_move_ref(out, in);
-        av_packet_free(&in);
         return 0;
     }
 
@@ -259,62 +272,22 @@ static int vvc_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *out)
         bytestream2_seek(&gb, nalu_size, SEEK_CUR);
     }
 
-    bytestream2_seek(&gb, 0, SEEK_SET);
-    while (bytestream2_get_bytes_left(&gb)) {
-        uint32_t nalu_size = 0;
-        int nalu_type;
-        int add_extradata, extra_size, prev_size;
-
-        if (bytestream2_get_bytes_left(&gb) < s->length_size) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-
-        for (i = 0; i < s->length_size; i++)
-            nalu_size = (nalu_size << 8) | bytestream2_get_byte(&gb);
-
-        if (nalu_size < 2 || nalu_size > bytestream2_get_bytes_left(&gb)) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-
-        nalu_type = (bytestream2_peek_be16(&gb) >> 3) & 0x1f;
-
-        /* prepend extradata to IRAP frames */
-        add_extradata = is_irap && nalu_type != VVC_AUD_NUT && !added_extra;
-        extra_size = add_extradata * ctx->par_out->extradata_size;
-        added_extra |= add_extradata;
-
-        if (FFMIN(INT_MAX, SIZE_MAX) < 4ULL + nalu_size + extra_size) {
-            ret = AVERROR_INVALIDDATA;
-            goto fail;
-        }
-
-        prev_size = out->size;
-
-        ret = av_grow_packet(out, 4 + nalu_size + extra_size);
-        if (ret < 0)
-            goto fail;
-
-        if (extra_size)
-            memcpy(out->data + prev_size, ctx->par_out->extradata, extra_size);
-        AV_WB32(out->data + prev_size + extra_size, 1);
-        bytestream2_get_buffer(&gb, out->data + prev_size + 4 + extra_size,
-                               nalu_size);
-    }
-
-    ret = av_packet_copy_props(out, in);
-    if (ret < 0)
-        goto fail;
+    return ff_h2645_mp4toannexb_filter(ctx, in, out, s->length_size,
+                                       vvc_add_extradata, &is_irap);
 
   fail:
-    if (ret < 0)
-        av_packet_unref(out);
-    av_packet_free(&in);
+    av_packet_unref(in);
 
     return ret;
 }
 
+static void vvc_mp4toannexb_close(AVBSFContext *ctx)
+{
+    VVCBSFContext *s = ctx->priv_data;
+
+    av_packet_free(&s->in);
+}
+
 static const enum AVCodecID codec_ids[] = {
     AV_CODEC_ID_VVC, AV_CODEC_ID_NONE,
 };
@@ -325,4 +298,5 @@ const FFBitStreamFilter ff_vvc_mp4toannexb_bsf = {
     .priv_data_size = sizeof(VVCBSFContext),
     .init           = vvc_mp4toannexb_init,
     .filter         = vvc_mp4toannexb_filter,
+    .close          = vvc_mp4toannexb_close,
 };
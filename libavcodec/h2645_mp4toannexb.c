@@ -0,0 +1,120 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/intreadwrite.h"
+
+#include "bsf.h"
+#include "bytestream.h"
+#include "defs.h"
+#include "h2645_mp4toannexb.h"
+#include "packet.h"
+
+int ff_h2645_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *in, AVPacket *out,
+                                int length_size,
+                                int (*add_extradata)(void *opaque,
+                                                     const uint8_t *nal),
+                                void *opaque)
+{
+    GetByteContext gb;
+    uint8_t *dst = NULL;
+    uint64_t out_size = 0;
+    int in_place = 0;
+    int i, ret = 0;
+
+    /* the first pass validates the input and sizes the output,
+     * the second one writes it */
+    for (int j = 0; j < 2; j++) {
+        int added_extra = 0;
+
+        bytestream2_init(&gb, in->data, in->size);
+
+        while (bytestream2_get_bytes_left(&gb)) {
+            uint32_t nalu_size = 0;
+            int add, extra_size;
+
+            if (bytestream2_get_bytes_left(&gb) < length_size) {
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+            for (i = 0; i < length_size; i++)
+                nalu_size = (nalu_size << 8) | bytestream2_get_byte(&gb);
+
+            if (nalu_size < 2 || nalu_size > bytestream2_get_bytes_left(&gb)) {
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+
+            add         = !added_extra && add_extradata(opaque, gb.buffer);
+            extra_size  = add * ctx->par_out->extradata_size;
+            added_extra |= add;
+
+            if (!j) {
+                out_size += 4 + nalu_size + extra_size;
+            } else {
+                if (extra_size) {
+                    memcpy(dst, ctx->par_out->extradata, extra_size);
+                    dst += extra_size;
+                }
+                AV_WB32(dst, 1);
+                if (!in_place)
+                    memcpy(dst + 4, gb.buffer, nalu_size);
+                dst += 4 + nalu_size;
+            }
+            bytestream2_skip(&gb, nalu_size);
+        }
+
+        if (!j) {
+            if (out_size > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE) {
+                ret = AVERROR_INVALIDDATA;
+                goto fail;
+            }
+            /* 4-byte lengths and nothing to prepend: overwrite the lengths */
+            in_place = out_size == in->size;
+            if (in_place) {
+                ret = av_packet_make_writable(in);
+                if (ret < 0)
+                    goto fail;
+                dst = in->data;
+            } else {
+                ret = av_new_packet(out, out_size);
+                if (ret < 0)
+                    goto fail;
+                dst = out->data;
+            }
+        }
+    }
+
+    if (in_place) {
+        av_packet_move_ref(out, in);
+        return 0;
+    }
+
+    ret = av_packet_copy_props(out, in);
+
+fail:
+    if (ret < 0)
+        av_packet_unref(out);
+    av_packet_unref(in);
+
+    return ret;
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_H2645_MP4TOANNEXB_H
+#define AVCODEC_H2645_MP4TOANNEXB_H
+
+#include <stdint.h>
+
+#include "bsf.h"
+#include "packet.h"
+
+/**
+ * Convert a packet of length-prefixed HEVC/VVC NAL units to Annex B,
+ * prepending the output extradata at most once per packet.
+ *
+ * @param in          input packet, always unreferenced on return
+ * @param out         output packet
+ * @param length_size size of the NAL unit length fields in bytes
+ * @param add_extradata called with the start of each NAL unit; returns
+ *                    nonzero if the extradata may be inserted in front of it
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int ff_h2645_mp4toannexb_filter(AVBSFContext *ctx, AVPacket *in, AVPacket *out,
+                                int length_size,
+                                int (*add_extradata)(void *opaque,
+                                                     const uint8_t *nal),
+                                void *opaque);
+
+#endif /* AVCODEC_H2645_MP4TOANNEXB_H */
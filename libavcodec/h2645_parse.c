@@ -25,115 +25,108 @@
 #include "libavutil/intmath.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
+#include "libavutil/thread.h"
 
 #include "bytestream.h"
 #include "hevc.h"
 #include "h264.h"
 #include "h2645_parse.h"
+#include "startcode.h"
 #include "vvc.h"
 
+static StartcodeFindCandidateFunc startcode_find_candidate;
+
+static av_cold void find_candidate_init(void)
+{
+    startcode_find_candidate = ff_startcode_find_candidate_func();
+}
+
+static StartcodeFindCandidateFunc get_find_candidate(void)
+{
+    static AVOnce init_once = AV_ONCE_INIT;
+
+    ff_thread_once(&init_once, find_candidate_init);
+    return startcode_find_candidate;
+}
+
 int ff_h2645_extract_rbsp(const uint8_t *src, int length,
                           H2645RBSP *rbsp, H2645NAL *nal, int small_padding)
 {
+    StartcodeFindCandidateFunc find_candidate = get_find_candidate();
     int i, si, di;
     uint8_t *dst;
 
     nal->skipped_bytes = 0;
-#define STARTCODE_TEST                                                  \
-        if (i + 2 < length && src[i + 1] == 0 &&                        \
-           (src[i + 2] == 3 || src[i + 2] == 1)) {                      \
-            if (src[i + 2] == 1) {                                      \
-                /* startcode, so we must be past the end */             \
-                length = i;                                             \
-            }                                                           \
-            break;                                                      \
+
+    /* look for the first escape or start code, one zero byte at a time */
+    for (i = 0; i + 2 < length; i++) {
+        i += find_candidate(src + i, length - 2 - i);
+        if (i + 2 < length && src[i + 1] == 0 &&
+            (src[i + 2] == 3 || src[i + 2] == 1)) {
+            if (src[i + 2] == 1) {
+                /* startcode, so we must be past the end */
+                length = i;
+            }
+            break;
         }
-#if HAVE_FAST_UNALIGNED
-#define FIND_FIRST_ZERO                                                 \
-        if (i > 0 && !src[i])                                           \
-            i--;                                                        \
-        while (src[i])                                                  \
-            i++
-#if HAVE_FAST_64BIT
-    for (i = 0; i + 1 < length; i += 9) {
-        if (!((~AV_RN64(src + i) &
-               (AV_RN64(src + i) - 0x0100010001000101ULL)) &
-              0x8000800080008080ULL))
-            continue;
-        FIND_FIRST_ZERO;
-        STARTCODE_TEST;
-        i -= 7;
     }
-#else
-    for (i = 0; i + 1 < length; i += 5) {
-        if (!((~AV_RN32(src + i) &
-               (AV_RN32(src + i) - 0x01000101U)) &
-              0x80008080U))
-            continue;
-        FIND_FIRST_ZERO;
-        STARTCODE_TEST;
-        i -= 3;
-    }
-#endif /* HAVE_FAST_64BIT */
-#else
-    for (i = 0; i + 1 < length; i += 2) {
-        if (src[i])
-            continue;
-        if (i > 0 && src[i - 1] == 0)
-            i--;
-        STARTCODE_TEST;
-    }
-#endif /* HAVE_FAST_UNALIGNED */
+    if (i + 2 >= length)
+        i = length;
 
-    if (i >= length - 1 && small_padding) { // no escaped 0
+    if (i == length && small_padding) { // no escaped 0
         nal->data     =
         nal->raw_data = src;
         nal->size     =
         nal->raw_size = length;
         return length;
-    } else if (i > length)
-        i = length;
+    }
 
     dst = &rbsp->rbsp_buffer[rbsp->rbsp_buffer_size];
 
     memcpy(dst, src, i);
     si = di = i;
     while (si + 2 < length) {
+        /* copy everything up to the next zero byte in one go */
+        int n = find_candidate(src + si, length - 2 - si);
+
+        memcpy(dst + di, src + si, n);
+        si += n;
+        di += n;
+        if (si + 2 >= length)
+            break;
+
         // remove escapes (very rare 1:2^22)
-        if (src[si + 2] > 3) {
+        if (src[si + 1] || !src[si + 2] || src[si + 2] > 3) {
             dst[di++] = src[si++];
-            dst[di++] = src[si++];
-        } else if (src[si] == 0 && src[si + 1] == 0 && src[si + 2] != 0) {
-            if (src[si + 2] == 3) { // escape
-                dst[di++] = 0;
-                dst[di++] = 0;
-                si       += 3;
-
-                if (nal->skipped_bytes_pos) {
-                    nal->skipped_bytes++;
-                    if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
-                        nal->skipped_bytes_pos_size *= 2;
-                        av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
-                        av_reallocp_array(&nal->skipped_bytes_pos,
-                                nal->skipped_bytes_pos_size,
-                                sizeof(*nal->skipped_bytes_pos));
-                        if (!nal->skipped_bytes_pos) {
-                            nal->skipped_bytes_pos_size = 0;
-                            return AVERROR(ENOMEM);
-                        }
-                    }
-                    if (nal->skipped_bytes_pos)
-                        nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
+            continue;
+        }
+        if (src[si + 2] != 3) // next start code
+            goto nsc;
+
+        dst[di++] = 0;
+        dst[di++] = 0;
+        si       += 3;
+
+        if (nal->skipped_bytes_pos) {
+            nal->skipped_bytes++;
+            if (nal->skipped_bytes_pos_size < nal->skipped_bytes) {
+                nal->skipped_bytes_pos_size *= 2;
+                av_assert0(nal->skipped_bytes_pos_size >= nal->skipped_bytes);
+                av_reallocp_array(&nal->skipped_bytes_pos,
+                        nal->skipped_bytes_pos_size,
+                        sizeof(*nal->skipped_bytes_pos));
+                if (!nal->skipped_bytes_pos) {
+                    nal->skipped_bytes_pos_size = 0;
+                    return AVERROR(ENOMEM);
                 }
-                continue;
-            } else // next start code
-                goto nsc;
+            }
+            if (nal->skipped_bytes_pos)
+                nal->skipped_bytes_pos[nal->skipped_bytes-1] = di - 1;
         }
-
-        dst[di++] = src[si++];
     }
-    while (si < length)
-        dst[di++] = src[si++];
+    memcpy(dst + di, src + si, length - si);
+    di += length - si;
+    si  = length;
 
 nsc:
     memset(dst + di, 0, AV_INPUT_BUFFER_PADDING_SIZE);
@@ -401,13 +394,17 @@ static int h264_parse_nal_header(H2645NAL *nal, void *logctx)
 
 static int find_next_start_code(const uint8_t *buf, const uint8_t *next_avc)
 {
+    StartcodeFindCandidateFunc find_candidate = get_find_candidate();
     int i = 0;
 
     if (buf + 3 >= next_avc)
         return next_avc - buf;
 
     while (buf + i + 3 < next_avc) {
-        if (buf[i] == 0 && buf[i + 1] == 0 && buf[i + 2] == 1)
+        i += find_candidate(buf + i, next_avc - buf - 3 - i);
+        if (buf + i + 3 >= next_avc)
+            break;
+        if (buf[i + 1] == 0 && buf[i + 2] == 1)
             break;
         i++;
     }
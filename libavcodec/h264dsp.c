@@ -150,7 +150,7 @@ av_cold void ff_h264dsp_init(H264DSPContext *c, const int bit_depth,
         H264_DSP(8);
         break;
     }
-    c->startcode_find_candidate = ff_startcode_find_candidate_c;
+    c->startcode_find_candidate = ff_startcode_find_candidate_func();
 
 #if ARCH_AARCH64
     ff_h264dsp_init_aarch64(c, bit_depth, chroma_format_idc);
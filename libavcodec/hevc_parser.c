@@ -21,6 +21,7 @@
  */
 
 #include "libavutil/common.h"
+#include "libavutil/intreadwrite.h"
 
 #include "golomb.h"
 #include "hevc.h"
@@ -29,6 +30,7 @@
 #include "hevc_sei.h"
 #include "h2645_parse.h"
 #include "parser.h"
+#include "startcode.h"
 
 #define START_CODE 0x000001 ///< start_code_prefix_one_3bytes
 
@@ -48,6 +50,8 @@ typedef struct HEVCParserContext {
 
     int poc;
     int pocTid0;
+
+    StartcodeFindCandidateFunc find_candidate;
 } HEVCParserContext;
 
 static int hevc_parse_slice_header(AVCodecParserContext *s, H2645NAL *nal,
@@ -262,11 +266,24 @@ static int hevc_find_frame_end(AVCodecParserContext *s, const uint8_t *buf,
 {
     HEVCParserContext *ctx = s->priv_data;
     ParseContext       *pc = &ctx->pc;
+    StartcodeFindCandidateFunc find_candidate = ctx->find_candidate;
     int i;
 
     for (i = 0; i < buf_size; i++) {
         int nut;
 
+        /* a start code can only be completed 5 bytes after a zero byte,
+         * so jump to the next such position; state64 holds the last 8 bytes */
+        if (i >= 8 && buf[i - 5]) {
+            int next = i + 1 + find_candidate(buf + i - 4, buf_size - i + 4);
+            if (next >= buf_size) {
+                pc->state64 = AV_RB64(buf + buf_size - 8);
+                break;
+            }
+            pc->state64 = AV_RB64(buf + next - 8);
+            i = next;
+        }
+
         pc->state64 = (pc->state64 << 8) | buf[i];
 
         if (((pc->state64 >> 3 * 8) & 0xFFFFFF) != START_CODE)
@@ -339,6 +356,15 @@ static int hevc_parse(AVCodecParserContext *s, AVCodecContext *avctx,
     return next;
 }
 
+static av_cold int hevc_parser_init(AVCodecParserContext *s)
+{
+    HEVCParserContext *ctx = s->priv_data;
+
+    ctx->find_candidate = ff_startcode_find_candidate_func();
+
+    return 0;
+}
+
 static void hevc_parser_close(AVCodecParserContext *s)
 {
     HEVCParserContext *ctx = s->priv_data;
@@ -353,6 +379,7 @@ static void hevc_parser_close(AVCodecParserContext *s)
 const AVCodecParser ff_hevc_parser = {
     .codec_ids      = { AV_CODEC_ID_HEVC },
     .priv_data_size = sizeof(HEVCParserContext),
+    .parser_init    = hevc_parser_init,
     .parser_parse   = hevc_parse,
     .parser_close   = hevc_parser_close,
 };
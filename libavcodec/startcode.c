@@ -25,10 +25,20 @@
  * @author Michael Niedermayer <michaelni@gmx.at>
  */
 
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
 #include "libavutil/intreadwrite.h"
 #include "startcode.h"
 #include "config.h"
 
+#if ARCH_AARCH64
+#include "libavutil/aarch64/cpu.h"
+#include "aarch64/startcode.h"
+#elif ARCH_X86
+#include "libavutil/x86/cpu.h"
+#include "x86/startcode.h"
+#endif
+
 int ff_startcode_find_candidate_c(const uint8_t *buf, int size)
 {
     int i = 0;
@@ -54,5 +64,28 @@ int ff_startcode_find_candidate_c(const uint8_t *buf, int size)
     for (; i < size; i++)
         if (!buf[i])
             break;
-    return i;
+    return FFMIN(i, FFMAX(size, 0));
+}
+
+StartcodeFindCandidateFunc ff_startcode_find_candidate_func(void)
+{
+    av_unused int cpu_flags = av_get_cpu_flags();
+
+#if ARCH_AARCH64
+    if (have_neon(cpu_flags))
+        return ff_startcode_find_candidate_neon;
+#elif ARCH_X86 && HAVE_X86ASM
+#if HAVE_AVX512_EXTERNAL && ARCH_X86_64
+    if (EXTERNAL_AVX512(cpu_flags))
+        return ff_startcode_find_candidate_avx512;
+#endif
+#if HAVE_AVX2_EXTERNAL
+    if (EXTERNAL_AVX2_FAST(cpu_flags))
+        return ff_startcode_find_candidate_avx2;
+#endif
+    if (EXTERNAL_SSE2(cpu_flags))
+        return ff_startcode_find_candidate_sse2;
+#endif
+
+    return ff_startcode_find_candidate_c;
 }
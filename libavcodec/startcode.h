@@ -31,6 +31,21 @@ const uint8_t *avpriv_find_start_code(const uint8_t *p,
                                       const uint8_t *end,
                                       uint32_t *state);
 
+typedef int (*StartcodeFindCandidateFunc)(const uint8_t *buf, int size);
+
+/**
+ * Return the offset of the first zero byte in buf, or size if there is none.
+ * buf must be followed by AV_INPUT_BUFFER_PADDING_SIZE readable bytes.
+ */
 int ff_startcode_find_candidate_c(const uint8_t *buf, int size);
 
+/**
+ * Return the fastest startcode_find_candidate implementation for the
+ * running CPU. All of them follow the first-zero contract of the C version;
+ * the ARMv6 one, which only finds candidates, is set by the DSP inits.
+ * The result depends on av_get_cpu_flags(), so callers should keep it
+ * instead of calling this per buffer.
+ */
+StartcodeFindCandidateFunc ff_startcode_find_candidate_func(void);
+
 #endif /* AVCODEC_STARTCODE_H */
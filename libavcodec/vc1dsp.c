@@ -1030,7 +1030,7 @@ av_cold void ff_vc1dsp_init(VC1DSPContext *dsp)
     dsp->sprite_v_double_twoscale = sprite_v_double_twoscale_c;
 #endif /* CONFIG_WMV3IMAGE_DECODER || CONFIG_VC1IMAGE_DECODER */
 
-    dsp->startcode_find_candidate = ff_startcode_find_candidate_c;
+    dsp->startcode_find_candidate = ff_startcode_find_candidate_func();
     dsp->vc1_unescape_buffer      = vc1_unescape_buffer;
 
 #if ARCH_AARCH64
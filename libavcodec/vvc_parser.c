@@ -20,9 +20,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/intreadwrite.h"
+
 #include "cbs.h"
 #include "cbs_h266.h"
 #include "parser.h"
+#include "startcode.h"
 
 #define START_CODE 0x000001 ///< start_code_prefix_one_3bytes
 #define IS_IDR(nut)   (nut == VVC_IDR_W_RADL || nut == VVC_IDR_N_LP)
@@ -54,6 +57,8 @@ typedef struct VVCParserContext {
     AuDetector au_detector;
 
     int parsed_extradata;
+
+    StartcodeFindCandidateFunc find_candidate;
 } VVCParserContext;
 
 static const enum AVPixelFormat pix_fmts_8bit[] = {
@@ -86,11 +91,24 @@ static int find_frame_end(AVCodecParserContext *s, const uint8_t *buf,
 {
     VVCParserContext *ctx = s->priv_data;
     ParseContext *pc = &ctx->pc;
+    StartcodeFindCandidateFunc find_candidate = ctx->find_candidate;
     int i;
 
     for (i = 0; i < buf_size; i++) {
         int nut, code_len;
 
+        /* a start code can only be completed 5 bytes after a zero byte,
+         * so jump to the next such position; state64 holds the last 8 bytes */
+        if (i >= 8 && buf[i - 5]) {
+            int next = i + 1 + find_candidate(buf + i - 4, buf_size - i + 4);
+            if (next >= buf_size) {
+                pc->state64 = AV_RB64(buf + buf_size - 8);
+                break;
+            }
+            pc->state64 = AV_RB64(buf + next - 8);
+            i = next;
+        }
+
         pc->state64 = (pc->state64 << 8) | buf[i];
 
         if (((pc->state64 >> 3 * 8) & 0xFFFFFF) != START_CODE)
@@ -489,6 +507,7 @@ static av_cold int vvc_parser_init(AVCodecParserContext *s)
     if (ret < 0)
         return ret;
     au_detector_init(&ctx->au_detector);
+    ctx->find_candidate = ff_startcode_find_candidate_func();
 
     ctx->cbc->decompose_unit_types    = decompose_unit_types;
     ctx->cbc->nb_decompose_unit_types = FF_ARRAY_ELEMS(decompose_unit_types);
@@ -0,0 +1,77 @@
+;******************************************************************************
+;* SIMD start code candidate search
+;*
+;* This file is part of FFmpeg.
+;*
+;* FFmpeg is free software; you can redistribute it and/or
+;* modify it under the terms of the GNU Lesser General Public
+;* License as published by the Free Software Foundation; either
+;* version 2.1 of the License, or (at your option) any later version.
+;*
+;* FFmpeg is distributed in the hope that it will be useful,
+;* but WITHOUT ANY WARRANTY; without even the implied warranty of
+;* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;* Lesser General Public License for more details.
+;*
+;* You should have received a copy of the GNU Lesser General Public
+;* License along with FFmpeg; if not, write to the Free Software
+;* Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+;******************************************************************************
+
+%include "libavutil/x86/x86util.asm"
+
+SECTION .text
+
+;-----------------------------------------------------------------------------
+; int ff_startcode_find_candidate(const uint8_t *buf, int size)
+;
+; Returns the offset of the first zero byte in buf, or size if there is none.
+; Whole vectors are loaded, so up to mmsize - 1 bytes after buf + size are
+; read; they are covered by the input padding.
+;-----------------------------------------------------------------------------
+%macro STARTCODE_FIND_CANDIDATE 0
+cglobal startcode_find_candidate, 2, 4, 2, buf, size, idx, mask
+    movsxdifnidn sizeq, sized
+    xor           idxd, idxd
+    test         sizeq, sizeq
+    jle .end
+    pxor            m0, m0
+.loop:
+%if cpuflag(avx512)
+    vpcmpeqb        k1, m0, [bufq+idxq]
+    kmovq        maskq, k1
+%else
+    movu            m1, [bufq+idxq]
+    pcmpeqb         m1, m0
+    pmovmskb     maskd, m1
+%endif
+    test         maskq, maskq
+    jnz .found
+    add           idxq, mmsize
+    cmp           idxq, sizeq
+    jl .loop
+    mov            eax, sized
+    RET
+.found:
+    bsf          maskq, maskq
+    add           idxq, maskq
+    cmp           idxq, sizeq
+    jle .end
+    mov           idxq, sizeq
+.end:
+    mov            eax, idxd
+    RET
+%endmacro
+
+INIT_XMM sse2
+STARTCODE_FIND_CANDIDATE
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+STARTCODE_FIND_CANDIDATE
+%endif
+
+%if HAVE_AVX512_EXTERNAL && ARCH_X86_64
+INIT_ZMM avx512
+STARTCODE_FIND_CANDIDATE
+%endif
@@ -149,6 +149,8 @@ void avformat_free_context(AVFormatContext *s)
     if (s->oformat && ffofmt(s->oformat)->deinit && si->initialized)
         ffofmt(s->oformat)->deinit(s);
 
+    ff_parse_workers_free(s);
+
     av_opt_free(s);
     if (s->iformat && s->iformat->priv_class && s->priv_data)
         av_opt_free(s->priv_data);
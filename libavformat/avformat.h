@@ -1429,6 +1429,7 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_SHORTEST   0x100000 ///< Stop muxing when the shortest stream stops.
 #endif
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+#define AVFMT_FLAG_FAST_PROBE 0x400000 ///< Finish avformat_find_stream_info() from parser-level information, without decoding
 
     /**
      * Maximum number of bytes read from input in order to determine stream
@@ -1870,6 +1871,17 @@ typedef struct AVFormatContext {
      * @return 0 on success, a negative AVERROR code on failure
      */
     int (*io_close2)(struct AVFormatContext *s, AVIOContext *pb);
+
+    /**
+     * Number of threads used to run the parsers of video streams, so
+     * that the streams of a multi-program input are parsed in parallel.
+     * Packets are still returned in the same order as without threads.
+     * 0 parses all streams on the calling thread.
+     *
+     * - demuxing: Set by user
+     * - muxing: unused
+     */
+    int parse_threads;
 } AVFormatContext;
 
 /**
@@ -509,7 +509,7 @@ int avio_open(AVIOContext **s, const char *filename, int flags)
 
 
 static inline int retry_transfer_wrapper(URLContext *h, uint8_t *buf,
-                                         const uint8_t *cbuf,
+                                         const uint8_t *cbuf, AVBufferRef *ref,
                                          int size, int size_min,
                                          int read)
 {
@@ -521,8 +521,12 @@ static inline int retry_transfer_wrapper(URLContext *h, uint8_t *buf,
     while (len < size_min) {
         if (ff_check_interrupt(&h->interrupt_callback))
             return AVERROR_EXIT;
-        ret = read ? h->prot->url_read (h, buf + len, size - len):
-                     h->prot->url_write(h, cbuf + len, size - len);
+        if (read)
+            ret = h->prot->url_read(h, buf + len, size - len);
+        else if (ref)
+            ret = h->prot->url_write_buffer(h, cbuf + len, size - len, ref);
+        else
+            ret = h->prot->url_write(h, cbuf + len, size - len);
         if (ret == AVERROR(EINTR))
             continue;
         if (h->flags & AVIO_FLAG_NONBLOCK)
@@ -564,14 +568,14 @@ int ffurl_read2(void *urlcontext, uint8_t *buf, int size)
 
     if (!(h->flags & AVIO_FLAG_READ))
         return AVERROR(EIO);
-    return retry_transfer_wrapper(h, buf, NULL, size, 1, 1);
+    return retry_transfer_wrapper(h, buf, NULL, NULL, size, 1, 1);
 }
 
 int ffurl_read_complete(URLContext *h, unsigned char *buf, int size)
 {
     if (!(h->flags & AVIO_FLAG_READ))
         return AVERROR(EIO);
-    return retry_transfer_wrapper(h, buf, NULL, size, size, 1);
+    return retry_transfer_wrapper(h, buf, NULL, NULL, size, size, 1);
 }
 
 int ffurl_write2(void *urlcontext, const uint8_t *buf, int size)
@@ -584,7 +588,21 @@ int ffurl_write2(void *urlcontext, const uint8_t *buf, int size)
     if (h->max_packet_size && size > h->max_packet_size)
         return AVERROR(EIO);
 
-    return retry_transfer_wrapper(h, NULL, buf, size, size, 0);
+    return retry_transfer_wrapper(h, NULL, buf, NULL, size, size, 0);
+}
+
+int ffurl_write_buffer(URLContext *h, const uint8_t *data, int size,
+                       AVBufferRef *buf)
+{
+    if (!(h->flags & AVIO_FLAG_WRITE))
+        return AVERROR(EIO);
+    /* avoid sending too big packets */
+    if (h->max_packet_size && size > h->max_packet_size)
+        return AVERROR(EIO);
+    if (!h->prot->url_write_buffer)
+        buf = NULL;
+
+    return retry_transfer_wrapper(h, NULL, data, buf, size, size, 0);
 }
 
 int64_t ffurl_seek2(void *urlcontext, int64_t pos, int whence)
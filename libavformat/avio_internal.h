@@ -21,6 +21,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -121,6 +122,15 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
 
 void ffio_fill(AVIOContext *s, int b, int64_t count);
 
+/**
+ * Write the data of a refcounted buffer, like avio_write(buf->data, buf->size).
+ *
+ * If s writes to a protocol, the buffered data is flushed and buf itself is
+ * passed to ffurl_write_buffer(), so that the protocol can send it without
+ * copying. The data must not be modified afterwards.
+ */
+void ffio_write_buffer(AVIOContext *s, AVBufferRef *buf);
+
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
 {
     avio_wl32(pb, MKTAG(s[0], s[1], s[2], s[3]));
@@ -30,6 +30,7 @@
 #include "avio.h"
 #include "avio_internal.h"
 #include "internal.h"
+#include "url.h"
 #include <stdarg.h>
 
 #define IO_BUFFER_SIZE 32768
@@ -127,12 +128,15 @@ void avio_context_free(AVIOContext **ps)
     av_freep(ps);
 }
 
-static void writeout(AVIOContext *s, const uint8_t *data, int len)
+static void writeout_buffer(AVIOContext *s, const uint8_t *data, int len,
+                            AVBufferRef *ref)
 {
     FFIOContext *const ctx = ffiocontext(s);
     if (!s->error) {
         int ret = 0;
-        if (s->write_data_type)
+        if (ref)
+            ret = ffurl_write_buffer(ffio_geturlcontext(s), data, len, ref);
+        else if (s->write_data_type)
             ret = s->write_data_type(s->opaque, data,
                                      len,
                                      ctx->current_type,
@@ -159,6 +163,11 @@ static void writeout(AVIOContext *s, const uint8_t *data, int len)
     s->pos += len;
 }
 
+static void writeout(AVIOContext *s, const uint8_t *data, int len)
+{
+    writeout_buffer(s, data, len, NULL);
+}
+
 static void flush_buffer(AVIOContext *s)
 {
     s->buf_ptr_max = FFMAX(s->buf_ptr, s->buf_ptr_max);
@@ -219,6 +228,18 @@ void avio_write(AVIOContext *s, const unsigned char *buf, int size)
     } while (size > 0);
 }
 
+void ffio_write_buffer(AVIOContext *s, AVBufferRef *buf)
+{
+    if (buf->size <= 0)
+        return;
+    if (!ffio_geturlcontext(s) || s->write_data_type || s->update_checksum) {
+        avio_write(s, buf->data, buf->size);
+        return;
+    }
+    avio_flush(s);
+    writeout_buffer(s, buf->data, buf->size, buf);
+}
+
 void avio_flush(AVIOContext *s)
 {
     int seekback = s->write_flag ? FFMIN(0, s->buf_ptr - s->buf_ptr_max) : 0;
@@ -990,7 +1011,8 @@ void ffio_write_lines(AVIOContext *s, const unsigned char *buf, int size,
 int ffio_copy_url_options(AVIOContext* pb, AVDictionary** avio_opts)
 {
     const char *opts[] = {
-        "headers", "user_agent", "cookies", "http_proxy", "referer", "rw_timeout", "icy", NULL };
+        "headers", "user_agent", "cookies", "http_proxy", "referer", "rw_timeout", "icy",
+        "connection_pool", NULL };
     const char **opt = opts;
     uint8_t *buf = NULL;
     int ret = 0;
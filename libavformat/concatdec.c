@@ -18,12 +18,15 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
+
 #include "libavutil/avstring.h"
 #include "libavutil/avassert.h"
 #include "libavutil/bprint.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/parseutils.h"
+#include "libavutil/thread.h"
 #include "libavutil/timestamp.h"
 #include "libavcodec/codec_desc.h"
 #include "libavcodec/bsf.h"
@@ -38,6 +41,12 @@ typedef enum ConcatMatchMode {
     MATCH_EXACT_ID,
 } ConcatMatchMode;
 
+typedef enum ConcatPrefetchState {
+    PREFETCH_NONE,
+    PREFETCH_PENDING,   ///< being opened by the prefetch thread
+    PREFETCH_DONE,      ///< prefetch_avf and prefetch_ret are set
+} ConcatPrefetchState;
+
 typedef struct ConcatStream {
     AVBSFContext *bsf;
     int out_stream_index;
@@ -57,6 +66,9 @@ typedef struct {
     AVDictionary *metadata;
     AVDictionary *options;
     int nb_streams;
+    ConcatPrefetchState prefetch_state;
+    AVFormatContext *prefetch_avf;
+    int prefetch_ret;
 } ConcatFile;
 
 typedef struct {
@@ -71,6 +83,16 @@ typedef struct {
     ConcatMatchMode stream_match_mode;
     unsigned auto_convert;
     int segment_time_metadata;
+    int prefetch;                   ///< number of files to open ahead of the current one
+#if HAVE_THREADS
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_lock;
+    pthread_cond_t prefetch_cond;
+    int prefetch_sync_initialized;
+    int prefetch_thread_started;
+    unsigned prefetch_cur;          ///< file the prefetch window starts after
+    atomic_int prefetch_stop;
+#endif
 } ConcatContext;
 
 static int concat_probe(const AVProbeData *probe)
@@ -331,42 +353,198 @@ static int64_t get_best_effort_duration(ConcatFile *file, AVFormatContext *avf)
     return AV_NOPTS_VALUE;
 }
 
-static int open_file(AVFormatContext *avf, unsigned fileno)
+/**
+ * Open and probe the input of a file. Only reads from the concat context
+ * and the file entry, so that it can also run on the prefetch thread.
+ */
+static int open_input(AVFormatContext *avf, ConcatFile *file,
+                      AVFormatContext **pic, const AVIOInterruptCB *int_cb)
 {
-    ConcatContext *cat = avf->priv_data;
-    ConcatFile *file = &cat->files[fileno];
+    AVFormatContext *ic;
     AVDictionary *options = NULL;
     int ret;
 
-    if (cat->avf)
-        avformat_close_input(&cat->avf);
-
-    cat->avf = avformat_alloc_context();
-    if (!cat->avf)
+    *pic = ic = avformat_alloc_context();
+    if (!ic)
         return AVERROR(ENOMEM);
 
-    cat->avf->flags |= avf->flags & ~AVFMT_FLAG_CUSTOM_IO;
-    cat->avf->interrupt_callback = avf->interrupt_callback;
+    ic->flags |= avf->flags & ~AVFMT_FLAG_CUSTOM_IO;
+    ic->interrupt_callback = *int_cb;
 
-    if ((ret = ff_copy_whiteblacklists(cat->avf, avf)) < 0)
-        return ret;
+    if ((ret = ff_copy_whiteblacklists(ic, avf)) < 0)
+        goto fail;
 
     ret = av_dict_copy(&options, file->options, 0);
     if (ret < 0)
-        return ret;
+        goto fail;
 
-    if ((ret = avformat_open_input(&cat->avf, file->url, NULL, &options)) < 0 ||
-        (ret = avformat_find_stream_info(cat->avf, NULL)) < 0) {
+    if ((ret = avformat_open_input(pic, file->url, NULL, &options)) < 0 ||
+        (ret = avformat_find_stream_info(*pic, NULL)) < 0) {
         av_log(avf, AV_LOG_ERROR, "Impossible to open '%s'\n", file->url);
         av_dict_free(&options);
-        avformat_close_input(&cat->avf);
-        return ret;
+        goto fail;
     }
     if (options) {
         av_log(avf, AV_LOG_WARNING, "Unused options for '%s'.\n", file->url);
         /* TODO log unused options once we have a proper string API */
         av_dict_free(&options);
     }
+    return 0;
+
+fail:
+    avformat_close_input(pic);
+    return ret;
+}
+
+#if HAVE_THREADS
+static int prefetch_interrupt_cb(void *opaque)
+{
+    AVFormatContext *avf = opaque;
+    ConcatContext *cat = avf->priv_data;
+
+    return atomic_load(&cat->prefetch_stop) ||
+           ff_check_interrupt(&avf->interrupt_callback);
+}
+
+static void *prefetch_thread(void *arg)
+{
+    AVFormatContext *avf = arg;
+    ConcatContext *cat = avf->priv_data;
+    const AVIOInterruptCB int_cb = { prefetch_interrupt_cb, avf };
+
+    ff_thread_setname("concat-prefetch");
+
+    pthread_mutex_lock(&cat->prefetch_lock);
+    while (!atomic_load(&cat->prefetch_stop)) {
+        unsigned end = FFMIN(cat->nb_files - cat->prefetch_cur - 1,
+                             cat->prefetch) + cat->prefetch_cur + 1;
+        AVFormatContext *ic;
+        ConcatFile *file = NULL;
+        int ret;
+
+        for (unsigned i = cat->prefetch_cur + 1; i < end; i++) {
+            if (cat->files[i].prefetch_state == PREFETCH_NONE) {
+                file = &cat->files[i];
+                break;
+            }
+        }
+        if (!file) {
+            pthread_cond_wait(&cat->prefetch_cond, &cat->prefetch_lock);
+            continue;
+        }
+
+        file->prefetch_state = PREFETCH_PENDING;
+        pthread_mutex_unlock(&cat->prefetch_lock);
+
+        av_log(avf, AV_LOG_VERBOSE, "Prefetching '%s'\n", file->url);
+        ret = open_input(avf, file, &ic, &int_cb);
+
+        pthread_mutex_lock(&cat->prefetch_lock);
+        file->prefetch_avf   = ic;
+        file->prefetch_ret   = ret;
+        file->prefetch_state = PREFETCH_DONE;
+        pthread_cond_broadcast(&cat->prefetch_cond);
+    }
+    pthread_mutex_unlock(&cat->prefetch_lock);
+
+    return NULL;
+}
+
+static int prefetch_start(AVFormatContext *avf)
+{
+    ConcatContext *cat = avf->priv_data;
+    int ret;
+
+    if ((ret = pthread_mutex_init(&cat->prefetch_lock, NULL))) {
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&cat->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&cat->prefetch_lock);
+        return AVERROR(ret);
+    }
+    cat->prefetch_sync_initialized = 1;
+
+    atomic_init(&cat->prefetch_stop, 0);
+    if ((ret = pthread_create(&cat->prefetch_thread, NULL, prefetch_thread, avf))) {
+        av_log(avf, AV_LOG_ERROR, "Failed to start the prefetch thread\n");
+        return AVERROR(ret);
+    }
+    cat->prefetch_thread_started = 1;
+    return 0;
+}
+
+static void prefetch_stop(AVFormatContext *avf)
+{
+    ConcatContext *cat = avf->priv_data;
+
+    if (cat->prefetch_thread_started) {
+        pthread_mutex_lock(&cat->prefetch_lock);
+        atomic_store(&cat->prefetch_stop, 1);
+        pthread_cond_broadcast(&cat->prefetch_cond);
+        pthread_mutex_unlock(&cat->prefetch_lock);
+        pthread_join(cat->prefetch_thread, NULL);
+        cat->prefetch_thread_started = 0;
+    }
+    if (cat->prefetch_sync_initialized) {
+        pthread_cond_destroy(&cat->prefetch_cond);
+        pthread_mutex_destroy(&cat->prefetch_lock);
+        cat->prefetch_sync_initialized = 0;
+    }
+}
+
+/**
+ * Move the prefetch window to the files following fileno and return the
+ * input prefetched for fileno, if any. Prefetched inputs that fell out of
+ * the window, e.g. after a seek, are closed.
+ */
+static AVFormatContext *prefetch_take(AVFormatContext *avf, unsigned fileno)
+{
+    ConcatContext *cat = avf->priv_data;
+    ConcatFile *file = &cat->files[fileno];
+    AVFormatContext *ic = NULL;
+
+    pthread_mutex_lock(&cat->prefetch_lock);
+    while (file->prefetch_state == PREFETCH_PENDING)
+        pthread_cond_wait(&cat->prefetch_cond, &cat->prefetch_lock);
+    if (file->prefetch_state == PREFETCH_DONE) {
+        if (file->prefetch_ret >= 0)
+            ic = file->prefetch_avf;
+        file->prefetch_avf   = NULL;
+        file->prefetch_state = PREFETCH_NONE;
+    }
+    cat->prefetch_cur = fileno;
+    for (unsigned i = 0; i < cat->nb_files; i++) {
+        if (cat->files[i].prefetch_state == PREFETCH_DONE &&
+            (i <= fileno || i - fileno > cat->prefetch)) {
+            avformat_close_input(&cat->files[i].prefetch_avf);
+            cat->files[i].prefetch_state = PREFETCH_NONE;
+        }
+    }
+    pthread_cond_broadcast(&cat->prefetch_cond);
+    pthread_mutex_unlock(&cat->prefetch_lock);
+
+    return ic;
+}
+#endif
+
+static int open_file(AVFormatContext *avf, unsigned fileno)
+{
+    ConcatContext *cat = avf->priv_data;
+    ConcatFile *file = &cat->files[fileno];
+    AVFormatContext *ic = NULL;
+    int ret;
+
+    if (cat->avf)
+        avformat_close_input(&cat->avf);
+
+#if HAVE_THREADS
+    if (cat->prefetch_thread_started)
+        ic = prefetch_take(avf, fileno);
+#endif
+    /* A failed prefetch is retried here, and reported if it fails again. */
+    if (!ic && (ret = open_input(avf, file, &ic, &avf->interrupt_callback)) < 0)
+        return ret;
+    cat->avf = ic;
     cat->cur_file = file;
     file->start_time = !fileno ? 0 :
                        cat->files[fileno - 1].start_time +
@@ -395,7 +573,11 @@ static int concat_read_close(AVFormatContext *avf)
     ConcatContext *cat = avf->priv_data;
     unsigned i, j;
 
+#if HAVE_THREADS
+    prefetch_stop(avf);
+#endif
     for (i = 0; i < cat->nb_files; i++) {
+        avformat_close_input(&cat->files[i].prefetch_avf);
         av_freep(&cat->files[i].url);
         for (j = 0; j < cat->files[i].nb_streams; j++) {
             if (cat->files[i].streams[j].bsf)
@@ -690,6 +872,17 @@ static int concat_read_header(AVFormatContext *avf)
 
     cat->stream_match_mode = avf->nb_streams ? MATCH_EXACT_ID :
                                                MATCH_ONE_TO_ONE;
+
+    if (cat->prefetch && cat->nb_files > 1) {
+#if HAVE_THREADS
+        if ((ret = prefetch_start(avf)) < 0)
+            return ret;
+#else
+        av_log(avf, AV_LOG_ERROR, "prefetch requires threading support\n");
+        return AVERROR(ENOSYS);
+#endif
+    }
+
     if ((ret = open_file(avf, 0)) < 0)
         return ret;
 
@@ -933,6 +1126,8 @@ static const AVOption options[] = {
       OFFSET(auto_convert), AV_OPT_TYPE_BOOL, {.i64 = 1}, 0, 1, DEC },
     { "segment_time_metadata", "output file segment start time and duration as packet metadata",
       OFFSET(segment_time_metadata), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, DEC },
+    { "prefetch", "number of files to open and probe ahead of the current one",
+      OFFSET(prefetch), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, DEC },
     { NULL }
 };
 
@@ -23,9 +23,11 @@
 
 #include <libavformat/avformat.h>
 #include <libavformat/avio.h>
+#include <libavformat/avio_internal.h>
 #include <libavformat/internal.h>
 #include <libavformat/url.h>
 #include <libavutil/avstring.h>
+#include <libavutil/buffer.h>
 #include <libavutil/dict.h>
 #include <libavutil/error.h>
 #include <libavutil/log.h>
@@ -54,8 +56,7 @@ typedef struct buffer_data {
 } buffer_data;
 
 typedef struct Chunk {
-    unsigned char *buf;
-    int size;
+    AVBufferRef *buf; /* Refcounted so the TCP layer can send it without copying */
 } Chunk;
 
 typedef struct ChunksStorage {
@@ -132,7 +133,7 @@ static void release_request(connection *conn) {
     pthread_mutex_lock(&conn->chunks.mutex);
     for (int i = 0; i < conn->chunks.nr_of_chunks; i++) {
         Chunk *chunk = conn->chunks.storage[i];
-        av_free(chunk->buf);
+        av_buffer_unref(&chunk->buf);
         av_free(chunk);
     }
     av_freep((void*)&conn->chunks.storage);
@@ -185,7 +186,7 @@ static bool write_chunk_if_available(connection *conn) {
 
 
     start_time_ms = US_TO_MS(av_gettime());
-    avio_write(conn->out, chunk->buf, chunk->size);
+    ffio_write_buffer(conn->out, chunk->buf);
     after_write_time_ms = US_TO_MS(av_gettime());
     write_time_ms = after_write_time_ms - start_time_ms;
     if (write_time_ms > kWarningTreshold) {
@@ -786,13 +787,13 @@ void pool_write_flush(const unsigned char *buf, const int size, const int conn_n
         return;
     }
 
-    new_chunk->size = size;
-    new_chunk->buf = av_mallocz(size);
+    new_chunk->buf = av_buffer_alloc(size);
     if (new_chunk->buf == NULL) {
         av_log(NULL, AV_LOG_WARNING, "Could not malloc pool_write_flush.\n");
+        av_free(new_chunk);
         return;
     }
-    memcpy(new_chunk->buf, buf, size);
+    memcpy(new_chunk->buf->data, buf, size);
 
     pthread_mutex_lock(&conn->chunks.mutex);
     av_dynarray_add((void*)&conn->chunks.storage, &conn->chunks.nr_of_chunks, new_chunk);
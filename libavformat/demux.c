@@ -31,6 +31,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/timestamp.h"
 
@@ -38,6 +39,7 @@
 #include "libavcodec/bsf.h"
 #include "libavcodec/codec_desc.h"
 #include "libavcodec/internal.h"
+#include "libavcodec/mpeg4audio.h"
 #include "libavcodec/packet_internal.h"
 #include "libavcodec/raw.h"
 
@@ -374,6 +376,8 @@ void avformat_close_input(AVFormatContext **ps)
         (s->flags & AVFMT_FLAG_CUSTOM_IO))
         pb = NULL;
 
+    ff_parse_workers_free(s);
+
     if (s->iformat)
         if (ffifmt(s->iformat)->read_close)
             ffifmt(s->iformat)->read_close(s);
@@ -1145,6 +1149,74 @@ static void compute_pkt_fields(AVFormatContext *s, AVStream *st,
         pkt->flags |= AV_PKT_FLAG_KEY;
 }
 
+/**
+ * Turn the parser output in out_pkt->data/size into a packet: make it
+ * refcounted, move over the side data of the input packet pkt and set
+ * timestamps, duration and flags from the parser state.
+ */
+static int init_parsed_packet(AVStream *st, AVPacket *pkt, AVPacket *out_pkt)
+{
+    FFStream *const sti = ffstream(st);
+    int ret;
+
+    if (pkt->buf && out_pkt->data == pkt->data) {
+        /* reference pkt->buf only when out_pkt->data is guaranteed to point
+         * to data in it and not in the parser's internal buffer. */
+        /* XXX: Ensure this is the case with all parsers when sti->parser->flags
+         * is PARSER_FLAG_COMPLETE_FRAMES and check for that instead? */
+        out_pkt->buf = av_buffer_ref(pkt->buf);
+        if (!out_pkt->buf)
+            return AVERROR(ENOMEM);
+    } else {
+        ret = av_packet_make_refcounted(out_pkt);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (pkt->side_data) {
+        out_pkt->side_data       = pkt->side_data;
+        out_pkt->side_data_elems = pkt->side_data_elems;
+        pkt->side_data          = NULL;
+        pkt->side_data_elems    = 0;
+    }
+
+    /* set the duration */
+    out_pkt->duration = (sti->parser->flags & PARSER_FLAG_COMPLETE_FRAMES) ? pkt->duration : 0;
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (sti->avctx->sample_rate > 0) {
+            out_pkt->duration =
+                av_rescale_q_rnd(sti->parser->duration,
+                                 (AVRational) { 1, sti->avctx->sample_rate },
+                                 st->time_base,
+                                 AV_ROUND_DOWN);
+        }
+    } else if (st->codecpar->codec_id == AV_CODEC_ID_GIF) {
+        if (st->time_base.num > 0 && st->time_base.den > 0 &&
+            sti->parser->duration) {
+            out_pkt->duration = sti->parser->duration;
+        }
+    }
+
+    out_pkt->stream_index = st->index;
+    out_pkt->pts          = sti->parser->pts;
+    out_pkt->dts          = sti->parser->dts;
+    out_pkt->pos          = sti->parser->pos;
+    out_pkt->flags       |= pkt->flags & (AV_PKT_FLAG_DISCARD | AV_PKT_FLAG_CORRUPT);
+
+    if (sti->need_parsing == AVSTREAM_PARSE_FULL_RAW)
+        out_pkt->pos = sti->parser->frame_offset;
+
+    if (sti->parser->key_frame == 1 ||
+        (sti->parser->key_frame == -1 &&
+         sti->parser->pict_type == AV_PICTURE_TYPE_I))
+        out_pkt->flags |= AV_PKT_FLAG_KEY;
+
+    if (sti->parser->key_frame == -1 && sti->parser->pict_type ==AV_PICTURE_TYPE_NONE && (pkt->flags&AV_PKT_FLAG_KEY))
+        out_pkt->flags |= AV_PKT_FLAG_KEY;
+
+    return 0;
+}
+
 /**
  * Parse a packet, add all split parts to parse_queue.
  *
@@ -1188,62 +1260,8 @@ static int parse_packet(AVFormatContext *s, AVPacket *pkt,
         if (!out_pkt->size)
             continue;
 
-        if (pkt->buf && out_pkt->data == pkt->data) {
-            /* reference pkt->buf only when out_pkt->data is guaranteed to point
-             * to data in it and not in the parser's internal buffer. */
-            /* XXX: Ensure this is the case with all parsers when sti->parser->flags
-             * is PARSER_FLAG_COMPLETE_FRAMES and check for that instead? */
-            out_pkt->buf = av_buffer_ref(pkt->buf);
-            if (!out_pkt->buf) {
-                ret = AVERROR(ENOMEM);
-                goto fail;
-            }
-        } else {
-            ret = av_packet_make_refcounted(out_pkt);
-            if (ret < 0)
-                goto fail;
-        }
-
-        if (pkt->side_data) {
-            out_pkt->side_data       = pkt->side_data;
-            out_pkt->side_data_elems = pkt->side_data_elems;
-            pkt->side_data          = NULL;
-            pkt->side_data_elems    = 0;
-        }
-
-        /* set the duration */
-        out_pkt->duration = (sti->parser->flags & PARSER_FLAG_COMPLETE_FRAMES) ? pkt->duration : 0;
-        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-            if (sti->avctx->sample_rate > 0) {
-                out_pkt->duration =
-                    av_rescale_q_rnd(sti->parser->duration,
-                                     (AVRational) { 1, sti->avctx->sample_rate },
-                                     st->time_base,
-                                     AV_ROUND_DOWN);
-            }
-        } else if (st->codecpar->codec_id == AV_CODEC_ID_GIF) {
-            if (st->time_base.num > 0 && st->time_base.den > 0 &&
-                sti->parser->duration) {
-                out_pkt->duration = sti->parser->duration;
-            }
-        }
-
-        out_pkt->stream_index = st->index;
-        out_pkt->pts          = sti->parser->pts;
-        out_pkt->dts          = sti->parser->dts;
-        out_pkt->pos          = sti->parser->pos;
-        out_pkt->flags       |= pkt->flags & (AV_PKT_FLAG_DISCARD | AV_PKT_FLAG_CORRUPT);
-
-        if (sti->need_parsing == AVSTREAM_PARSE_FULL_RAW)
-            out_pkt->pos = sti->parser->frame_offset;
-
-        if (sti->parser->key_frame == 1 ||
-            (sti->parser->key_frame == -1 &&
-             sti->parser->pict_type == AV_PICTURE_TYPE_I))
-            out_pkt->flags |= AV_PKT_FLAG_KEY;
-
-        if (sti->parser->key_frame == -1 && sti->parser->pict_type ==AV_PICTURE_TYPE_NONE && (pkt->flags&AV_PKT_FLAG_KEY))
-            out_pkt->flags |= AV_PKT_FLAG_KEY;
+        if ((ret = init_parsed_packet(st, pkt, out_pkt)) < 0)
+            goto fail;
 
         compute_pkt_fields(s, st, sti->parser, out_pkt, next_dts, next_pts);
 
@@ -1266,6 +1284,466 @@ fail:
     return ret;
 }
 
+/**
+ * Propagate what the parser found out about the stream to the codec
+ * parameters.
+ */
+static int update_stream_params_from_parser(AVStream *st)
+{
+    FFStream *const sti = ffstream(st);
+    int ret;
+
+    st->codecpar->sample_rate = sti->avctx->sample_rate;
+    st->codecpar->bit_rate = sti->avctx->bit_rate;
+    ret = av_channel_layout_copy(&st->codecpar->ch_layout, &sti->avctx->ch_layout);
+    if (ret < 0)
+        return ret;
+    st->codecpar->codec_id = sti->avctx->codec_id;
+    return 0;
+}
+
+#if HAVE_THREADS
+enum ParseEntryType {
+    PARSE_ENTRY_RAW,        ///< packet output as is, without parsing
+    PARSE_ENTRY_INLINE,     ///< packet parsed on the demuxing thread
+    PARSE_ENTRY_JOB,        ///< packet parsed on a worker thread
+};
+
+/**
+ * A packet output by a parser on a worker thread, together with the parser
+ * and codec state at the time it was output that compute_pkt_fields() uses.
+ */
+typedef struct ParseResult {
+    AVPacket *pkt;
+    int64_t next_pts, next_dts;
+    int pict_type;
+    int repeat_pict;
+    int64_t offset;
+    int has_b_frames;
+    AVRational framerate;
+} ParseResult;
+
+typedef struct ParseEntry {
+    enum ParseEntryType type;
+    AVStream *st;
+    AVPacket *pkt;
+    /* PARSE_ENTRY_JOB only */
+    int running;            ///< being parsed by a worker, under lock
+    int done;               ///< results are ready, under lock
+    int ret;
+    int has_b_frames;       ///< avctx->has_b_frames when the job was queued
+    ParseResult *results;
+    int nb_results;
+    int nb_results_allocated;
+} ParseEntry;
+
+struct FFParseWorkers {
+    pthread_t *threads;
+    int nb_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;    ///< a job was queued or the workers must exit
+    pthread_cond_t done_cond;   ///< a job was done
+    int exit;
+    /* Ring of the packets read but not finished yet, in demuxing order.
+     * Only entries of type PARSE_ENTRY_JOB are touched by the workers. */
+    ParseEntry *entries;
+    int nb_entries;
+    int head;
+    int count;
+};
+
+static ParseEntry *parse_entry(FFParseWorkers *pw, int i)
+{
+    return &pw->entries[(pw->head + i) % pw->nb_entries];
+}
+
+/**
+ * Run the parser over a whole packet on a worker thread. Only the parser
+ * and the codec context of the stream are modified, the rest of the
+ * bookkeeping is done by parse_entry_finish() on the demuxing thread.
+ */
+static int parse_job_run(ParseEntry *e)
+{
+    AVStream *st = e->st;
+    FFStream *const sti = ffstream(st);
+    AVPacket *pkt = e->pkt;
+    const uint8_t *data = pkt->data;
+    int size = pkt->size;
+    int ret;
+
+    while (size > 0) {
+        int64_t next_pts = pkt->pts;
+        int64_t next_dts = pkt->dts;
+        ParseResult *res;
+        uint8_t *out_data;
+        int out_size, len;
+
+        len = av_parser_parse2(sti->parser, sti->avctx,
+                               &out_data, &out_size, data, size,
+                               pkt->pts, pkt->dts, pkt->pos);
+
+        pkt->pts = pkt->dts = AV_NOPTS_VALUE;
+        pkt->pos = -1;
+        data  = len ? data + len : data;
+        size -= len;
+
+        if (!out_size)
+            continue;
+
+        if (e->nb_results == e->nb_results_allocated) {
+            int n = FFMAX(2 * e->nb_results_allocated, 4);
+            res = av_realloc_array(e->results, n, sizeof(*res));
+            if (!res)
+                return AVERROR(ENOMEM);
+            memset(res + e->nb_results, 0, (n - e->nb_results) * sizeof(*res));
+            e->results = res;
+            e->nb_results_allocated = n;
+        }
+        res = &e->results[e->nb_results];
+        if (!res->pkt && !(res->pkt = av_packet_alloc()))
+            return AVERROR(ENOMEM);
+
+        res->pkt->data = out_data;
+        res->pkt->size = out_size;
+        ret = init_parsed_packet(st, pkt, res->pkt);
+        if (ret < 0) {
+            av_packet_unref(res->pkt);
+            return ret;
+        }
+        res->next_pts     = next_pts;
+        res->next_dts     = next_dts;
+        res->pict_type    = sti->parser->pict_type;
+        res->repeat_pict  = sti->parser->repeat_pict;
+        res->offset       = sti->parser->offset;
+        res->has_b_frames = sti->avctx->has_b_frames;
+        res->framerate    = sti->avctx->framerate;
+        e->nb_results++;
+    }
+
+    return 0;
+}
+
+static void *parse_worker(void *arg)
+{
+    FFParseWorkers *pw = arg;
+
+    ff_thread_setname("lavf-parse");
+
+    pthread_mutex_lock(&pw->lock);
+    while (1) {
+        ParseEntry *e = NULL;
+
+        for (int i = 0; i < pw->count; i++) {
+            ParseEntry *cur = parse_entry(pw, i);
+            if (cur->type == PARSE_ENTRY_JOB && !cur->running && !cur->done) {
+                e = cur;
+                break;
+            }
+        }
+        if (!e) {
+            if (pw->exit)
+                break;
+            pthread_cond_wait(&pw->job_cond, &pw->lock);
+            continue;
+        }
+
+        e->running = 1;
+        pthread_mutex_unlock(&pw->lock);
+
+        e->ret = parse_job_run(e);
+
+        pthread_mutex_lock(&pw->lock);
+        e->running = 0;
+        e->done    = 1;
+        pthread_cond_broadcast(&pw->done_cond);
+    }
+    pthread_mutex_unlock(&pw->lock);
+
+    return NULL;
+}
+
+static void parse_entry_reset(ParseEntry *e)
+{
+    av_packet_unref(e->pkt);
+    for (int i = 0; i < e->nb_results; i++)
+        av_packet_unref(e->results[i].pkt);
+    e->nb_results = 0;
+    e->running    = 0;
+    e->done       = 0;
+    e->ret        = 0;
+}
+
+/**
+ * Wait for the jobs being parsed and drop all entries that are not
+ * finished yet.
+ */
+static void parse_workers_discard(FFParseWorkers *pw)
+{
+    pthread_mutex_lock(&pw->lock);
+    for (int i = 0; i < pw->count; i++) {
+        ParseEntry *e = parse_entry(pw, i);
+        if (e->type == PARSE_ENTRY_JOB && !e->running)
+            e->done = 1;
+    }
+    for (int i = 0; i < pw->count; i++) {
+        ParseEntry *e = parse_entry(pw, i);
+        while (e->running)
+            pthread_cond_wait(&pw->done_cond, &pw->lock);
+    }
+    for (int i = 0; i < pw->count; i++)
+        parse_entry_reset(parse_entry(pw, i));
+    pw->head  = 0;
+    pw->count = 0;
+    pthread_mutex_unlock(&pw->lock);
+}
+
+void ff_parse_workers_flush(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+
+    if (si->parse_workers)
+        parse_workers_discard(si->parse_workers);
+}
+
+void ff_parse_workers_free(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    FFParseWorkers *pw = si->parse_workers;
+
+    if (!pw)
+        return;
+
+    parse_workers_discard(pw);
+
+    pthread_mutex_lock(&pw->lock);
+    pw->exit = 1;
+    pthread_cond_broadcast(&pw->job_cond);
+    pthread_mutex_unlock(&pw->lock);
+    for (int i = 0; i < pw->nb_threads; i++)
+        pthread_join(pw->threads[i], NULL);
+
+    for (int i = 0; i < pw->nb_entries; i++) {
+        ParseEntry *e = &pw->entries[i];
+        av_packet_free(&e->pkt);
+        for (int j = 0; j < e->nb_results_allocated; j++)
+            av_packet_free(&e->results[j].pkt);
+        av_freep(&e->results);
+    }
+    av_freep(&pw->entries);
+    av_freep(&pw->threads);
+    pthread_cond_destroy(&pw->done_cond);
+    pthread_cond_destroy(&pw->job_cond);
+    pthread_mutex_destroy(&pw->lock);
+    av_freep(&si->parse_workers);
+}
+
+static int parse_workers_init(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    FFParseWorkers *pw;
+    int ret;
+
+    pw = av_mallocz(sizeof(*pw));
+    if (!pw)
+        return AVERROR(ENOMEM);
+
+    if ((ret = pthread_mutex_init(&pw->lock, NULL))) {
+        av_free(pw);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&pw->job_cond, NULL))) {
+        pthread_mutex_destroy(&pw->lock);
+        av_free(pw);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&pw->done_cond, NULL))) {
+        pthread_cond_destroy(&pw->job_cond);
+        pthread_mutex_destroy(&pw->lock);
+        av_free(pw);
+        return AVERROR(ret);
+    }
+    si->parse_workers = pw;
+
+    /* Read ahead far enough that packets of several streams are in flight. */
+    pw->nb_entries = FFMAX(4 * s->parse_threads, 8);
+    pw->entries    = av_calloc(pw->nb_entries, sizeof(*pw->entries));
+    pw->threads    = av_calloc(s->parse_threads, sizeof(*pw->threads));
+    if (!pw->entries || !pw->threads)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < pw->nb_entries; i++) {
+        pw->entries[i].pkt = av_packet_alloc();
+        if (!pw->entries[i].pkt)
+            return AVERROR(ENOMEM);
+    }
+
+    for (int i = 0; i < s->parse_threads; i++) {
+        if ((ret = pthread_create(&pw->threads[i], NULL, parse_worker, pw))) {
+            av_log(s, AV_LOG_ERROR, "Failed to start parser thread: %s\n",
+                   av_err2str(AVERROR(ret)));
+            return AVERROR(ret);
+        }
+        pw->nb_threads++;
+    }
+
+    av_log(s, AV_LOG_VERBOSE, "Parsing video streams with %d threads\n",
+           pw->nb_threads);
+    return 0;
+}
+
+static int parse_entry_push(AVFormatContext *s, enum ParseEntryType type,
+                            AVStream *st, AVPacket *pkt)
+{
+    FFParseWorkers *pw = ffformatcontext(s)->parse_workers;
+    ParseEntry *e;
+
+    av_assert0(pw->count < pw->nb_entries);
+
+    pthread_mutex_lock(&pw->lock);
+    e = parse_entry(pw, pw->count);
+    e->type = type;
+    e->st   = st;
+    av_packet_move_ref(e->pkt, pkt);
+    if (type == PARSE_ENTRY_JOB) {
+        e->has_b_frames = ffstream(st)->avctx->has_b_frames;
+        pthread_cond_signal(&pw->job_cond);
+    }
+    pw->count++;
+    pthread_mutex_unlock(&pw->lock);
+
+    return 0;
+}
+
+/**
+ * Do what read_frame_internal() does after parsing a packet, in the order
+ * the packets were read.
+ */
+static int parse_entry_finish(AVFormatContext *s, ParseEntry *e)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    AVStream *st = e->st;
+    FFStream *const sti = ffstream(st);
+    AVPacket *pkt = e->pkt;
+    int ret = 0;
+
+    switch (e->type) {
+    case PARSE_ENTRY_RAW:
+        compute_pkt_fields(s, st, NULL, pkt, AV_NOPTS_VALUE, AV_NOPTS_VALUE);
+        if ((s->iformat->flags & AVFMT_GENERIC_INDEX) &&
+            (pkt->flags & AV_PKT_FLAG_KEY) && pkt->dts != AV_NOPTS_VALUE) {
+            ff_reduce_index(s, st->index);
+            av_add_index_entry(st, pkt->pos, pkt->dts,
+                               0, 0, AVINDEX_KEYFRAME);
+        }
+        if (pkt->flags & AV_PKT_FLAG_KEY)
+            sti->skip_to_keyframe = 0;
+        if (sti->skip_to_keyframe)
+            av_packet_unref(pkt);
+        else
+            ret = avpriv_packet_list_put(&si->parse_queue, pkt, NULL, 0);
+        break;
+    case PARSE_ENTRY_INLINE:
+        if ((ret = parse_packet(s, pkt, st->index, 0)) >= 0)
+            ret = update_stream_params_from_parser(st);
+        break;
+    case PARSE_ENTRY_JOB: {
+        AVCodecParserContext *pc = sti->parser;
+        int pict_type        = pc->pict_type;
+        int repeat_pict      = pc->repeat_pict;
+        int64_t offset       = pc->offset;
+        int has_b_frames     = sti->avctx->has_b_frames;
+        AVRational framerate = sti->avctx->framerate;
+        int prev_has_b_frames;
+
+        if ((ret = e->ret) < 0)
+            break;
+
+        /* Replay the state the parser was in when each packet was output,
+         * keeping the has_b_frames updates done by compute_pkt_fields()
+         * unless the parser changed it in between. */
+        sti->avctx->has_b_frames = prev_has_b_frames = e->has_b_frames;
+        for (int i = 0; i < e->nb_results && ret >= 0; i++) {
+            ParseResult *res = &e->results[i];
+
+            pc->pict_type    = res->pict_type;
+            pc->repeat_pict  = res->repeat_pict;
+            pc->offset       = res->offset;
+            if (res->has_b_frames != prev_has_b_frames)
+                sti->avctx->has_b_frames = prev_has_b_frames = res->has_b_frames;
+            sti->avctx->framerate = res->framerate;
+
+            compute_pkt_fields(s, st, pc, res->pkt, res->next_dts, res->next_pts);
+            ret = avpriv_packet_list_put(&si->parse_queue, res->pkt, NULL, 0);
+        }
+        pc->pict_type    = pict_type;
+        pc->repeat_pict  = repeat_pict;
+        pc->offset       = offset;
+        if (has_b_frames != prev_has_b_frames)
+            sti->avctx->has_b_frames = has_b_frames;
+        sti->avctx->framerate = framerate;
+
+        if (ret >= 0)
+            ret = update_stream_params_from_parser(st);
+        break;
+    }
+    }
+
+    parse_entry_reset(e);
+    return ret;
+}
+
+/**
+ * Finish pending entries in order. If st is set, wait until there are no
+ * entries left for it. Otherwise wait for the first nb_wait entries to be
+ * parsed, and then finish those that are done.
+ */
+static int parse_workers_collect(AVFormatContext *s, const AVStream *st, int nb_wait)
+{
+    FFParseWorkers *pw = ffformatcontext(s)->parse_workers;
+    int ret = 0;
+
+    while (pw->count && ret >= 0) {
+        ParseEntry *e = parse_entry(pw, 0);
+
+        if (st) {
+            int pending = 0;
+            for (int i = 0; i < pw->count && !pending; i++)
+                pending = parse_entry(pw, i)->st == st;
+            if (!pending)
+                break;
+        }
+
+        if (e->type == PARSE_ENTRY_JOB) {
+            int done;
+            pthread_mutex_lock(&pw->lock);
+            while (!e->done && (st || nb_wait > 0))
+                pthread_cond_wait(&pw->done_cond, &pw->lock);
+            done = e->done;
+            pthread_mutex_unlock(&pw->lock);
+            if (!done)
+                break;
+        }
+
+        ret = parse_entry_finish(s, e);
+
+        pthread_mutex_lock(&pw->lock);
+        pw->head = (pw->head + 1) % pw->nb_entries;
+        pw->count--;
+        pthread_mutex_unlock(&pw->lock);
+        nb_wait--;
+    }
+
+    return ret;
+}
+#else
+void ff_parse_workers_flush(AVFormatContext *s)
+{
+}
+
+void ff_parse_workers_free(AVFormatContext *s)
+{
+}
+#endif
+
 static int64_t ts_to_samples(AVStream *st, int64_t ts)
 {
     return av_rescale(ts, st->time_base.num * st->codecpar->sample_rate, st->time_base.den);
@@ -1327,12 +1805,32 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
     while (!got_packet && !si->parse_queue.head) {
         AVStream *st;
         FFStream *sti;
+#if HAVE_THREADS
+        FFParseWorkers *const pw = si->parse_workers;
+
+        if (pw && pw->count) {
+            /* collect what the workers are done with, and wait for the
+             * oldest packet if we cannot read further ahead */
+            ret = parse_workers_collect(s, NULL, pw->count == pw->nb_entries);
+            if (ret < 0)
+                return ret;
+            if (si->parse_queue.head)
+                break;
+        }
+#endif
 
         /* read next packet */
         ret = ff_read_packet(s, pkt);
         if (ret < 0) {
             if (ret == AVERROR(EAGAIN))
                 return ret;
+#if HAVE_THREADS
+            if (pw) {
+                int err = parse_workers_collect(s, NULL, pw->count);
+                if (err < 0)
+                    return err;
+            }
+#endif
             /* flush the parsers */
             for (unsigned i = 0; i < s->nb_streams; i++) {
                 AVStream *const st  = s->streams[i];
@@ -1352,6 +1850,12 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
 
         /* update context if required */
         if (sti->need_context_update) {
+#if HAVE_THREADS
+            if (pw && (ret = parse_workers_collect(s, st, 0)) < 0) {
+                av_packet_unref(pkt);
+                return ret;
+            }
+#endif
             if (avcodec_is_open(sti->avctx)) {
                 av_log(s, AV_LOG_DEBUG, "Demuxer context update while decoder is open, closing and trying to re-open\n");
                 ret = codec_close(sti);
@@ -1411,6 +1915,37 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
                 sti->parser->flags |= PARSER_FLAG_USE_CODEC_TS;
         }
 
+#if HAVE_THREADS
+        if (st->discard < AVDISCARD_ALL && sti->need_parsing && sti->parser &&
+            st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !sti->info &&
+            s->parse_threads > 0 && pkt->size) {
+            if (!si->parse_workers && (ret = parse_workers_init(s)) < 0) {
+                av_packet_unref(pkt);
+                return ret;
+            }
+            /* the stream must be idle before a worker touches its parser */
+            if (pw && ((ret = parse_workers_collect(s, st, 0)) < 0 ||
+                       (ret = parse_workers_collect(s, NULL, pw->count == pw->nb_entries)) < 0)) {
+                av_packet_unref(pkt);
+                return ret;
+            }
+            parse_entry_push(s, PARSE_ENTRY_JOB, st, pkt);
+            continue;
+        }
+        if (pw && (pw->count || si->parse_queue.head) &&
+            (!sti->need_parsing || !sti->parser || st->discard < AVDISCARD_ALL)) {
+            /* keep the packet behind those still being parsed */
+            if (pw->count == pw->nb_entries &&
+                (ret = parse_workers_collect(s, NULL, 1)) < 0) {
+                av_packet_unref(pkt);
+                return ret;
+            }
+            parse_entry_push(s, !sti->need_parsing || !sti->parser ?
+                                PARSE_ENTRY_RAW : PARSE_ENTRY_INLINE, st, pkt);
+            continue;
+        }
+#endif
+
         if (!sti->need_parsing || !sti->parser) {
             /* no parsing needed: we just output the packet as is */
             compute_pkt_fields(s, st, NULL, pkt, AV_NOPTS_VALUE, AV_NOPTS_VALUE);
@@ -1424,12 +1959,8 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
         } else if (st->discard < AVDISCARD_ALL) {
             if ((ret = parse_packet(s, pkt, pkt->stream_index, 0)) < 0)
                 return ret;
-            st->codecpar->sample_rate = sti->avctx->sample_rate;
-            st->codecpar->bit_rate = sti->avctx->bit_rate;
-            ret = av_channel_layout_copy(&st->codecpar->ch_layout, &sti->avctx->ch_layout);
-            if (ret < 0)
+            if ((ret = update_stream_params_from_parser(st)) < 0)
                 return ret;
-            st->codecpar->codec_id = sti->avctx->codec_id;
         } else {
             /* free packet */
             av_packet_unref(pkt);
@@ -2020,10 +2551,15 @@ static int determinable_frame_size(const AVCodecContext *avctx)
     return 0;
 }
 
-static int has_codec_parameters(const AVStream *st, const char **errmsg_ptr)
+static int has_codec_parameters(const AVFormatContext *ic, const AVStream *st,
+                                const char **errmsg_ptr)
 {
     const FFStream *const sti = cffstream(st);
     const AVCodecContext *const avctx = sti->avctx;
+    /* In fast probe mode audio is not decoded, so do not wait for parameters
+     * only a decoder can provide. */
+    const int decode = !(ic->flags & AVFMT_FLAG_FAST_PROBE) &&
+                       sti->info->found_decoder >= 0;
 
 #define FAIL(errmsg) do {                                         \
         if (errmsg_ptr)                                           \
@@ -2038,19 +2574,21 @@ static int has_codec_parameters(const AVStream *st, const char **errmsg_ptr)
     case AVMEDIA_TYPE_AUDIO:
         if (!avctx->frame_size && determinable_frame_size(avctx))
             FAIL("unspecified frame size");
-        if (sti->info->found_decoder >= 0 &&
-            avctx->sample_fmt == AV_SAMPLE_FMT_NONE)
+        if (decode && avctx->sample_fmt == AV_SAMPLE_FMT_NONE)
             FAIL("unspecified sample format");
         if (!avctx->sample_rate)
             FAIL("unspecified sample rate");
         if (!avctx->ch_layout.nb_channels)
             FAIL("unspecified number of channels");
-        if (sti->info->found_decoder >= 0 && !sti->nb_decoded_frames && avctx->codec_id == AV_CODEC_ID_DTS)
+        if (decode && !sti->nb_decoded_frames && avctx->codec_id == AV_CODEC_ID_DTS)
             FAIL("no decodable DTS frames");
         break;
     case AVMEDIA_TYPE_VIDEO:
         if (!avctx->width)
             FAIL("unspecified size");
+        /* Video is still decoded in fast probe mode until the decoder sets
+         * the pixel format, together with the profile and aspect ratio that
+         * the parsers do not export. */
         if (sti->info->found_decoder >= 0 && avctx->pix_fmt == AV_PIX_FMT_NONE)
             FAIL("unspecified pixel format");
         if (st->codecpar->codec_id == AV_CODEC_ID_RV30 || st->codecpar->codec_id == AV_CODEC_ID_RV40)
@@ -2131,7 +2669,7 @@ static int try_decode_frame(AVFormatContext *s, AVStream *st,
 
     while ((pkt_to_send || (!pkt->data && got_picture)) &&
            ret >= 0 &&
-           (!has_codec_parameters(st, NULL) || !has_decode_delay_been_guessed(st) ||
+           (!has_codec_parameters(s, st, NULL) || !has_decode_delay_been_guessed(st) ||
             (!sti->codec_info_nb_frames &&
              (avctx->codec->capabilities & AV_CODEC_CAP_CHANNEL_CONF)))) {
         got_picture = 0;
@@ -2496,6 +3034,59 @@ static int extract_extradata(FFFormatContext *si, AVStream *st, const AVPacket *
     return 0;
 }
 
+/**
+ * Fill in the video parameters the parser found in the bitstream, which
+ * are otherwise only set by decoding a frame.
+ */
+static void update_params_from_parser(FFStream *sti)
+{
+    const AVCodecParserContext *const pc = sti->parser;
+    AVCodecContext *const avctx = sti->avctx;
+
+    if (avctx->codec_type != AVMEDIA_TYPE_VIDEO)
+        return;
+    if (!avctx->width && pc->width > 0 && pc->height > 0) {
+        avctx->width  = pc->width;
+        avctx->height = pc->height;
+    }
+    if (!avctx->coded_width && pc->coded_width > 0 && pc->coded_height > 0) {
+        avctx->coded_width  = pc->coded_width;
+        avctx->coded_height = pc->coded_height;
+    }
+    /* Only without a decoder, which sets it with the profile and SAR. */
+    if (sti->info->found_decoder < 0 &&
+        avctx->pix_fmt == AV_PIX_FMT_NONE && pc->format >= 0)
+        avctx->pix_fmt = pc->format;
+    if (avctx->field_order == AV_FIELD_UNKNOWN &&
+        pc->field_order != AV_FIELD_UNKNOWN)
+        avctx->field_order = pc->field_order;
+}
+
+/**
+ * Take the AAC channel count and sample rate from the AudioSpecificConfig
+ * when nothing was decoded, instead of trusting the container.
+ */
+static void update_params_from_asc(AVFormatContext *ic, FFStream *sti)
+{
+    AVCodecContext *const avctx = sti->avctx;
+    MPEG4AudioConfig cfg = { 0 };
+
+    if (avctx->codec_id != AV_CODEC_ID_AAC || !avctx->extradata ||
+        sti->nb_decoded_frames)
+        return;
+    if (avpriv_mpeg4audio_get_config2(&cfg, avctx->extradata,
+                                      avctx->extradata_size, 1, ic) < 0)
+        return;
+    if (cfg.channels > 0 && cfg.channels != avctx->ch_layout.nb_channels) {
+        av_channel_layout_uninit(&avctx->ch_layout);
+        av_channel_layout_default(&avctx->ch_layout, cfg.channels);
+    }
+    if (cfg.ext_sample_rate > 0)
+        avctx->sample_rate = cfg.ext_sample_rate;
+    else if (cfg.sample_rate > 0)
+        avctx->sample_rate = cfg.sample_rate;
+}
+
 int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 {
     FFFormatContext *const si = ffformatcontext(ic);
@@ -2512,8 +3103,9 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
     int64_t probesize = ic->probesize;
     int eof_reached = 0;
     int *missing_streams = av_opt_ptr(ic->iformat->priv_class, ic->priv_data, "missing_streams");
+    const int fast_probe = !!(ic->flags & AVFMT_FLAG_FAST_PROBE);
 
-    flush_codecs = probesize > 0;
+    flush_codecs = probesize > 0 && !fast_probe;
 
     av_opt_set_int(ic, "skip_clear", 1, AV_OPT_SEARCH_CHILDREN);
 
@@ -2529,6 +3121,13 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             max_stream_analyze_duration = 7*AV_TIME_BASE;
     }
 
+#if HAVE_THREADS
+    /* the analysis looks at the parsers, which must not be in use */
+    if (si->parse_workers &&
+        (ret = parse_workers_collect(ic, NULL, si->parse_workers->count)) < 0)
+        return ret;
+#endif
+
     if (ic->pb) {
         FFIOContext *const ctx = ffiocontext(ic->pb);
         av_log(ic, AV_LOG_DEBUG, "Before avformat_find_stream_info() pos: %"PRId64" bytes read:%"PRId64" seeks:%d nb_streams:%d\n",
@@ -2580,7 +3179,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
         // Try to just open decoders, in case this is enough to get parameters.
         // Also ensure that subtitle_header is properly set.
-        if (!has_codec_parameters(st, NULL) && sti->request_probe <= 0 ||
+        if (!has_codec_parameters(ic, st, NULL) && sti->request_probe <= 0 ||
             st->codecpar->codec_type == AVMEDIA_TYPE_SUBTITLE) {
             if (codec && !avctx->codec)
                 if (avcodec_open2(avctx, codec, options ? &options[i] : &thread_opt) < 0)
@@ -2612,7 +3211,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             int fps_analyze_framecount = 20;
             int count;
 
-            if (!has_codec_parameters(st, NULL))
+            if (!has_codec_parameters(ic, st, NULL))
                 break;
             /* If the timebase is coarse (like the usual millisecond precision
              * of mkv), we need to analyze more frames to reliably arrive at
@@ -2623,7 +3222,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                 fps_analyze_framecount = 0;
             if (ic->fps_probe_size >= 0)
                 fps_analyze_framecount = ic->fps_probe_size;
-            if (st->disposition & AV_DISPOSITION_ATTACHED_PIC)
+            if (st->disposition & AV_DISPOSITION_ATTACHED_PIC || fast_probe)
                 fps_analyze_framecount = 0;
             /* variable fps and no guess at the real fps */
             count = (ic->iformat->flags & AVFMT_NOTIMESTAMPS) ?
@@ -2636,7 +3235,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             }
             // Look at the first 3 frames if there is evidence of frame delay
             // but the decoder delay is not set.
-            if (sti->info->frame_delay_evidence && count < 2 && sti->avctx->has_b_frames == 0)
+            if (sti->info->frame_delay_evidence && count < 2 && sti->avctx->has_b_frames == 0 &&
+                !fast_probe)
                 break;
             if (!sti->avctx->extradata &&
                 (!sti->extract_extradata.inited || sti->extract_extradata.bsf) &&
@@ -2811,6 +3411,16 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                 goto unref_then_goto_end;
         }
 
+        /* In fast probe mode only decode if the parser could not provide
+         * the basic parameters, e.g. for AAC or codecs without a parser,
+         * and for the first video frame. */
+        if (fast_probe) {
+            if (sti->parser)
+                update_params_from_parser(sti);
+            if (has_codec_parameters(ic, st, NULL))
+                goto next_packet;
+        }
+
         /* If still no information, we try to open the codec and to
          * decompress the frame. We try to avoid that in most cases as
          * it takes longer and uses more memory. For MPEG-4, we need to
@@ -2823,6 +3433,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         try_decode_frame(ic, st, pkt,
                          (options && i < orig_nb_streams) ? &options[i] : NULL);
 
+next_packet:
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(pkt1);
 
@@ -2834,7 +3445,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         for (unsigned stream_index = 0; stream_index < ic->nb_streams; stream_index++) {
             AVStream *const st = ic->streams[stream_index];
             AVCodecContext *const avctx = ffstream(st)->avctx;
-            if (!has_codec_parameters(st, NULL)) {
+            if (!has_codec_parameters(ic, st, NULL)) {
                 const AVCodec *codec = find_probe_decoder(ic, st, st->codecpar->codec_id);
                 if (codec && !avctx->codec) {
                     AVDictionary *opts = NULL;
@@ -2892,6 +3503,11 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                     avctx->codec_tag= tag;
             }
 
+            /* without decoding, trust the bitstream timing information */
+            if (fast_probe && !st->avg_frame_rate.num &&
+                avctx->framerate.num > 0 && avctx->framerate.den > 0)
+                st->avg_frame_rate = avctx->framerate;
+
             /* estimate average framerate if not set by demuxer */
             if (sti->info->codec_info_duration_fields &&
                 !st->avg_frame_rate.num &&
@@ -2940,6 +3556,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
                 if (fr.num && fr.den && av_cmp_q(st->time_base, av_inv_q(fr)) <= 0) {
                     st->r_frame_rate = fr;
+                } else if (fast_probe && st->avg_frame_rate.num) {
+                    st->r_frame_rate = st->avg_frame_rate;
                 } else {
                     st->r_frame_rate.num = st->time_base.den;
                     st->r_frame_rate.den = st->time_base.num;
@@ -2952,6 +3570,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                                                    hw_ratio);
             }
         } else if (avctx->codec_type == AVMEDIA_TYPE_AUDIO) {
+            if (fast_probe)
+                update_params_from_asc(ic, sti);
             if (!avctx->bits_per_coded_sample)
                 avctx->bits_per_coded_sample =
                     av_get_bits_per_sample(avctx->codec_id);
@@ -2998,7 +3618,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             if (ret < 0)
                 goto find_stream_info_err;
         }
-        if (!has_codec_parameters(st, &errmsg)) {
+        if (!has_codec_parameters(ic, st, &errmsg)) {
             char buf[256];
             avcodec_string(buf, sizeof(buf), sti->avctx, 0);
             av_log(ic, AV_LOG_WARNING,
@@ -197,6 +197,17 @@ int ff_read_packet(AVFormatContext *s, AVPacket *pkt);
 
 void ff_read_frame_flush(AVFormatContext *s);
 
+/**
+ * Drop the packets queued for or being parsed by the parser threads,
+ * waiting for those in progress.
+ */
+void ff_parse_workers_flush(AVFormatContext *s);
+
+/**
+ * Stop the parser threads and free their state.
+ */
+void ff_parse_workers_free(AVFormatContext *s);
+
 /**
  * Perform a binary search using av_index_search_timestamp() and
  * FFInputFormat.read_timestamp().
@@ -36,6 +36,7 @@
 #include "libavutil/mastering_display_metadata.h"
 #include "libavutil/mathematics.h"
 #include "avformat.h"
+#include "avio_internal.h"
 #include "demux.h"
 #include "internal.h"
 #include "flv.h"
@@ -46,6 +47,8 @@
 
 #define MAX_DEPTH 16      ///< arbitrary limit to prevent unbounded recursion
 
+#define META_CACHE_MAX_SIZE 16384 ///< largest script tag body kept for comparison
+
 typedef struct FLVMasteringMeta {
     double r_x;
     double r_y;
@@ -105,6 +108,18 @@ typedef struct FLVContext {
 
     FLVMetaVideoColor *metaVideoColor;
     int meta_color_info_flag;
+
+    int audio_flags_cache;      ///< flags byte of the last audio tag, -1 if none
+    int audio_rate_cache;       ///< sample rate audio_flags_cache resolves to
+
+    uint8_t *meta_buf;          ///< body of the script tag being read
+    unsigned meta_buf_size;
+    int meta_buf_len;           ///< valid bytes in meta_buf, 0 if not read
+    uint8_t *meta_cache;        ///< body of the last parsed onMetaData tag
+    unsigned meta_cache_size;
+    int meta_cache_len;
+    int meta_cache_nb_streams;  ///< nb_streams when meta_cache was parsed
+    int meta_cache_event_flags; ///< event flags raised by parsing meta_cache
 } FLVContext;
 
 /* AMF date type */
@@ -190,6 +205,7 @@ static void add_keyframes_index(AVFormatContext *s)
 static AVStream *create_stream(AVFormatContext *s, int codec_type)
 {
     FLVContext *flv   = s->priv_data;
+    int missing_streams = flv->missing_streams;
     AVStream *st = avformat_new_stream(s, NULL);
     if (!st)
         return NULL;
@@ -209,7 +225,10 @@ static AVStream *create_stream(AVFormatContext *s, int codec_type)
         flv->missing_streams &= ~FLV_HEADER_FLAG_HASVIDEO;
         st->avg_frame_rate = flv->framerate;
     }
-
+    /* With fast probing, trust the header flags about which streams exist. */
+    if (missing_streams && !flv->missing_streams &&
+        s->flags & AVFMT_FLAG_FAST_PROBE)
+        s->ctx_flags &= ~AVFMTCTX_NOHEADER;
 
     avpriv_set_pts_info(st, 32, 1, 1000); /* 32 bit pts in ms */
     flv->last_keyframe_stream_index = s->nb_streams - 1;
@@ -843,6 +862,49 @@ static int flv_read_metabody(AVFormatContext *s, int64_t next_pos)
     return 0;
 }
 
+static int flv_is_onmetadata(const uint8_t *buf, int size)
+{
+    static const char name[] = "onMetaData";
+
+    return size >= 3 + sizeof(name) - 1 &&
+           buf[0] == AMF_DATA_TYPE_STRING &&
+           AV_RB16(buf + 1) == sizeof(name) - 1 &&
+           !memcmp(buf + 3, name, sizeof(name) - 1);
+}
+
+/**
+ * Read the body of a script tag into meta_buf and check whether it is
+ * identical to the last onMetaData tag that was parsed with the same set of
+ * streams. Live streams commonly repeat the same metadata, parsing it again
+ * would not change anything. The metadata events of the cached tag are
+ * raised again.
+ *
+ * @return 1 if the tag can be skipped, 0 if it has to be parsed; in that
+ *         case the read position is restored to meta_pos
+ */
+static int flv_metabody_cached(AVFormatContext *s, int size, int64_t meta_pos)
+{
+    FLVContext *flv = s->priv_data;
+
+    flv->meta_buf_len = 0;
+    if (size > META_CACHE_MAX_SIZE || ffio_ensure_seekback(s->pb, size) < 0)
+        return 0;
+    av_fast_malloc(&flv->meta_buf, &flv->meta_buf_size, size);
+    if (!flv->meta_buf)
+        return 0;
+    if (avio_read(s->pb, flv->meta_buf, size) == size) {
+        flv->meta_buf_len = size;
+        if (size == flv->meta_cache_len &&
+            s->nb_streams == flv->meta_cache_nb_streams &&
+            !memcmp(flv->meta_buf, flv->meta_cache, size)) {
+            s->event_flags |= flv->meta_cache_event_flags;
+            return 1;
+        }
+    }
+    avio_seek(s->pb, meta_pos, SEEK_SET);
+    return 0;
+}
+
 static int flv_read_header(AVFormatContext *s)
 {
     int flags;
@@ -877,6 +939,7 @@ static int flv_read_header(AVFormatContext *s)
     s->start_time = 0;
     flv->sum_flv_tag_size = 0;
     flv->last_keyframe_stream_index = -1;
+    flv->audio_flags_cache = -1;
 
     return 0;
 }
@@ -890,6 +953,8 @@ static int flv_read_close(AVFormatContext *s)
     av_freep(&flv->keyframe_times);
     av_freep(&flv->keyframe_filepositions);
     av_freep(&flv->metaVideoColor);
+    av_freep(&flv->meta_buf);
+    av_freep(&flv->meta_cache);
     return 0;
 }
 
@@ -1206,20 +1271,24 @@ static int flv_read_packet(AVFormatContext *s, AVPacket *pkt)
     int orig_size;
     int enhanced_flv = 0;
     uint32_t video_codec_id = 0;
+    uint8_t header[11] = { 0 };
 
 retry:
     /* pkt size is repeated at end. skip it */
     pos  = avio_tell(s->pb);
-    type = (avio_r8(s->pb) & 0x1F);
+    ret = avio_read(s->pb, header, sizeof(header));
+    if (ret != sizeof(header))
+        return ret < 0 ? ret : AVERROR_EOF;
+    type = header[0] & 0x1F;
     orig_size =
-    size = avio_rb24(s->pb);
+    size = AV_RB24(header + 1);
     flv->sum_flv_tag_size += size + 11LL;
-    dts  = avio_rb24(s->pb);
-    dts |= (unsigned)avio_r8(s->pb) << 24;
+    dts  = AV_RB24(header + 4);
+    dts |= (unsigned)header[7] << 24;
+    /* header[8..10] is the stream id, always 0 */
     av_log(s, AV_LOG_TRACE, "type:%d, size:%d, last:%d, dts:%"PRId64" pos:%"PRId64"\n", type, size, last, dts, avio_tell(s->pb));
     if (avio_feof(s->pb))
         return AVERROR_EOF;
-    avio_skip(s->pb, 3); /* stream id, always 0 */
     flags = 0;
 
     if (flv->validate_next < flv->validate_count) {
@@ -1279,7 +1348,23 @@ retry:
         if (size > 13 + 1 + 4) { // Header-type metadata stuff
             int type;
             meta_pos = avio_tell(s->pb);
-            type = flv_read_metabody(s, next);
+            if (flv_metabody_cached(s, size, meta_pos)) {
+                type = 0;
+            } else {
+                int nb_streams  = s->nb_streams;
+                int event_flags = s->event_flags & AVFMT_EVENT_FLAG_METADATA_UPDATED;
+
+                s->event_flags &= ~AVFMT_EVENT_FLAG_METADATA_UPDATED;
+                type = flv_read_metabody(s, next);
+                if (type == 0 && flv_is_onmetadata(flv->meta_buf, flv->meta_buf_len)) {
+                    FFSWAP(uint8_t *, flv->meta_buf,      flv->meta_cache);
+                    FFSWAP(unsigned,  flv->meta_buf_size, flv->meta_cache_size);
+                    flv->meta_cache_len         = flv->meta_buf_len;
+                    flv->meta_cache_nb_streams  = nb_streams;
+                    flv->meta_cache_event_flags = s->event_flags & AVFMT_EVENT_FLAG_METADATA_UPDATED;
+                }
+                s->event_flags |= event_flags;
+            }
             if (type == 0 && dts == 0 || type < 0) {
                 if (type < 0 && flv->validate_count &&
                     flv->validate_index[0].pos     > next &&
@@ -1417,6 +1502,8 @@ retry_duration:
             sample_rate           = st->codecpar->sample_rate;
             flv->last_channels    =
             channels              = st->codecpar->ch_layout.nb_channels;
+        } else if (flags == flv->audio_flags_cache) {
+            sample_rate = flv->audio_rate_cache;
         } else {
             AVCodecParameters *par = avcodec_parameters_alloc();
             if (!par) {
@@ -1428,6 +1515,8 @@ retry_duration:
             flv_set_audio_codec(s, st, par, flags & FLV_AUDIO_CODECID_MASK);
             sample_rate = par->sample_rate;
             avcodec_parameters_free(&par);
+            flv->audio_flags_cache = flags;
+            flv->audio_rate_cache  = sample_rate;
         }
     } else if (stream_type == FLV_STREAM_TYPE_VIDEO) {
         int ret = flv_set_video_codec(s, st, video_codec_id, 1);
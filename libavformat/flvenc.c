@@ -25,6 +25,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/mastering_display_metadata.h"
 #include "libavutil/mathematics.h"
+#include "libavcodec/bytestream.h"
 #include "libavcodec/codec_desc.h"
 #include "libavcodec/mpeg4audio.h"
 #include "avio.h"
@@ -78,6 +79,12 @@ typedef enum {
     FLV_NO_DURATION_FILESIZE = (1 << 4),
 } FLVFlags;
 
+/**
+ * Audio and video tags up to this size, including the PreviousTagSize
+ * field, are assembled in FLVContext.tag_buf and written in one go.
+ */
+#define FLV_TAG_BUF_SIZE 4096
+
 typedef struct FLVFileposition {
     int64_t keyframe_position;
     double keyframe_timestamp;
@@ -126,6 +133,8 @@ typedef struct FLVContext {
     int flags;
     int64_t last_ts[FLV_STREAM_TYPE_NB];
     int metadata_pkt_written;
+
+    uint8_t tag_buf[FLV_TAG_BUF_SIZE];
 } FLVContext;
 
 static int get_audio_flags(AVFormatContext *s, AVCodecParameters *par)
@@ -986,7 +995,7 @@ static int flv_write_packet(AVFormatContext *s, AVPacket *pkt)
     int size = pkt->size;
     uint8_t *data = NULL;
     uint8_t frametype = pkt->flags & AV_PKT_FLAG_KEY ? FLV_FRAME_KEY : FLV_FRAME_INTER;
-    int flags = -1, flags_size, ret = 0;
+    int flags = -1, flags_size, tag_type, ret = 0;
     int64_t cur_offset = avio_tell(pb);
 
     if (par->codec_type == AVMEDIA_TYPE_AUDIO && !pkt->size) {
@@ -1051,7 +1060,7 @@ static int flv_write_packet(AVFormatContext *s, AVPacket *pkt)
 
     switch (par->codec_type) {
     case AVMEDIA_TYPE_VIDEO:
-        avio_w8(pb, FLV_TAG_TYPE_VIDEO);
+        tag_type = FLV_TAG_TYPE_VIDEO;
 
         flags = ff_codec_get_tag(flv_video_codec_ids, par->codec_id);
 
@@ -1062,11 +1071,11 @@ static int flv_write_packet(AVFormatContext *s, AVPacket *pkt)
 
         av_assert0(size);
 
-        avio_w8(pb, FLV_TAG_TYPE_AUDIO);
+        tag_type = FLV_TAG_TYPE_AUDIO;
         break;
     case AVMEDIA_TYPE_SUBTITLE:
     case AVMEDIA_TYPE_DATA:
-        avio_w8(pb, FLV_TAG_TYPE_META);
+        tag_type = FLV_TAG_TYPE_META;
         break;
     default:
         return AVERROR(EINVAL);
@@ -1108,14 +1117,17 @@ static int flv_write_packet(AVFormatContext *s, AVPacket *pkt)
         goto fail;
     }
 
-    avio_wb24(pb, size + flags_size);
-    put_timestamp(pb, ts);
-    avio_wb24(pb, flv->reserved);
-
     if (par->codec_type == AVMEDIA_TYPE_DATA ||
         par->codec_type == AVMEDIA_TYPE_SUBTITLE ) {
         int data_size;
-        int64_t metadata_size_pos = avio_tell(pb);
+        int64_t metadata_size_pos;
+
+        avio_w8(pb, tag_type);
+        avio_wb24(pb, size + flags_size);
+        put_timestamp(pb, ts);
+        avio_wb24(pb, flv->reserved);
+
+        metadata_size_pos = avio_tell(pb);
         if (par->codec_id == AV_CODEC_ID_TEXT) {
             // legacy FFmpeg magic?
             avio_w8(pb, AMF_DATA_TYPE_STRING);
@@ -1141,37 +1153,57 @@ static int flv_write_packet(AVFormatContext *s, AVPacket *pkt)
         avio_seek(pb, data_size + 10 - 3, SEEK_CUR);
         avio_wb32(pb, data_size + 11);
     } else {
+        /* The tag header, payload and PreviousTagSize are serialized into
+         * tag_buf and written at once; only payloads too large for it are
+         * written directly from the packet. */
+        unsigned tag_size = size + flags_size + 11;
+        uint8_t *buf = flv->tag_buf;
+
         av_assert1(flags>=0);
+        bytestream_put_byte(&buf, tag_type);
+        bytestream_put_be24(&buf, size + flags_size);
+        bytestream_put_be24(&buf, ts & 0xFFFFFF);
+        bytestream_put_byte(&buf, (ts >> 24) & 0x7F);
+        bytestream_put_be24(&buf, flv->reserved);
+
         if (par->codec_id == AV_CODEC_ID_HEVC) {
             int pkttype = (pkt->pts != pkt->dts) ? PacketTypeCodedFrames : PacketTypeCodedFramesX;
-            avio_w8(pb, FLV_IS_EX_HEADER | pkttype | frametype); // ExVideoTagHeader mode with PacketTypeCodedFrames(X)
-            avio_write(pb, "hvc1", 4);
+            bytestream_put_byte(&buf, FLV_IS_EX_HEADER | pkttype | frametype); // ExVideoTagHeader mode with PacketTypeCodedFrames(X)
+            bytestream_put_buffer(&buf, "hvc1", 4);
             if (pkttype == PacketTypeCodedFrames)
-                avio_wb24(pb, pkt->pts - pkt->dts);
+                bytestream_put_be24(&buf, pkt->pts - pkt->dts);
         } else if (par->codec_id == AV_CODEC_ID_AV1 || par->codec_id == AV_CODEC_ID_VP9) {
-            avio_w8(pb, FLV_IS_EX_HEADER | PacketTypeCodedFrames | frametype);
-            avio_write(pb, par->codec_id == AV_CODEC_ID_AV1 ? "av01" : "vp09", 4);
+            bytestream_put_byte(&buf, FLV_IS_EX_HEADER | PacketTypeCodedFrames | frametype);
+            bytestream_put_buffer(&buf, par->codec_id == AV_CODEC_ID_AV1 ? "av01" : "vp09", 4);
         } else {
-            avio_w8(pb, flags);
+            bytestream_put_byte(&buf, flags);
         }
         if (par->codec_id == AV_CODEC_ID_VP6)
-            avio_w8(pb,0);
+            bytestream_put_byte(&buf, 0);
         if (par->codec_id == AV_CODEC_ID_VP6F || par->codec_id == AV_CODEC_ID_VP6A) {
             if (par->extradata_size)
-                avio_w8(pb, par->extradata[0]);
+                bytestream_put_byte(&buf, par->extradata[0]);
             else
-                avio_w8(pb, ((FFALIGN(par->width,  16) - par->width) << 4) |
-                             (FFALIGN(par->height, 16) - par->height));
+                bytestream_put_byte(&buf, ((FFALIGN(par->width,  16) - par->width) << 4) |
+                                           (FFALIGN(par->height, 16) - par->height));
         } else if (par->codec_id == AV_CODEC_ID_AAC)
-            avio_w8(pb, 1); // AAC raw
+            bytestream_put_byte(&buf, 1); // AAC raw
         else if (par->codec_id == AV_CODEC_ID_H264 || par->codec_id == AV_CODEC_ID_MPEG4) {
-            avio_w8(pb, 1); // AVC NALU
-            avio_wb24(pb, pkt->pts - pkt->dts);
+            bytestream_put_byte(&buf, 1); // AVC NALU
+            bytestream_put_be24(&buf, pkt->pts - pkt->dts);
         }
+        av_assert1(buf - flv->tag_buf == flags_size + 11);
 
-        avio_write(pb, data ? data : pkt->data, size);
+        if (tag_size + 4 <= sizeof(flv->tag_buf)) {
+            bytestream_put_buffer(&buf, data ? data : pkt->data, size);
+            bytestream_put_be32(&buf, tag_size); // previous tag size
+            avio_write(pb, flv->tag_buf, buf - flv->tag_buf);
+        } else {
+            avio_write(pb, flv->tag_buf, buf - flv->tag_buf);
+            avio_write(pb, data ? data : pkt->data, size);
+            avio_wb32(pb, tag_size); // previous tag size
+        }
 
-        avio_wb32(pb, size + flags_size + 11); // previous tag size
         flv->duration = FFMAX(flv->duration,
                               pkt->pts + flv->delay + pkt->duration);
     }
@@ -37,6 +37,7 @@
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "demux.h"
@@ -48,6 +49,7 @@
 #include "hls_sample_encryption.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define PREFETCH_CHUNK_SIZE 65536
 
 #define MAX_FIELD_LEN 64
 #define MAX_CHARACTERISTICS_LEN 512
@@ -133,6 +135,12 @@ struct playlist {
     int64_t cur_seg_offset;
     int64_t last_load_time;
 
+    /* Current segment when it was served from the prefetch cache,
+     * used instead of input */
+    uint8_t *prefetch_data;
+    int64_t prefetch_data_len;
+    int prefetch_depth;
+
     /* Currently active Media Initialization Section */
     struct segment *cur_init_section;
     uint8_t *init_sec_buf;
@@ -189,6 +197,33 @@ struct rendition {
     int disposition;
 };
 
+enum PrefetchState {
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+};
+
+/*
+ * A segment download scheduled ahead of the playback position. Jobs are
+ * keyed by playlist and sequence number and only carry copies of the
+ * segment fields, as the segment list may be replaced by a reload while
+ * the download is in flight.
+ */
+struct prefetch_job {
+    struct playlist *pls;
+    int64_t seq_no;
+    int64_t duration;
+    char *url;
+    AVDictionary *opts;
+    enum PrefetchState state;
+    int cancelled;
+    int ret;
+    uint8_t *data;
+    unsigned int data_size;
+    int64_t data_len;
+    int64_t fetch_time;
+};
+
 struct variant {
     int bandwidth;
 
@@ -229,6 +264,22 @@ typedef struct HLSContext {
     int seg_max_retry;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
+
+    int prefetch_segments;
+    int64_t prefetch_max_size;
+    struct prefetch_job **prefetch_jobs;
+    int nb_prefetch_jobs;
+    int64_t prefetch_bytes;
+    int prefetch_abort;
+    /* idle persistent connections of the prefetch workers */
+    AVIOContext **prefetch_conns;
+    int nb_prefetch_conns;
+    AVMutex prefetch_mutex;
+    AVCond prefetch_cond;
+#if HAVE_THREADS
+    pthread_t *prefetch_workers;
+    int nb_prefetch_workers;
+#endif
 } HLSContext;
 
 static void free_segment_dynarray(struct segment **segments, int n_segments)
@@ -275,6 +326,7 @@ static void free_playlist_list(HLSContext *c)
         av_freep(&pls->init_sec_buf);
         av_packet_free(&pls->pkt);
         av_freep(&pls->pb.pub.buffer);
+        av_freep(&pls->prefetch_data);
         ff_format_io_close(c->ctx, &pls->input);
         pls->input_read_done = 0;
         ff_format_io_close(c->ctx, &pls->input_next);
@@ -1067,6 +1119,15 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
 {
     int ret;
 
+    if (pls->prefetch_data) {
+        buf_size = FFMIN(buf_size, pls->prefetch_data_len - pls->cur_seg_offset);
+        if (buf_size <= 0)
+            return AVERROR_EOF;
+        memcpy(buf, pls->prefetch_data + pls->cur_seg_offset, buf_size);
+        pls->cur_seg_offset += buf_size;
+        return buf_size;
+    }
+
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
@@ -1472,6 +1533,389 @@ static int playlist_needed(struct playlist *pls)
     return 0;
 }
 
+static void prefetch_remove_job(HLSContext *c, int idx)
+{
+    struct prefetch_job *job = c->prefetch_jobs[idx];
+
+    c->prefetch_bytes -= job->data_len;
+    memmove(c->prefetch_jobs + idx, c->prefetch_jobs + idx + 1,
+            (c->nb_prefetch_jobs - idx - 1) * sizeof(*c->prefetch_jobs));
+    c->nb_prefetch_jobs--;
+}
+
+static void prefetch_free_job(struct prefetch_job **pjob)
+{
+    struct prefetch_job *job = *pjob;
+
+    if (!job)
+        return;
+    av_freep(&job->url);
+    av_freep(&job->data);
+    av_dict_free(&job->opts);
+    av_freep(pjob);
+}
+
+static int prefetch_find_job(HLSContext *c, struct playlist *pls, int64_t seq_no)
+{
+    for (int i = 0; i < c->nb_prefetch_jobs; i++) {
+        struct prefetch_job *job = c->prefetch_jobs[i];
+        if (job->pls == pls && job->seq_no == seq_no && !job->cancelled)
+            return i;
+    }
+    return -1;
+}
+
+/* Download a whole segment into memory, runs on a prefetch worker. */
+static int prefetch_fetch(HLSContext *c, struct prefetch_job *job)
+{
+    AVFormatContext *s = c->ctx;
+    AVIOContext *in = NULL;
+    int64_t start = av_gettime_relative();
+    int ret;
+
+    if (c->http_persistent) {
+        ff_mutex_lock(&c->prefetch_mutex);
+        if (c->nb_prefetch_conns)
+            in = c->prefetch_conns[--c->nb_prefetch_conns];
+        ff_mutex_unlock(&c->prefetch_mutex);
+    }
+
+    /* Cookies set by the response end up in job->opts and are taken over
+     * by the demuxer when it uses the segment. */
+    ret = open_url(s, &in, job->url, &job->opts, NULL, NULL);
+    if (ret < 0)
+        return ret;
+
+    for (;;) {
+        uint8_t *data;
+
+        if (job->data_size - job->data_len < PREFETCH_CHUNK_SIZE) {
+            if (job->data_len + PREFETCH_CHUNK_SIZE > INT_MAX) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            data = av_fast_realloc(job->data, &job->data_size,
+                                   job->data_len + PREFETCH_CHUNK_SIZE);
+            if (!data) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            job->data = data;
+        }
+
+        ret = avio_read(in, job->data + job->data_len, PREFETCH_CHUNK_SIZE);
+        if (ret == AVERROR_EOF) {
+            ret = 0;
+            break;
+        } else if (ret < 0) {
+            break;
+        }
+
+        ff_mutex_lock(&c->prefetch_mutex);
+        job->data_len     += ret;
+        c->prefetch_bytes += ret;
+        if (job->cancelled || c->prefetch_abort) {
+            ret = AVERROR_EXIT;
+        } else if (c->prefetch_bytes > c->prefetch_max_size) {
+            /* Give up on the download rather than exceed the limit, the
+             * segment is opened normally once it is reached. */
+            c->prefetch_bytes -= job->data_len;
+            job->data_len = 0;
+            ret = AVERROR(ENOBUFS);
+        } else
+            ret = 0;
+        ff_mutex_unlock(&c->prefetch_mutex);
+        if (ret < 0)
+            break;
+    }
+    if (ret == AVERROR(ENOBUFS)) {
+        av_freep(&job->data);
+        job->data_size = 0;
+    }
+
+    /* A connection that served the whole segment can be reused by the
+     * next download of any worker. */
+    if (!ret && c->http_persistent) {
+        ff_mutex_lock(&c->prefetch_mutex);
+        if (!c->prefetch_abort &&
+            av_dynarray_add_nofree(&c->prefetch_conns, &c->nb_prefetch_conns, in) >= 0)
+            in = NULL;
+        ff_mutex_unlock(&c->prefetch_mutex);
+    }
+    ff_format_io_close(s, &in);
+    job->fetch_time = av_gettime_relative() - start;
+
+    return ret;
+}
+
+#if HAVE_THREADS
+static void *prefetch_worker(void *arg)
+{
+    HLSContext *c = arg;
+
+    ff_mutex_lock(&c->prefetch_mutex);
+    while (!c->prefetch_abort) {
+        struct prefetch_job *job = NULL;
+        int i, ret;
+
+        for (i = 0; i < c->nb_prefetch_jobs; i++) {
+            if (c->prefetch_jobs[i]->state == PREFETCH_QUEUED) {
+                job = c->prefetch_jobs[i];
+                break;
+            }
+        }
+        if (!job) {
+            ff_cond_wait(&c->prefetch_cond, &c->prefetch_mutex);
+            continue;
+        }
+
+        job->state = PREFETCH_RUNNING;
+        ff_mutex_unlock(&c->prefetch_mutex);
+
+        ret = prefetch_fetch(c, job);
+
+        ff_mutex_lock(&c->prefetch_mutex);
+        job->ret   = ret;
+        job->state = PREFETCH_DONE;
+        if (job->cancelled) {
+            for (i = 0; i < c->nb_prefetch_jobs; i++) {
+                if (c->prefetch_jobs[i] == job) {
+                    prefetch_remove_job(c, i);
+                    break;
+                }
+            }
+            prefetch_free_job(&job);
+        }
+        ff_cond_broadcast(&c->prefetch_cond);
+    }
+    ff_mutex_unlock(&c->prefetch_mutex);
+
+    return NULL;
+}
+#endif
+
+static int prefetch_start(HLSContext *c)
+{
+#if HAVE_THREADS
+    int ret;
+
+    if (!ff_format_io_is_default(c->ctx)) {
+        av_log(c->ctx, AV_LOG_WARNING, "Segment prefetching opens segments from "
+               "worker threads and cannot be used with custom I/O callbacks, disabled\n");
+        c->prefetch_segments = 0;
+        return 0;
+    }
+
+    c->prefetch_workers = av_calloc(c->prefetch_segments, sizeof(*c->prefetch_workers));
+    if (!c->prefetch_workers)
+        return AVERROR(ENOMEM);
+
+    if ((ret = ff_mutex_init(&c->prefetch_mutex, NULL))) {
+        av_freep(&c->prefetch_workers);
+        return AVERROR(ret);
+    }
+    if ((ret = ff_cond_init(&c->prefetch_cond, NULL))) {
+        ff_mutex_destroy(&c->prefetch_mutex);
+        av_freep(&c->prefetch_workers);
+        return AVERROR(ret);
+    }
+
+    for (int i = 0; i < c->prefetch_segments; i++) {
+        ret = pthread_create(&c->prefetch_workers[i], NULL, prefetch_worker, c);
+        if (ret) {
+            av_log(c->ctx, AV_LOG_WARNING, "Failed to start prefetch worker: %s\n",
+                   av_err2str(AVERROR(ret)));
+            break;
+        }
+        c->nb_prefetch_workers++;
+    }
+    if (!c->nb_prefetch_workers) {
+        ff_cond_destroy(&c->prefetch_cond);
+        ff_mutex_destroy(&c->prefetch_mutex);
+        av_freep(&c->prefetch_workers);
+        return AVERROR(ret);
+    }
+#else
+    av_log(c->ctx, AV_LOG_WARNING, "Segment prefetching requires threads, disabled\n");
+    c->prefetch_segments = 0;
+#endif
+    return 0;
+}
+
+static void prefetch_stop(HLSContext *c)
+{
+#if HAVE_THREADS
+    if (!c->prefetch_workers)
+        return;
+
+    ff_mutex_lock(&c->prefetch_mutex);
+    c->prefetch_abort = 1;
+    ff_cond_broadcast(&c->prefetch_cond);
+    ff_mutex_unlock(&c->prefetch_mutex);
+
+    for (int i = 0; i < c->nb_prefetch_workers; i++)
+        pthread_join(c->prefetch_workers[i], NULL);
+    av_freep(&c->prefetch_workers);
+    c->nb_prefetch_workers = 0;
+
+    for (int i = 0; i < c->nb_prefetch_jobs; i++)
+        prefetch_free_job(&c->prefetch_jobs[i]);
+    av_freep(&c->prefetch_jobs);
+    c->nb_prefetch_jobs = 0;
+
+    for (int i = 0; i < c->nb_prefetch_conns; i++)
+        ff_format_io_close(c->ctx, &c->prefetch_conns[i]);
+    av_freep(&c->prefetch_conns);
+    c->nb_prefetch_conns = 0;
+
+    ff_cond_destroy(&c->prefetch_cond);
+    ff_mutex_destroy(&c->prefetch_mutex);
+#endif
+}
+
+/* Drop all cached and pending segments of a playlist, e.g. on seek. */
+static void prefetch_flush(HLSContext *c, struct playlist *pls)
+{
+    av_freep(&pls->prefetch_data);
+
+    if (!c->prefetch_segments)
+        return;
+
+    ff_mutex_lock(&c->prefetch_mutex);
+    for (int i = c->nb_prefetch_jobs - 1; i >= 0; i--) {
+        struct prefetch_job *job = c->prefetch_jobs[i];
+        if (job->pls != pls)
+            continue;
+        if (job->state == PREFETCH_RUNNING) {
+            /* the worker drops it once the download returns */
+            job->cancelled = 1;
+        } else {
+            prefetch_remove_job(c, i);
+            prefetch_free_job(&job);
+        }
+    }
+    ff_mutex_unlock(&c->prefetch_mutex);
+}
+
+/* Queue downloads of the segments following the current one. */
+static void prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    int queued = 0;
+
+    if (!pls->prefetch_depth)
+        pls->prefetch_depth = 1;
+
+    ff_mutex_lock(&c->prefetch_mutex);
+    for (int i = 1; i <= pls->prefetch_depth; i++) {
+        int64_t n = pls->cur_seq_no - pls->start_seq_no + i;
+        struct prefetch_job *job;
+        struct segment *seg;
+
+        if (n >= pls->n_segments)
+            break;
+        seg = pls->segments[n];
+        if (seg->key_type != KEY_NONE || !av_strstart(seg->url, "http", NULL))
+            break;
+        if (prefetch_find_job(c, pls, pls->cur_seq_no + i) >= 0)
+            continue;
+        if (c->prefetch_bytes >= c->prefetch_max_size)
+            break;
+
+        job = av_mallocz(sizeof(*job));
+        if (!job)
+            break;
+        job->pls      = pls;
+        job->seq_no   = pls->cur_seq_no + i;
+        job->duration = seg->duration;
+        job->url      = av_strdup(seg->url);
+        av_dict_copy(&job->opts, c->avio_opts, 0);
+        if (c->http_persistent)
+            av_dict_set(&job->opts, "multiple_requests", "1", 0);
+        if (seg->size >= 0) {
+            av_dict_set_int(&job->opts, "offset", seg->url_offset, 0);
+            av_dict_set_int(&job->opts, "end_offset", seg->url_offset + seg->size, 0);
+        }
+        if (!job->url || av_dynarray_add_nofree(&c->prefetch_jobs,
+                                                &c->nb_prefetch_jobs, job) < 0) {
+            prefetch_free_job(&job);
+            break;
+        }
+        queued = 1;
+    }
+    if (queued)
+        ff_cond_broadcast(&c->prefetch_cond);
+    ff_mutex_unlock(&c->prefetch_mutex);
+}
+
+/*
+ * Serve the current segment of pls from the prefetch cache, waiting for its
+ * download if one is in flight. Returns 1 if the segment is now available in
+ * pls->prefetch_data, 0 if it has to be opened normally.
+ */
+static int prefetch_take(HLSContext *c, struct playlist *pls)
+{
+    const AVDictionaryEntry *t;
+    struct prefetch_job *job;
+    int idx;
+
+    ff_mutex_lock(&c->prefetch_mutex);
+    idx = prefetch_find_job(c, pls, pls->cur_seq_no);
+    if (idx < 0) {
+        ff_mutex_unlock(&c->prefetch_mutex);
+        return 0;
+    }
+    job = c->prefetch_jobs[idx];
+    if (job->state == PREFETCH_QUEUED) {
+        /* nobody is working on it, fetching it ourselves is faster */
+        prefetch_remove_job(c, idx);
+        ff_mutex_unlock(&c->prefetch_mutex);
+        prefetch_free_job(&job);
+        return 0;
+    }
+    while (job->state != PREFETCH_DONE)
+        ff_cond_wait(&c->prefetch_cond, &c->prefetch_mutex);
+    prefetch_remove_job(c, prefetch_find_job(c, pls, pls->cur_seq_no));
+    ff_mutex_unlock(&c->prefetch_mutex);
+
+    if (job->ret < 0) {
+        av_log(pls->parent, AV_LOG_WARNING,
+               "Prefetching segment %"PRId64" of playlist %d failed: %s\n",
+               job->seq_no, pls->index, av_err2str(job->ret));
+        prefetch_free_job(&job);
+        return 0;
+    }
+
+    /* Take over the cookies the segment response may have updated. */
+    if ((t = av_dict_get(job->opts, "cookies", NULL, 0)))
+        av_dict_set(&c->avio_opts, "cookies", t->value, 0);
+
+    /* Adapt the prefetch depth to the measured throughput: fetch further
+     * ahead while segments take more than half their duration to arrive. */
+    if (job->fetch_time > 0) {
+        av_log(pls->parent, AV_LOG_DEBUG,
+               "Prefetched segment %"PRId64" of playlist %d, %"PRId64" bytes "
+               "at %"PRId64" kbit/s\n", job->seq_no, pls->index, job->data_len,
+               job->data_len * 8 * 1000 / job->fetch_time);
+        if (job->fetch_time > job->duration / 2)
+            pls->prefetch_depth = FFMIN(pls->prefetch_depth + 1, c->prefetch_segments);
+        else if (job->fetch_time < job->duration / 4)
+            pls->prefetch_depth = FFMAX(pls->prefetch_depth - 1, 1);
+    }
+
+    /* An idle persistent connection is kept for the segments that are
+     * not prefetched, it is reused once this one has been read. */
+    if (!c->http_persistent)
+        ff_format_io_close(pls->parent, &pls->input);
+    pls->input_read_done   = 0;
+    pls->prefetch_data     = job->data;
+    pls->prefetch_data_len = job->data_len;
+    pls->cur_seg_offset    = 0;
+    job->data = NULL;
+    prefetch_free_job(&job);
+
+    return 1;
+}
+
 static int read_data(void *opaque, uint8_t *buf, int buf_size)
 {
     struct playlist *v = opaque;
@@ -1486,7 +1930,8 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->prefetch_data) ||
+        (c->http_persistent && v->input_read_done)) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1562,6 +2007,8 @@ reload:
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
             ret = 0;
+        } else if (c->prefetch_segments && prefetch_take(c, v)) {
+            ret = 0;
         } else {
             ret = open_input(c, v, seg, &v->input);
         }
@@ -1586,7 +2033,7 @@ reload:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1596,7 +2043,9 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->prefetch_segments) {
+        prefetch_schedule(c, v);
+    } else if (c->http_multiple == 1 && !v->input_next_requested &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1629,7 +2078,11 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->prefetch_data) {
+        av_freep(&v->prefetch_data);
+        if (v->input)
+            v->input_read_done = 1;
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1913,6 +2366,7 @@ static int hls_close(AVFormatContext *s)
 {
     HLSContext *c = s->priv_data;
 
+    prefetch_stop(c);
     free_playlist_list(c);
     free_variant_list(c);
     free_rendition_list(c);
@@ -1950,6 +2404,9 @@ static int hls_read_header(AVFormatContext *s)
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         return ret;
 
+    if (c->prefetch_segments && (ret = prefetch_start(c)) < 0)
+        return ret;
+
     if (c->n_variants == 0) {
         av_log(s, AV_LOG_WARNING, "Empty playlist\n");
         return AVERROR_EOF;
@@ -2084,6 +2541,7 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            prefetch_flush(c, pls);
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2238,6 +2696,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            prefetch_flush(c, pls);
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2494,6 +2953,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        prefetch_flush(c, pls);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2586,6 +3046,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Maximum number of segments to download ahead in parallel, 0 = disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 16, FLAGS},
+    {"prefetch_max_size", "Maximum amount of memory used for prefetched segments",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 * 1024 * 1024}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
@@ -35,6 +35,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
+#include "libavutil/thread.h"
 
 #include "avformat.h"
 #include "http.h"
@@ -44,6 +45,9 @@
 #include "os_support.h"
 #include "url.h"
 #include "version.h"
+#if CONFIG_TLS_PROTOCOL
+#include "tls.h"
+#endif
 
 #include <pthread.h>
 
@@ -56,6 +60,7 @@
 #define BUFFER_SIZE   (MAX_URL_SIZE + HTTP_HEADERS_SIZE)
 #define MAX_REDIRECTS 8
 #define MAX_CACHED_REDIRECTS 32
+#define HTTP_POOL_SIZE 32
 #define HTTP_SINGLE   1
 #define HTTP_MUTLI    2
 #define MAX_EXPIRY    19
@@ -141,6 +146,9 @@ typedef struct HTTPContext {
     AVDictionary *redirect_cache;
     uint64_t filesize_from_content_range;
     int64_t start_time_ms;
+    int connection_pool;
+    int64_t pool_idle_timeout;
+    char *pool_key;
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -183,6 +191,8 @@ static const AVOption options[] = {
     { "resource", "The resource requested by a client", OFFSET(resource), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    { "connection_pool", "keep finished connections open for reuse by later requests to the same server", OFFSET(connection_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
+    { "pool_idle_timeout", "time after which idle pooled connections are closed", OFFSET(pool_idle_timeout), AV_OPT_TYPE_DURATION, { .i64 = 30000000 }, 0, INT64_MAX, D | E },
     { NULL }
 };
 
@@ -207,6 +217,196 @@ void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
            sizeof(HTTPAuthState));
 }
 
+/*
+ * Process-wide pool of idle keep-alive connections, shared by all HTTP
+ * contexts opened with connection_pool enabled. Connections are keyed by
+ * the lower protocol URL and all options passed on to the lower protocol.
+ * Idle connections past their timeout are closed by the next pool access,
+ * the rest by ff_http_pool_drain().
+ */
+typedef struct HTTPPoolEntry {
+    char *key;
+    URLContext *hd;
+    int64_t idle_since;
+    int64_t idle_timeout;
+} HTTPPoolEntry;
+
+static AVMutex pool_lock = AV_MUTEX_INITIALIZER;
+static HTTPPoolEntry pool[HTTP_POOL_SIZE];
+static int pool_nb_entries;
+
+static void pool_remove_entry(int idx, HTTPPoolEntry *entry)
+{
+    *entry = pool[idx];
+    pool[idx] = pool[--pool_nb_entries];
+}
+
+/* Must be called with pool_lock held, returns the expired connections
+ * in expired so they can be closed after unlocking. */
+static int pool_expire(int64_t now, HTTPPoolEntry *expired)
+{
+    int nb_expired = 0;
+
+    for (int i = pool_nb_entries - 1; i >= 0; i--)
+        if (now - pool[i].idle_since > pool[i].idle_timeout)
+            pool_remove_entry(i, &expired[nb_expired++]);
+    return nb_expired;
+}
+
+static void pool_free_entries(HTTPPoolEntry *entries, int nb_entries)
+{
+    for (int i = 0; i < nb_entries; i++) {
+        ffurl_closep(&entries[i].hd);
+        av_freep(&entries[i].key);
+    }
+}
+
+/* An idle connection must not have anything to read: readable means the
+ * peer closed it or sent data we cannot attribute to a request. */
+static int pool_connection_alive(URLContext *hd)
+{
+    int fd = ffurl_get_file_handle(hd);
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+
+    if (fd < 0)
+        return 0;
+    return poll(&p, 1, 0) == 0;
+}
+
+static URLContext *pool_get(URLContext *h, const char *key)
+{
+    HTTPPoolEntry expired[HTTP_POOL_SIZE], entry = { 0 };
+    int nb_expired;
+
+    ff_mutex_lock(&pool_lock);
+    nb_expired = pool_expire(av_gettime_relative(), expired);
+    for (int i = pool_nb_entries - 1; i >= 0; i--) {
+        if (!strcmp(pool[i].key, key)) {
+            pool_remove_entry(i, &entry);
+            break;
+        }
+    }
+    ff_mutex_unlock(&pool_lock);
+
+    pool_free_entries(expired, nb_expired);
+    if (!entry.hd)
+        return NULL;
+    av_freep(&entry.key);
+
+    if (!pool_connection_alive(entry.hd)) {
+        av_log(h, AV_LOG_DEBUG, "Discarding stale pooled connection %s\n", key);
+        ffurl_closep(&entry.hd);
+        return NULL;
+    }
+
+#if CONFIG_TLS_PROTOCOL
+    if (!strcmp(entry.hd->prot->name, "tls"))
+        ff_tls_set_interrupt_callback(entry.hd, &h->interrupt_callback);
+    else
+#endif
+        entry.hd->interrupt_callback = h->interrupt_callback;
+
+    av_log(h, AV_LOG_DEBUG, "Reusing pooled connection %s\n", key);
+    return entry.hd;
+}
+
+static void pool_put(URLContext *h, URLContext **hd)
+{
+    HTTPContext *s = h->priv_data;
+    static const AVIOInterruptCB no_interrupt = { 0 };
+    HTTPPoolEntry expired[HTTP_POOL_SIZE + 1], entry = {
+        .key          = av_strdup(s->pool_key),
+        .hd           = *hd,
+        .idle_timeout = s->pool_idle_timeout,
+    };
+    int nb_expired;
+
+    if (!entry.key) {
+        ffurl_closep(hd);
+        return;
+    }
+    *hd = NULL;
+
+    /* The interrupt callback may refer to the closing owner. */
+#if CONFIG_TLS_PROTOCOL
+    if (!strcmp(entry.hd->prot->name, "tls"))
+        ff_tls_set_interrupt_callback(entry.hd, &no_interrupt);
+    else
+#endif
+        entry.hd->interrupt_callback = no_interrupt;
+
+    ff_mutex_lock(&pool_lock);
+    entry.idle_since = av_gettime_relative();
+    nb_expired = pool_expire(entry.idle_since, expired);
+    if (pool_nb_entries == HTTP_POOL_SIZE) {
+        /* evict the connection that has been idle the longest */
+        int oldest = 0;
+        for (int i = 1; i < pool_nb_entries; i++)
+            if (pool[i].idle_since < pool[oldest].idle_since)
+                oldest = i;
+        pool_remove_entry(oldest, &expired[nb_expired++]);
+    }
+    pool[pool_nb_entries++] = entry;
+    ff_mutex_unlock(&pool_lock);
+
+    pool_free_entries(expired, nb_expired);
+}
+
+void ff_http_pool_drain(void)
+{
+    HTTPPoolEntry entries[HTTP_POOL_SIZE];
+    int nb_entries;
+
+    ff_mutex_lock(&pool_lock);
+    nb_entries = pool_nb_entries;
+    memcpy(entries, pool, nb_entries * sizeof(*entries));
+    pool_nb_entries = 0;
+    ff_mutex_unlock(&pool_lock);
+
+    pool_free_entries(entries, nb_entries);
+}
+
+/* Any option left for the lower protocol (TCP timeouts and addresses,
+ * TLS certificates and verification, ...) may change the connection,
+ * so only identical option sets share connections. */
+static char *pool_make_key(const char *lower_url, AVDictionary *options)
+{
+    const AVDictionaryEntry *e = NULL;
+    AVBPrint bp;
+    char *key;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "%s", lower_url);
+    while ((e = av_dict_iterate(options, e)))
+        av_bprintf(&bp, ";%s=%s", e->key, e->value);
+    if (av_bprint_finalize(&bp, &key) < 0)
+        return NULL;
+    return key;
+}
+
+/* Whether the connection is idle at the end of a complete exchange and
+ * the server agreed to keep it open. */
+static int http_connection_reusable(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+
+    if (!s->pool_key || s->willclose || s->listen ||
+        s->http_code < 200 || s->http_code >= 300 ||
+        s->buf_ptr != s->buf_end)
+        return 0;
+
+    if (h->flags & AVIO_FLAG_WRITE) {
+        /* the reply was read by http_shutdown(), its body must be empty */
+        return !(h->flags & AVIO_FLAG_READ) && s->end_chunked_post &&
+               (s->http_code == 204 || s->filesize == 0);
+    }
+
+    if (s->chunksize != UINT64_MAX)
+        return s->chunkend;
+    return s->filesize != UINT64_MAX &&
+           s->off >= (s->end_off ? s->end_off : s->filesize);
+}
+
 static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 {
     const char *path, *proxy_path, *lower_proto = "tcp", *local_path;
@@ -216,7 +416,8 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     char auth[1024], proxyauth[1024] = "";
     char path1[MAX_URL_SIZE], sanitized_path[MAX_URL_SIZE + 1];
     char buf[1024], urlbuf[MAX_URL_SIZE];
-    int port, use_proxy, err = 0;
+    int port, use_proxy, reused = 0, err = 0;
+    uint64_t off;
     HTTPContext *s = h->priv_data;
 
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
@@ -272,16 +473,45 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
 
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
+    /* Connections through proxies are not pooled. */
+    av_freep(&s->pool_key);
+    if (s->connection_pool && !proxy_path) {
+        s->pool_key = pool_make_key(buf, *options);
+        if (!s->pool_key) {
+            err = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
     if (!s->hd) {
-        err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
-                                   &h->interrupt_callback, options,
-                                   h->protocol_whitelist, h->protocol_blacklist, h);
+        if (s->pool_key && (s->hd = pool_get(h, s->pool_key)))
+            reused = 1;
+        else
+            err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
+                                       &h->interrupt_callback, options,
+                                       h->protocol_whitelist, h->protocol_blacklist, h);
     }
 
 end:
     freeenv_utf8(env_http_proxy);
-    return err < 0 ? err : http_connect(
-        h, path, local_path, hoststr, auth, proxyauth);
+    if (err < 0)
+        return err;
+
+    off = s->off;
+    s->line_count = 0;
+    err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    if (err < 0 && err != AVERROR_EXIT && reused && !s->line_count) {
+        /* the server may have closed the idle connection meanwhile */
+        av_log(h, AV_LOG_DEBUG, "Request on pooled connection failed, reconnecting\n");
+        ffurl_closep(&s->hd);
+        s->off = off;
+        err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
+                                   &h->interrupt_callback, options,
+                                   h->protocol_whitelist, h->protocol_blacklist, h);
+        if (err >= 0)
+            err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    }
+    return err;
 }
 
 static int http_should_reconnect(HTTPContext *s, int err)
@@ -1508,7 +1738,8 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
         av_bprintf(&request, "Expect: 100-continue\r\n");
 
     if (!has_header(s->headers, "\r\nConnection: "))
-        av_bprintf(&request, "Connection: %s\r\n", s->multiple_requests ? "keep-alive" : "close");
+        av_bprintf(&request, "Connection: %s\r\n",
+                   s->multiple_requests || s->connection_pool ? "keep-alive" : "close");
 
     if (!has_header(s->headers, "\r\nHost: "))
         av_bprintf(&request, "Host: %s\r\n", hoststr);
@@ -1621,7 +1852,7 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
                    "Chunked encoding data size: %"PRIu64"\n",
                     s->chunksize);
 
-            if (!s->chunksize && s->multiple_requests) {
+            if (!s->chunksize && (s->multiple_requests || s->connection_pool)) {
                 http_get_line(s, line, sizeof(line)); // read empty chunk
                 s->chunkend = 1;
                 return 0;
@@ -1860,7 +2091,8 @@ static int http_read(URLContext *h, uint8_t *buf, int size)
 }
 
 /* used only when posting data */
-static int http_write(URLContext *h, const uint8_t *buf, int size)
+static int http_write_data(URLContext *h, const uint8_t *buf, int size,
+                           AVBufferRef *ref)
 {
     char temp[11] = "";  /* 32-bit hex + CRLF + nul */
     int ret;
@@ -1869,7 +2101,7 @@ static int http_write(URLContext *h, const uint8_t *buf, int size)
 
     if (!s->chunked_post) {
         /* non-chunked data is sent without any special encoding */
-        return ffurl_write(s->hd, buf, size);
+        return ffurl_write_buffer(s->hd, buf, size, ref);
     }
 
     /* silently ignore zero-size data since chunk encoding that would
@@ -1879,13 +2111,24 @@ static int http_write(URLContext *h, const uint8_t *buf, int size)
         snprintf(temp, sizeof(temp), "%x\r\n", size);
 
         if ((ret = ffurl_write(s->hd, temp, strlen(temp))) < 0 ||
-            (ret = ffurl_write(s->hd, buf, size)) < 0          ||
+            (ret = ffurl_write_buffer(s->hd, buf, size, ref)) < 0 ||
             (ret = ffurl_write(s->hd, crlf, sizeof(crlf) - 1)) < 0)
             return ret;
     }
     return size;
 }
 
+static int http_write(URLContext *h, const uint8_t *buf, int size)
+{
+    return http_write_data(h, buf, size, NULL);
+}
+
+static int http_write_buffer(URLContext *h, const uint8_t *buf, int size,
+                             AVBufferRef *ref)
+{
+    return http_write_data(h, buf, size, ref);
+}
+
 static int http_shutdown(URLContext *h, int flags)
 {
     int ret = 0;
@@ -1927,7 +2170,7 @@ static int http_shutdown(URLContext *h, int flags)
 
 static int http_close(URLContext *h)
 {
-    int ret = 0;
+    int ret = 0, reusable = 0;
     HTTPContext *s = h->priv_data;
 
 #if CONFIG_ZLIB
@@ -1935,12 +2178,23 @@ static int http_close(URLContext *h)
     av_freep(&s->inflate_buffer);
 #endif /* CONFIG_ZLIB */
 
+    /* http_shutdown() resets the status, which for writes is then
+     * updated from the reply. */
+    if (s->hd && !(h->flags & AVIO_FLAG_WRITE))
+        reusable = http_connection_reusable(h);
+
     if (s->hd && !s->end_chunked_post)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
 
-    if (s->hd)
+    if (s->hd && (h->flags & AVIO_FLAG_WRITE))
+        reusable = http_connection_reusable(h);
+
+    if (s->hd && reusable)
+        pool_put(h, &s->hd);
+    else if (s->hd)
         ffurl_closep(&s->hd);
+    av_freep(&s->pool_key);
     av_dict_free(&s->chained_options);
     av_dict_free(&s->cookie_dict);
     av_dict_free(&s->redirect_cache);
@@ -2054,6 +2308,7 @@ const URLProtocol ff_http_protocol = {
     .url_handshake       = http_handshake,
     .url_read            = http_read,
     .url_write           = http_write,
+    .url_write_buffer    = http_write_buffer,
     .url_seek            = http_seek,
     .url_close           = http_close,
     .url_get_file_handle = http_get_file_handle,
@@ -2074,6 +2329,7 @@ const URLProtocol ff_https_protocol = {
     .url_open2           = http_open,
     .url_read            = http_read,
     .url_write           = http_write,
+    .url_write_buffer    = http_write_buffer,
     .url_seek            = http_seek,
     .url_close           = http_close,
     .url_get_file_handle = http_get_file_handle,
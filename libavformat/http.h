@@ -64,6 +64,11 @@ int ff_http_averror(int status_code, int default_averror);
 
 char *ff_http_get_url(URLContext *h);
 
+/**
+ * Close all idle connections kept by the connection_pool option.
+ */
+void ff_http_pool_drain(void);
+
 int ff_http_get_code(URLContext *h);
 
 
@@ -61,6 +61,8 @@ typedef struct FFFrac {
 } FFFrac;
 
 
+typedef struct FFParseWorkers FFParseWorkers;
+
 typedef struct FFFormatContext {
     /**
      * The public context.
@@ -183,6 +185,12 @@ typedef struct FFFormatContext {
      * Contexts and child contexts do not contain a metadata option
      */
     int metafree;
+
+    /**
+     * Threads running the parsers of video streams, if
+     * AVFormatContext.parse_threads is set. Demuxing only.
+     */
+    FFParseWorkers *parse_workers;
 } FFFormatContext;
 
 static av_always_inline FFFormatContext *ffformatcontext(AVFormatContext *s)
@@ -713,6 +721,15 @@ int ff_copy_whiteblacklists(AVFormatContext *dst, const AVFormatContext *src);
  */
 int ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether s uses the default io_open and io_close2 callbacks. Only
+ * those may be called from several threads at once; callbacks set by the
+ * user carry no such guarantee.
+ *
+ * @return 1 if both callbacks are the default ones, 0 otherwise
+ */
+int ff_format_io_is_default(const AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
@@ -164,6 +164,25 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * State of a walk over the sample tables, positioned on one sample.
+ */
+typedef struct MOVIndexCursor {
+    int64_t dts;
+    int64_t pos;
+    unsigned int sample;
+    unsigned int chunk;
+    unsigned int chunk_sample;  ///< sample number within the chunk
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int distance;
+} MOVIndexCursor;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int refcount;
@@ -267,6 +286,24 @@ typedef struct MOVStreamContext {
     } cenc;
 
     struct IAMFDemuxContext *iamf;
+
+    /**
+     * Index entries resolved on demand from the sample tables, instead of
+     * ffstream(st)->index_entries.
+     */
+    struct {
+        int enabled;
+        int nb_samples;
+        int key_off;
+        MOVIndexCursor start;        ///< cursor on the first sample
+        MOVIndexCursor cur;          ///< cursor on the sample after the last resolved one
+        MOVIndexCursor *points;      ///< cursors every MOV_LAZY_INDEX_INTERVAL samples
+        unsigned int nb_points;
+        unsigned int points_allocated_size;
+        AVIndexEntry entries[2];     ///< last resolved entries
+        int entry_samples[2];
+        int next_entry;
+    } lazy_index;
 } MOVStreamContext;
 
 typedef struct HEIFItem {
@@ -356,6 +393,9 @@ typedef struct MOVContext {
     int thmb_item_id;
     int64_t idat_offset;
     int interleaved_read;
+    int lazy_index;
+    int moov_tail_request;
+    int moov_from_tail;   ///< 'moov' was read on a second connection past the first 'mdat'
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
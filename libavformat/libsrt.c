@@ -44,6 +44,9 @@
 #define SRT_LIVE_MAX_PAYLOAD_SIZE 1456
 #endif
 
+/* Number of pending callers queued on a multi_client listener */
+#define SRT_MULTI_CLIENT_BACKLOG 64
+
 enum SRTMode {
     SRT_MODE_CALLER = 0,
     SRT_MODE_LISTENER = 1,
@@ -92,6 +95,7 @@ typedef struct SRTContext {
     SRT_TRANSTYPE transtype;
     int linger;
     int tsbpd;
+    int multi_client;
 } SRTContext;
 
 #define D AV_OPT_FLAG_DECODING_PARAM
@@ -145,6 +149,7 @@ static const AVOption libsrt_options[] = {
     { "file",           NULL, 0, AV_OPT_TYPE_CONST,  { .i64 = SRTT_FILE }, INT_MIN, INT_MAX, .flags = D|E, .unit = "transtype" },
     { "linger",         "Number of seconds that the socket waits for unsent data when closing", OFFSET(linger),           AV_OPT_TYPE_INT,      { .i64 = -1 }, -1, INT_MAX,   .flags = D|E },
     { "tsbpd",          "Timestamp-based packet delivery",                                      OFFSET(tsbpd),            AV_OPT_TYPE_BOOL,     { .i64 = -1 }, -1, 1,         .flags = D|E },
+    { "multi_client",   "Accept multiple callers with avio_accept() in listener mode",          OFFSET(multi_client),     AV_OPT_TYPE_BOOL,     { .i64 = 0 },   0, 1,         .flags = D|E },
     { NULL }
 };
 
@@ -234,22 +239,34 @@ static int libsrt_network_wait_fd_timeout(URLContext *h, int eid, int write, int
     }
 }
 
-static int libsrt_listen(int eid, int fd, const struct sockaddr *addr, socklen_t addrlen, URLContext *h, int64_t timeout)
+static int libsrt_bind_listen(int fd, const struct sockaddr *addr, socklen_t addrlen, URLContext *h, int backlog)
 {
-    int ret;
     int reuse = 1;
-    /* Max streamid length plus an extra space for the terminating null character */
-    char streamid[513];
-    int streamid_len = sizeof(streamid);
     if (srt_setsockopt(fd, SOL_SOCKET, SRTO_REUSEADDR, &reuse, sizeof(reuse))) {
         av_log(h, AV_LOG_WARNING, "setsockopt(SRTO_REUSEADDR) failed\n");
     }
     if (srt_bind(fd, addr, addrlen))
         return libsrt_neterrno(h);
 
-    if (srt_listen(fd, 1))
+    if (srt_listen(fd, backlog))
         return libsrt_neterrno(h);
 
+    return 0;
+}
+
+/**
+ * Wait for a caller on a listening socket and accept it.
+ *
+ * @param streamid if not NULL, set to a copy of the stream ID of the caller
+ * @return the accepted socket or a negative error code
+ */
+static int libsrt_accept_caller(int eid, int fd, URLContext *h, int64_t timeout, char **streamid)
+{
+    int ret;
+    /* Max streamid length plus an extra space for the terminating null character */
+    char sid[513];
+    int sid_len = sizeof(sid);
+
     ret = libsrt_network_wait_fd_timeout(h, eid, 0, timeout, &h->interrupt_callback);
     if (ret < 0)
         return ret;
@@ -259,13 +276,31 @@ static int libsrt_listen(int eid, int fd, const struct sockaddr *addr, socklen_t
         return libsrt_neterrno(h);
     if (libsrt_socket_nonblock(ret, 1) < 0)
         av_log(h, AV_LOG_DEBUG, "libsrt_socket_nonblock failed\n");
-    if (!libsrt_getsockopt(h, ret, SRTO_STREAMID, "SRTO_STREAMID", streamid, &streamid_len))
+    if (!libsrt_getsockopt(h, ret, SRTO_STREAMID, "SRTO_STREAMID", sid, &sid_len)) {
         /* Note: returned streamid_len doesn't count the terminating null character */
-        av_log(h, AV_LOG_VERBOSE, "accept streamid [%s], length %d\n", streamid, streamid_len);
+        av_log(h, AV_LOG_VERBOSE, "accept streamid [%s], length %d\n", sid, sid_len);
+        if (streamid) {
+            *streamid = av_strdup(sid);
+            if (!*streamid) {
+                srt_close(ret);
+                return AVERROR(ENOMEM);
+            }
+        }
+    }
 
     return ret;
 }
 
+static int libsrt_listen(int eid, int fd, const struct sockaddr *addr, socklen_t addrlen, URLContext *h, int64_t timeout)
+{
+    int ret;
+
+    if ((ret = libsrt_bind_listen(fd, addr, addrlen, h, 1)) < 0)
+        return ret;
+
+    return libsrt_accept_caller(eid, fd, h, timeout, NULL);
+}
+
 static int libsrt_listen_connect(int eid, int fd, const struct sockaddr *addr, socklen_t addrlen, int64_t timeout, URLContext *h, int will_try_next)
 {
     int ret;
@@ -296,6 +331,18 @@ static int libsrt_setsockopt(URLContext *h, int fd, SRT_SOCKOPT optname, const c
     return 0;
 }
 
+static int libsrt_set_max_packet_size(URLContext *h, int fd)
+{
+    int packet_size = 0;
+    int optlen = sizeof(packet_size);
+    int ret = libsrt_getsockopt(h, fd, SRTO_PAYLOADSIZE, "SRTO_PAYLOADSIZE", &packet_size, &optlen);
+    if (ret < 0)
+        return ret;
+    if (packet_size > 0)
+        h->max_packet_size = packet_size;
+    return 0;
+}
+
 /* - The "POST" options can be altered any time on a connected socket.
      They MAY have also some meaning when set prior to connecting; such
      option is SRTO_RCVSYN, which makes connect/accept call asynchronous.
@@ -455,7 +502,24 @@ static int libsrt_setup(URLContext *h, const char *uri, int flags)
     if (libsrt_socket_nonblock(fd, 1) < 0)
         av_log(h, AV_LOG_DEBUG, "libsrt_socket_nonblock failed\n");
 
-    if (s->mode == SRT_MODE_LISTENER) {
+    if (s->mode == SRT_MODE_LISTENER && s->multi_client) {
+        /* Callers are accepted later by libsrt_accept(); keep the
+         * listening socket and wait for connections on it. */
+        ret = libsrt_bind_listen(fd, cur_ai->ai_addr, cur_ai->ai_addrlen, h,
+                                 SRT_MULTI_CLIENT_BACKLOG);
+        if (ret < 0)
+            goto fail1;
+        ret = eid = libsrt_epoll_create(h, fd, 0);
+        if (eid < 0)
+            goto fail1;
+
+        h->is_streamed = 1;
+        s->fd = fd;
+        s->eid = eid;
+
+        freeaddrinfo(ai);
+        return 0;
+    } else if (s->mode == SRT_MODE_LISTENER) {
         int read_eid = ret = libsrt_epoll_create(h, fd, 0);
         if (ret < 0)
             goto fail1;
@@ -493,13 +557,8 @@ static int libsrt_setup(URLContext *h, const char *uri, int flags)
     }
 
     if (flags & AVIO_FLAG_WRITE) {
-        int packet_size = 0;
-        int optlen = sizeof(packet_size);
-        ret = libsrt_getsockopt(h, fd, SRTO_PAYLOADSIZE, "SRTO_PAYLOADSIZE", &packet_size, &optlen);
-        if (ret < 0)
+        if ((ret = libsrt_set_max_packet_size(h, fd)) < 0)
             goto fail1;
-        if (packet_size > 0)
-            h->max_packet_size = packet_size;
     }
 
     ret = eid = libsrt_epoll_create(h, fd, flags & AVIO_FLAG_WRITE);
@@ -672,6 +731,9 @@ static int libsrt_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "linger", p)) {
             s->linger = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "multi_client", p)) {
+            s->multi_client = strtol(buf, NULL, 10);
+        }
     }
     ret = libsrt_setup(h, uri, flags);
     if (ret < 0)
@@ -683,6 +745,56 @@ err:
     return ret;
 }
 
+static int libsrt_accept(URLContext *s, URLContext **c)
+{
+    SRTContext *sc = s->priv_data;
+    SRTContext *cc;
+    int fd, eid, ret;
+
+    if (sc->mode != SRT_MODE_LISTENER || !sc->multi_client) {
+        av_log(s, AV_LOG_ERROR, "Accepting callers requires multi_client listener mode\n");
+        return AVERROR(EINVAL);
+    }
+    if ((ret = ffurl_alloc(c, s->filename, s->flags, &s->interrupt_callback)) < 0)
+        return ret;
+    cc = (*c)->priv_data;
+
+    /* Every accepted socket is a separate SRT instance user, balanced by
+     * the srt_cleanup() in libsrt_close(). */
+    if (srt_startup() < 0) {
+        ffurl_closep(c);
+        return AVERROR_UNKNOWN;
+    }
+    fd = libsrt_accept_caller(sc->eid, sc->fd, s, sc->listen_timeout, &cc->streamid);
+    if (fd < 0) {
+        ret = fd;
+        goto fail;
+    }
+    if ((ret = libsrt_set_options_post(s, fd)) < 0)
+        goto fail;
+    if ((*c)->flags & AVIO_FLAG_WRITE) {
+        if ((ret = libsrt_set_max_packet_size(*c, fd)) < 0)
+            goto fail;
+    }
+    ret = eid = libsrt_epoll_create(*c, fd, (*c)->flags & AVIO_FLAG_WRITE);
+    if (eid < 0)
+        goto fail;
+
+    (*c)->is_streamed = 1;
+    (*c)->rw_timeout  = s->rw_timeout;
+    cc->fd   = fd;
+    cc->eid  = eid;
+    cc->mode = SRT_MODE_LISTENER;
+    return 0;
+
+fail:
+    if (fd >= 0)
+        srt_close(fd);
+    srt_cleanup();
+    ffurl_closep(c);
+    return ret;
+}
+
 static int libsrt_read(URLContext *h, uint8_t *buf, int size)
 {
     SRTContext *s = h->priv_data;
@@ -746,6 +858,7 @@ const URLProtocol ff_libsrt_protocol = {
     .url_read            = libsrt_read,
     .url_write           = libsrt_write,
     .url_close           = libsrt_close,
+    .url_accept          = libsrt_accept,
     .priv_data_size      = sizeof(SRTContext),
     .flags               = URL_PROTOCOL_FLAG_NETWORK,
     .priv_data_class     = &libsrt_class,
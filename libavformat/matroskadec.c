@@ -66,9 +66,11 @@
 #include "isom.h"
 #include "matroska.h"
 #include "oggdec.h"
+#include "os_support.h"
 /* For ff_codec_get_id(). */
 #include "riff.h"
 #include "rmsipr.h"
+#include "url.h"
 
 #if CONFIG_BZLIB
 #include <bzlib.h>
@@ -432,6 +434,15 @@ typedef struct MatroskaDemuxContext {
 
     /* Bandwidth value for WebM DASH Manifest */
     int bandwidth;
+
+    /* Persistent seek index cache */
+    char    *index_cache;
+    int      index_cache_enabled;
+    int      index_cache_building;
+    int      index_cache_valid;
+    int      index_cache_dirty;
+    int64_t  index_cache_size;
+    int64_t  index_cache_mtime;
 } MatroskaDemuxContext;
 
 #define CHILD_OF(parent) { .def = { .n = parent } }
@@ -3256,6 +3267,125 @@ static int matroska_parse_tracks(AVFormatContext *s)
     return 0;
 }
 
+#define INDEX_CACHE_TAG     MKTAG('M', 'K', 'I', 'X')
+#define INDEX_CACHE_VERSION 1
+
+typedef struct IndexCacheEntry {
+    int64_t pos;
+    int64_t timestamp;
+} IndexCacheEntry;
+
+/*
+ * Identify the input for the index cache by its size and modification
+ * time. Both the input and the cache have to be local files: the file
+ * handle of other protocols says nothing about the resource, and the
+ * cache is replaced by renaming a temporary file.
+ */
+static int matroska_index_cache_stamp(MatroskaDemuxContext *matroska)
+{
+    AVFormatContext *s = matroska->ctx;
+    URLContext *h      = ffio_geturlcontext(s->pb);
+    const char *proto  = avio_find_protocol_name(matroska->index_cache);
+    int fd             = h ? ffurl_get_file_handle(h) : -1;
+    struct stat st;
+
+    if (!h || strcmp(h->prot->name, "file") || !proto || strcmp(proto, "file") ||
+        fd < 0 || fstat(fd, &st)) {
+        av_log(s, AV_LOG_WARNING, "The index cache needs a local input file "
+               "and cache path, ignoring index_cache\n");
+        return 0;
+    }
+
+    matroska->index_cache_size  = avio_size(s->pb);
+    matroska->index_cache_mtime = st.st_mtime;
+    return matroska->index_cache_size > 0;
+}
+
+static void matroska_index_cache_load(MatroskaDemuxContext *matroska)
+{
+    AVFormatContext *s = matroska->ctx;
+    AVIOContext *pb = NULL;
+    IndexCacheEntry *entries = NULL;
+    unsigned *nb_stream_entries = NULL;
+    unsigned nb_entries = 0, entries_size = 0;
+    int64_t size, mtime, segment_start;
+    unsigned nb_streams;
+    int ret;
+
+    if (!matroska_index_cache_stamp(matroska))
+        return;
+    matroska->index_cache_enabled = 1;
+
+    ret = s->io_open(s, &pb, matroska->index_cache, AVIO_FLAG_READ, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_VERBOSE, "No index cache at %s\n", matroska->index_cache);
+        return;
+    }
+
+    if (avio_rl32(pb) != INDEX_CACHE_TAG ||
+        avio_rl32(pb) != INDEX_CACHE_VERSION)
+        goto stale;
+    size          = avio_rl64(pb);
+    mtime         = avio_rl64(pb);
+    segment_start = avio_rl64(pb);
+    nb_streams    = avio_rl32(pb);
+    if (size != matroska->index_cache_size   ||
+        mtime != matroska->index_cache_mtime ||
+        segment_start != matroska->segment_start ||
+        nb_streams != s->nb_streams)
+        goto stale;
+    for (unsigned i = 0; i < nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        if (avio_rl32(pb) != st->time_base.num ||
+            avio_rl32(pb) != st->time_base.den)
+            goto stale;
+    }
+
+    /* Read and check everything before touching the stream indexes. */
+    nb_stream_entries = av_calloc(nb_streams, sizeof(*nb_stream_entries));
+    if (!nb_stream_entries)
+        goto stale;
+    for (unsigned i = 0; i < nb_streams && !avio_feof(pb); i++) {
+        nb_stream_entries[i] = avio_rl32(pb);
+
+        for (unsigned j = 0; j < nb_stream_entries[i] && !avio_feof(pb); j++) {
+            IndexCacheEntry *e;
+
+            if (nb_entries >= UINT_MAX / sizeof(*entries) - 1)
+                goto stale;
+            e = av_fast_realloc(entries, &entries_size, (nb_entries + 1) * sizeof(*entries));
+            if (!e)
+                goto stale;
+            entries = e;
+            e = &entries[nb_entries++];
+            e->pos       = avio_rl64(pb);
+            e->timestamp = avio_rl64(pb);
+            if (e->pos < segment_start || e->pos >= size)
+                goto stale;
+        }
+    }
+    if (avio_feof(pb))
+        goto stale;
+
+    nb_entries = 0;
+    for (unsigned i = 0; i < nb_streams; i++)
+        for (unsigned j = 0; j < nb_stream_entries[i]; j++, nb_entries++)
+            av_add_index_entry(s->streams[i], entries[nb_entries].pos,
+                               entries[nb_entries].timestamp, 0, 0, AVINDEX_KEYFRAME);
+
+    av_log(s, AV_LOG_VERBOSE, "Loaded index cache from %s\n", matroska->index_cache);
+    matroska->index_cache_valid = 1;
+    goto end;
+
+stale:
+    av_log(s, AV_LOG_VERBOSE, "Ignoring stale or invalid index cache %s\n",
+           matroska->index_cache);
+end:
+    av_free(entries);
+    av_free(nb_stream_entries);
+    ff_format_io_close(s, &pb);
+}
+
 static int matroska_read_header(AVFormatContext *s)
 {
     FFFormatContext *const si = ffformatcontext(s);
@@ -3403,6 +3533,10 @@ static int matroska_read_header(AVFormatContext *s)
 
     matroska_add_index_entries(matroska);
 
+    if (matroska->index_cache && !(s->flags & AVFMT_FLAG_IGNIDX) &&
+        (s->pb->seekable & AVIO_SEEKABLE_NORMAL))
+        matroska_index_cache_load(matroska);
+
     matroska_convert_tags(s);
 
     return 0;
@@ -4086,7 +4220,7 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
         return 0;
     }
 
-    if (st->discard >= AVDISCARD_ALL)
+    if (st->discard >= AVDISCARD_ALL && !matroska->index_cache_building)
         return res;
     if (block_duration > INT64_MAX)
         block_duration = INT64_MAX;
@@ -4112,6 +4246,10 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
         }
     }
 
+    /* Discarded tracks are only parsed to be indexed. */
+    if (st->discard >= AVDISCARD_ALL)
+        return res;
+
     if (matroska->skip_to_keyframe &&
         track->type != MATROSKA_TRACK_TYPE_SUBTITLE) {
         // Compare signed timecodes. Timecode may be negative due to codec delay
@@ -4201,6 +4339,68 @@ static int matroska_parse_block(MatroskaDemuxContext *matroska, AVBufferRef *buf
     return 0;
 }
 
+/*
+ * Fast path for the common case of a SimpleBlock with known length directly
+ * inside a cluster: the element header is decoded straight from the I/O
+ * buffer and the payload is read into block->bin without going through the
+ * generic ebml_parse() syntax lookup.
+ * Returns 1 if a block has been read, 0 if the generic parser has to be
+ * used instead (nothing has been consumed in this case), < 0 on error.
+ */
+static int matroska_read_simpleblock(MatroskaDemuxContext *matroska,
+                                     MatroskaBlock *block)
+{
+    AVIOContext *pb = matroska->ctx->pb;
+    MatroskaLevel *level = &matroska->levels[matroska->num_levels - 1];
+    const uint8_t *p = pb->buf_ptr;
+    int64_t pos;
+    uint64_t length;
+    int n, res;
+
+    if (matroska->current_id || pb->buf_end - p < 9 ||
+        *p != MATROSKA_ID_SIMPLEBLOCK || !p[1])
+        return 0;
+
+    n = 8 - ff_log2_tab[p[1]];
+    length = p[1] & (0xff >> n);
+    for (int i = 1; i < n; i++)
+        length = (length << 8) | p[1 + i];
+    /* Leave unknown lengths and oversized blocks to ebml_parse(),
+     * which knows how to complain about them. */
+    if (length + 1 == 1ULL << (7 * n) || length > 0x10000000)
+        return 0;
+
+    pos = avio_tell(pb);
+    if (level->length != EBML_UNKNOWN_LENGTH &&
+        pos + 1 + n + length > level->start + level->length)
+        return 0;
+
+    avio_skip(pb, 1 + n);
+    matroska->unknown_count = 0;
+    matroska->resync_pos    = pos;
+
+    res = ebml_read_binary(pb, length, pos + 1 + n, &block->bin);
+    if (res == NEEDS_CHECKING) {
+        res = pb->error ? pb->error : AVERROR_EOF;
+        if (res == AVERROR_EOF) {
+            av_log(matroska->ctx, AV_LOG_ERROR, "File ended prematurely\n");
+            res = AVERROR(EIO);
+        }
+    }
+    if (res < 0)
+        return res;
+
+    if (level->length != EBML_UNKNOWN_LENGTH) {
+        pos = avio_tell(pb);
+        while (matroska->num_levels && pos == level->start + level->length) {
+            matroska->num_levels--;
+            level--;
+        }
+    }
+
+    return 1;
+}
+
 static int matroska_parse_cluster(MatroskaDemuxContext *matroska)
 {
     MatroskaCluster *cluster = &matroska->current_cluster;
@@ -4224,7 +4424,9 @@ static int matroska_parse_cluster(MatroskaDemuxContext *matroska)
 
     if (matroska->num_levels == 2) {
         /* We are inside a cluster. */
-        res = ebml_parse(matroska, matroska_cluster_parsing, cluster);
+        res = matroska_read_simpleblock(matroska, block);
+        if (!res)
+            res = ebml_parse(matroska, matroska_cluster_parsing, cluster);
 
         if (res >= 0 && block->bin.size > 0) {
             int is_keyframe = block->non_simple ? block->reference.count == 0 : -1;
@@ -4275,6 +4477,85 @@ static int matroska_read_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
+/*
+ * Scan all clusters once to index every keyframe, so that the result
+ * can be stored in the index cache and later seeks don't need to scan.
+ */
+static void matroska_index_cache_build(MatroskaDemuxContext *matroska)
+{
+    AVFormatContext *s = matroska->ctx;
+    int64_t data_offset = ffformatcontext(s)->data_offset;
+    int ret;
+
+    /* Only try once, a failed scan would fail again on the next seek. */
+    matroska->index_cache_enabled = 0;
+    if (data_offset <= 0)
+        return;
+
+    av_log(s, AV_LOG_VERBOSE, "Building index for %s\n", matroska->index_cache);
+    matroska_reset_status(matroska, 0, data_offset);
+    matroska->index_cache_building = 1;
+    while ((ret = matroska_parse_cluster(matroska)) >= 0)
+        matroska_clear_queue(matroska);
+    matroska->index_cache_building = 0;
+    matroska_clear_queue(matroska);
+
+    /* An index of a damaged or truncated file must not be stored. */
+    if (ret != AVERROR_EOF || !matroska->done || s->pb->error) {
+        av_log(s, AV_LOG_WARNING, "Index scan did not reach the end of the "
+               "file cleanly, not writing %s\n", matroska->index_cache);
+        return;
+    }
+
+    matroska->index_cache_valid = 1;
+    matroska->index_cache_dirty = 1;
+}
+
+static void matroska_index_cache_write(MatroskaDemuxContext *matroska)
+{
+    AVFormatContext *s = matroska->ctx;
+    AVIOContext *pb = NULL;
+    char *tmp;
+    int ret;
+
+    tmp = av_asprintf("%s.tmp", matroska->index_cache);
+    if (!tmp)
+        return;
+    ret = s->io_open(s, &pb, tmp, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_WARNING, "Could not open index cache %s for writing\n", tmp);
+        av_free(tmp);
+        return;
+    }
+
+    avio_wl32(pb, INDEX_CACHE_TAG);
+    avio_wl32(pb, INDEX_CACHE_VERSION);
+    avio_wl64(pb, matroska->index_cache_size);
+    avio_wl64(pb, matroska->index_cache_mtime);
+    avio_wl64(pb, matroska->segment_start);
+    avio_wl32(pb, s->nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        avio_wl32(pb, s->streams[i]->time_base.num);
+        avio_wl32(pb, s->streams[i]->time_base.den);
+    }
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const FFStream *const sti = cffstream(s->streams[i]);
+        avio_wl32(pb, sti->nb_index_entries);
+        for (int j = 0; j < sti->nb_index_entries; j++) {
+            avio_wl64(pb, sti->index_entries[j].pos);
+            avio_wl64(pb, sti->index_entries[j].timestamp);
+        }
+    }
+
+    ret = ff_format_io_close(s, &pb);
+    if (ret >= 0)
+        ret = ff_rename(tmp, matroska->index_cache, s);
+    if (ret < 0)
+        av_log(s, AV_LOG_WARNING, "Failed to write index cache %s\n",
+               matroska->index_cache);
+    av_free(tmp);
+}
+
 static int matroska_read_seek(AVFormatContext *s, int stream_index,
                               int64_t timestamp, int flags)
 {
@@ -4290,6 +4571,9 @@ static int matroska_read_seek(AVFormatContext *s, int stream_index,
         matroska_parse_cues(matroska);
     }
 
+    if (matroska->index_cache_enabled && !matroska->index_cache_valid)
+        matroska_index_cache_build(matroska);
+
     if (!sti->nb_index_entries)
         goto err;
     timestamp = FFMAX(timestamp, sti->index_entries[0].timestamp);
@@ -4349,6 +4633,9 @@ static int matroska_read_close(AVFormatContext *s)
     MatroskaTrack *tracks = matroska->tracks.elem;
     int n;
 
+    if (matroska->index_cache_dirty)
+        matroska_index_cache_write(matroska);
+
     matroska_clear_queue(matroska);
 
     for (n = 0; n < matroska->tracks.nb_elem; n++)
@@ -4359,6 +4646,8 @@ static int matroska_read_close(AVFormatContext *s)
     return 0;
 }
 
+#define OFFSET(x) offsetof(MatroskaDemuxContext, x)
+
 #if CONFIG_WEBM_DASH_MANIFEST_DEMUXER
 typedef struct {
     int64_t start_time_ns;
@@ -4777,7 +5066,6 @@ static int webm_dash_manifest_read_packet(AVFormatContext *s, AVPacket *pkt)
     return AVERROR_EOF;
 }
 
-#define OFFSET(x) offsetof(MatroskaDemuxContext, x)
 static const AVOption options[] = {
     { "live", "flag indicating that the input is a live file that only has the headers.", OFFSET(is_live), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "bandwidth", "bandwidth of this stream to be specified in the DASH manifest.", OFFSET(bandwidth), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
@@ -4803,11 +5091,24 @@ const FFInputFormat ff_webm_dash_manifest_demuxer = {
 };
 #endif
 
+static const AVOption matroska_options[] = {
+    { "index_cache", "path of a persistent seek index cache", OFFSET(index_cache), AV_OPT_TYPE_STRING, {.str = NULL}, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+    { NULL },
+};
+
+static const AVClass matroska_class = {
+    .class_name = "matroska,webm demuxer",
+    .item_name  = av_default_item_name,
+    .option     = matroska_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 const FFInputFormat ff_matroska_demuxer = {
     .p.name         = "matroska,webm",
     .p.long_name    = NULL_IF_CONFIG_SMALL("Matroska / WebM"),
     .p.extensions   = "mkv,mk3d,mka,mks,webm",
     .p.mime_type    = "audio/webm,audio/x-matroska,video/webm,video/x-matroska",
+    .p.priv_class   = &matroska_class,
     .priv_data_size = sizeof(MatroskaDemuxContext),
     .flags_internal = FF_INFMT_FLAG_INIT_CLEANUP,
     .read_probe     = matroska_probe,
@@ -67,6 +67,7 @@
 #include "id3v1.h"
 #include "mov_chan.h"
 #include "replaygain.h"
+#include "url.h"
 
 #if CONFIG_ZLIB
 #include <zlib.h>
@@ -1222,12 +1223,86 @@ static int mov_read_pasp(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     return 0;
 }
 
+/* the options of the protocol the main connection uses that were changed from their defaults */
+static int mov_get_protocol_options(URLContext *uc, AVDictionary **opts)
+{
+    const AVOption *o = NULL;
+    int ret;
+
+    if (!uc->prot->priv_data_class)
+        return 0;
+
+    while ((o = av_opt_next(uc->priv_data, o))) {
+        uint8_t *val;
+
+        if (o->type == AV_OPT_TYPE_CONST || !(o->flags & AV_OPT_FLAG_DECODING_PARAM) ||
+            o->flags & (AV_OPT_FLAG_READONLY | AV_OPT_FLAG_EXPORT) ||
+            av_opt_is_set_to_default(uc->priv_data, o) > 0 ||
+            av_opt_get(uc->priv_data, o->name, 0, &val) < 0)
+            continue;
+        ret = av_dict_set(opts, o->name, val, AV_DICT_DONT_STRDUP_VAL);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/*
+ * The moov comes after the media data. Rather than skipping the mdat on the
+ * main connection and then seeking back to it for the first packet, read
+ * the rest of the file on a second connection opened past the mdat and keep
+ * the main one parked at the start of the payload.
+ */
+static int mov_read_moov_from_tail(MOVContext *c, AVIOContext *pb, MOVAtom atom)
+{
+    AVFormatContext *s = c->fc;
+    URLContext *uc = ffio_geturlcontext(pb);
+    AVIOContext *tail_pb = NULL;
+    AVDictionary *opts = NULL;
+    int64_t offset = avio_tell(pb) + atom.size;
+    int64_t size = avio_size(pb);
+    int ret;
+
+    if (pb != s->pb || c->moov_retry || !(pb->seekable & AVIO_SEEKABLE_NORMAL) ||
+        s->flags & AVFMT_FLAG_IGNIDX || !uc || !(uc->prot->flags & URL_PROTOCOL_FLAG_NETWORK) ||
+        offset <= 0 || size <= offset || atom.size <= pb->buf_end - pb->buf_ptr)
+        return 0;
+
+    /* Open it like the main connection, with the current cookies etc. */
+    if ((ret = mov_get_protocol_options(uc, &opts)) < 0 ||
+        (ret = av_dict_set_int(&opts, "offset", offset, 0)) < 0) {
+        av_dict_free(&opts);
+        return ret;
+    }
+    ret = s->io_open(s, &tail_pb, s->url, AVIO_FLAG_READ, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        av_log(s, AV_LOG_VERBOSE, "Could not open a second connection for the moov, skipping the mdat\n");
+        return 0;
+    }
+    if (avio_seek(tail_pb, offset, SEEK_SET) != offset) {
+        ff_format_io_close(s, &tail_pb);
+        return 0;
+    }
+
+    av_log(s, AV_LOG_DEBUG, "Reading the atoms past offset %"PRId64" on a second connection\n", offset);
+    ret = mov_read_default(c, tail_pb, (MOVAtom){ AV_RL32("root"), size - offset });
+    ff_format_io_close(s, &tail_pb);
+    if (ret < 0)
+        return ret;
+
+    c->moov_from_tail = c->found_moov;
+    return 0;
+}
+
 /* this atom contains actual media data */
 static int mov_read_mdat(MOVContext *c, AVIOContext *pb, MOVAtom atom)
 {
     if (atom.size == 0) /* wrong one (MP4) */
         return 0;
     c->found_mdat=1;
+    if (!c->found_moov && c->moov_tail_request)
+        return mov_read_moov_from_tail(c, pb, atom);
     return 0; /* now go for moov */
 }
 
@@ -3885,11 +3960,353 @@ static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, uns
     return *ctts_count;
 }
 
+/**
+ * Expand ctts entries such that we have a 1-1 mapping with samples.
+ */
+static int mov_expand_ctts(MOVStreamContext *sc)
+{
+    MOVCtts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+    unsigned int i, j;
+
+    if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        return AVERROR_INVALIDDATA;
+    sc->ctts_count = 0;
+    sc->ctts_allocated_size = 0;
+    sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                            sc->sample_count * sizeof(*sc->ctts_data));
+    if (!sc->ctts_data) {
+        av_free(ctts_data_old);
+        return AVERROR(ENOMEM);
+    }
+
+    memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+    for (i = 0; i < ctts_count_old &&
+                sc->ctts_count < sc->sample_count; i++)
+        for (j = 0; j < ctts_data_old[i].count &&
+                    sc->ctts_count < sc->sample_count; j++)
+            add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                           &sc->ctts_allocated_size, 1,
+                           ctts_data_old[i].duration);
+    av_free(ctts_data_old);
+    return 0;
+}
+
+/* distance in samples between the cursors kept for seeking in a lazy index */
+#define MOV_LAZY_INDEX_INTERVAL 1024
+/* number of samples used to estimate the video delay with a lazy index */
+#define MOV_LAZY_INDEX_PROBE_SAMPLES 1024
+
+static int mov_lazy_index_eligible(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!mov->lazy_index || mov->found_iloc)
+        return 0;
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+        st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    if (!sc->sample_count || sc->sample_count > INT_MAX ||
+        !sc->chunk_count || !sc->stsc_count || !sc->stts_count)
+        return 0;
+    /* mov_fix_index() rewrites the whole index */
+    if (sc->elst_count && !mov->ignore_editlist && mov->advanced_editlist)
+        return 0;
+    /* the stsz sanity checks of mov_build_index() work chunk by chunk */
+    if (sc->stsz_sample_size > 0 && sc->sample_size > 0 &&
+        sc->stsz_sample_size != sc->sample_size)
+        return 0;
+    if (!sc->stsz_sample_size && !sc->sample_sizes)
+        return 0;
+    /* mov_update_iamf_streams() copies the index to the other streams */
+    if (sc->iamf)
+        return 0;
+    if (sc->pseudo_stream_id != -1)
+        for (unsigned int i = 0; i < sc->stsc_count; i++)
+            if (sc->stsc_data[i].id - 1 != sc->pseudo_stream_id)
+                return 0;
+    return 1;
+}
+
+static void mov_index_cursor_enter_chunk(MOVStreamContext *sc, MOVIndexCursor *c)
+{
+    c->pos = sc->chunk_offsets[c->chunk];
+    c->chunk_sample = 0;
+    while (mov_stsc_index_valid(c->stsc_index, sc->stsc_count) &&
+           c->chunk + 1 == sc->stsc_data[c->stsc_index + 1].first)
+        c->stsc_index++;
+}
+
+/**
+ * Resolve the sample under the cursor into e and move the cursor to the
+ * next sample, the same way mov_build_index() does.
+ */
+static int mov_index_cursor_next(AVStream *st, MOVIndexCursor *c, AVIndexEntry *e)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+    unsigned int sample_size;
+    int keyframe = 0;
+
+    while (c->chunk_sample >= sc->stsc_data[c->stsc_index].count) {
+        if (++c->chunk >= sc->chunk_count)
+            return AVERROR_EOF;
+        mov_index_cursor_enter_chunk(sc, c);
+    }
+
+    if (!sc->keyframe_absent && (!sc->keyframe_count ||
+        c->sample + sc->lazy_index.key_off == sc->keyframes[c->stss_index])) {
+        keyframe = 1;
+        if (c->stss_index + 1 < sc->keyframe_count)
+            c->stss_index++;
+    } else if (sc->stps_count && c->sample + sc->lazy_index.key_off == sc->stps_data[c->stps_index]) {
+        keyframe = 1;
+        if (c->stps_index + 1 < sc->stps_count)
+            c->stps_index++;
+    }
+    if (rap_group_present && c->rap_group_index < sc->rap_group_count) {
+        if (sc->rap_group[c->rap_group_index].index > 0)
+            keyframe = 1;
+        if (++c->rap_group_sample == sc->rap_group[c->rap_group_index].count) {
+            c->rap_group_sample = 0;
+            c->rap_group_index++;
+        }
+    }
+    if (sc->keyframe_absent
+        && !sc->stps_count
+        && !rap_group_present
+        && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || !c->sample))
+        keyframe = 1;
+    if (keyframe)
+        c->distance = 0;
+
+    sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[c->sample];
+    if (sample_size > 0x3FFFFFFF || c->pos > INT64_MAX - sample_size)
+        return AVERROR_INVALIDDATA;
+
+    e->pos          = c->pos;
+    e->timestamp    = c->dts;
+    e->size         = sample_size;
+    e->min_distance = c->distance;
+    e->flags        = keyframe ? AVINDEX_KEYFRAME : 0;
+
+    c->pos += sample_size;
+    c->dts += sc->stts_data[c->stts_index].duration;
+    c->distance++;
+    c->stts_sample++;
+    c->chunk_sample++;
+    c->sample++;
+    if (c->stts_index + 1 < sc->stts_count && c->stts_sample == sc->stts_data[c->stts_index].count) {
+        c->stts_sample = 0;
+        c->stts_index++;
+    }
+    return 0;
+}
+
+static int mov_lazy_index_init(MOVContext *mov, AVStream *st, int64_t start_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVIndexCursor c = { .dts = start_dts };
+    unsigned int stsc_index = 0;
+    int64_t nb_samples = 0;
+
+    /* count the samples the chunk layout actually describes */
+    for (unsigned int i = 0; i < sc->chunk_count && nb_samples < sc->sample_count; i++) {
+        while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+               i + 1 == sc->stsc_data[stsc_index + 1].first)
+            stsc_index++;
+        nb_samples += sc->stsc_data[stsc_index].count;
+    }
+
+    mov_index_cursor_enter_chunk(sc, &c);
+    sc->lazy_index.points = av_fast_realloc(NULL, &sc->lazy_index.points_allocated_size,
+                                            sizeof(*sc->lazy_index.points));
+    if (!sc->lazy_index.points)
+        return AVERROR(ENOMEM);
+    sc->lazy_index.points[0] = c;
+    sc->lazy_index.nb_points = 1;
+    sc->lazy_index.cur = c;
+    sc->lazy_index.nb_samples = FFMIN(nb_samples, sc->sample_count);
+    sc->lazy_index.key_off = (sc->keyframe_count && sc->keyframes[0] > 0) ||
+                             (sc->stps_count && sc->stps_data[0] > 0);
+    sc->lazy_index.entry_samples[0] =
+    sc->lazy_index.entry_samples[1] = -1;
+    sc->lazy_index.enabled = 1;
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: lazy index of %d samples\n",
+           st->index, sc->lazy_index.nb_samples);
+    return 0;
+}
+
+/**
+ * Resolve sample n of a lazily indexed stream, walking the sample tables
+ * from the closest cursor. The returned entry stays valid until two more
+ * samples of the stream have been resolved.
+ */
+static AVIndexEntry *mov_lazy_index_get(AVStream *st, int n)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int point = n / MOV_LAZY_INDEX_INTERVAL;
+    MOVIndexCursor c;
+    AVIndexEntry *e;
+    int slot;
+
+    if (n < 0 || n >= sc->lazy_index.nb_samples)
+        return NULL;
+    for (slot = 0; slot < 2; slot++)
+        if (sc->lazy_index.entry_samples[slot] == n) {
+            /* keep it valid while the next sample is resolved */
+            sc->lazy_index.next_entry = !slot;
+            return &sc->lazy_index.entries[slot];
+        }
+
+    c = sc->lazy_index.points[FFMIN(point, sc->lazy_index.nb_points - 1)];
+    if (sc->lazy_index.cur.sample <= n && sc->lazy_index.cur.sample > c.sample)
+        c = sc->lazy_index.cur;
+
+    slot = sc->lazy_index.next_entry;
+    e    = &sc->lazy_index.entries[slot];
+    sc->lazy_index.entry_samples[slot] = -1;
+    while (c.sample <= n) {
+        if (c.sample == sc->lazy_index.nb_points * MOV_LAZY_INDEX_INTERVAL) {
+            MOVIndexCursor *points = av_fast_realloc(sc->lazy_index.points,
+                                                     &sc->lazy_index.points_allocated_size,
+                                                     (sc->lazy_index.nb_points + 1) * sizeof(*points));
+            if (points) {
+                sc->lazy_index.points = points;
+                points[sc->lazy_index.nb_points++] = c;
+            }
+        }
+        if (mov_index_cursor_next(st, &c, e) < 0) {
+            /* mov_build_index() stops at the first broken sample, too */
+            sc->lazy_index.nb_samples = c.sample;
+            return NULL;
+        }
+    }
+
+    sc->lazy_index.cur = c;
+    sc->lazy_index.entry_samples[slot] = n;
+    sc->lazy_index.next_entry = !slot;
+    return e;
+}
+
+/**
+ * Lazy index counterpart of av_index_search_timestamp().
+ */
+static int mov_lazy_index_search(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int backward = flags & AVSEEK_FLAG_BACKWARD;
+    int a = -1, b = -1, key = -1;
+    unsigned int lo, hi;
+    AVIndexEntry *e;
+
+    /* extend the cursors past the wanted timestamp */
+    while (sc->lazy_index.points[sc->lazy_index.nb_points - 1].dts <= wanted_timestamp &&
+           sc->lazy_index.nb_points * (int64_t)MOV_LAZY_INDEX_INTERVAL < sc->lazy_index.nb_samples) {
+        unsigned int nb_points = sc->lazy_index.nb_points;
+        if (!mov_lazy_index_get(st, nb_points * MOV_LAZY_INDEX_INTERVAL) ||
+            sc->lazy_index.nb_points == nb_points)
+            break;
+    }
+
+    /* last cursor at or before the wanted timestamp */
+    lo = 0;
+    hi = sc->lazy_index.nb_points - 1;
+    while (lo < hi) {
+        unsigned int m = (lo + hi + 1) >> 1;
+        if (sc->lazy_index.points[m].dts <= wanted_timestamp)
+            lo = m;
+        else
+            hi = m - 1;
+    }
+
+    for (int n = lo * MOV_LAZY_INDEX_INTERVAL; (e = mov_lazy_index_get(st, n)); n++) {
+        if (b < 0 && e->timestamp >= wanted_timestamp)
+            b = n;
+        if (e->timestamp > wanted_timestamp)
+            break;
+        a = n;
+        if (e->flags & AVINDEX_KEYFRAME)
+            key = n;
+    }
+
+    if (flags & AVSEEK_FLAG_ANY)
+        return backward ? a : b;
+
+    if (backward) {
+        /* the keyframe may precede the cursor */
+        while (a >= 0 && key < 0 && lo-- > 0) {
+            int end = (lo + 1) * MOV_LAZY_INDEX_INTERVAL;
+            for (int n = lo * MOV_LAZY_INDEX_INTERVAL; n < end && (e = mov_lazy_index_get(st, n)); n++)
+                if (e->flags & AVINDEX_KEYFRAME)
+                    key = n;
+        }
+        return key;
+    }
+
+    for (int n = b; n >= 0 && (e = mov_lazy_index_get(st, n)); n++)
+        if (e->flags & AVINDEX_KEYFRAME)
+            return n;
+    return -1;
+}
+
+/**
+ * Replace the lazy index of a stream by a full one, for code that needs
+ * to modify or walk ffstream(st)->index_entries.
+ */
+static int mov_lazy_index_expand(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVIndexCursor c = sc->lazy_index.points[0];
+    int nb_samples = sc->lazy_index.nb_samples;
+    int ret = 0;
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: building the full index\n", st->index);
+
+    av_assert0(!sti->nb_index_entries);
+    sc->lazy_index.enabled = 0;
+    av_freep(&sc->lazy_index.points);
+    sc->lazy_index.nb_points = sc->lazy_index.points_allocated_size = 0;
+
+    if (av_reallocp_array(&sti->index_entries, nb_samples, sizeof(*sti->index_entries)) < 0)
+        return AVERROR(ENOMEM);
+    sti->index_entries_allocated_size = nb_samples * sizeof(*sti->index_entries);
+    while (sti->nb_index_entries < nb_samples &&
+           mov_index_cursor_next(st, &c, &sti->index_entries[sti->nb_index_entries]) >= 0)
+        sti->nb_index_entries++;
+
+    if (sc->ctts_data) {
+        ret = mov_expand_ctts(sc);
+        sc->ctts_index  = sc->current_sample;
+        sc->ctts_sample = 0;
+    }
+    return ret;
+}
+
+/**
+ * Index entry n of a stream, or NULL past the last one.
+ */
+static AVIndexEntry *mov_get_index_entry(AVStream *st, int n)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+
+    if (sc->lazy_index.enabled)
+        return mov_lazy_index_get(st, n);
+    return n >= 0 && n < sti->nb_index_entries ? &sti->index_entries[n] : NULL;
+}
+
 #define MAX_REORDER_DELAY 16
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
     FFStream *const sti = ffstream(st);
+    int nb_entries = msc->lazy_index.enabled ?
+                     FFMIN(msc->lazy_index.nb_samples, MOV_LAZY_INDEX_PROBE_SAMPLES) :
+                     sti->nb_index_entries;
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -3902,14 +4319,18 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        for (int ind = 0; ind < nb_entries && ctts_ind < msc->ctts_count; ++ind) {
+            AVIndexEntry *e = mov_get_index_entry(st, ind);
+            if (!e)
+                break;
+
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = e->timestamp + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4382,8 +4803,6 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     unsigned int stps_index = 0;
     unsigned int i, j;
     uint64_t stream_size = 0;
-    MOVCtts *ctts_data_old = sc->ctts_data;
-    unsigned int ctts_count_old = sc->ctts_count;
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4453,6 +4872,30 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         if (!sc->sample_count || sti->nb_index_entries)
             return;
+
+        if (mov_lazy_index_eligible(mov, st)) {
+            if (mov_lazy_index_init(mov, st, current_dts) < 0)
+                return;
+
+            if (sc->stsz_sample_size > 0)
+                stream_size = (uint64_t)sc->stsz_sample_size * sc->lazy_index.nb_samples;
+            else
+                for (i = 0; i < sc->lazy_index.nb_samples; i++)
+                    stream_size += sc->sample_sizes[i];
+            if (st->duration > 0)
+                st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                for (i = 0; i < 99; i++) {
+                    AVIndexEntry *e = mov_lazy_index_get(st, i);
+                    if (!e)
+                        break;
+                    ff_rfps_add_frame(mov->fc, st, e->timestamp);
+                }
+            }
+            goto done;
+        }
+
         if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
             return;
         if (av_reallocp_array(&sti->index_entries,
@@ -4463,30 +4906,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
         sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
 
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
-                return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
-                return;
-            }
-
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
-        }
+        if (sc->ctts_data && mov_expand_ctts(sc) < 0)
+            return;
 
         for (i = 0; i < sc->chunk_count; i++) {
             int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
@@ -4687,9 +5108,11 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         mov_fix_index(mov, st);
     }
 
+done:
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO &&
+        mov_get_index_entry(st, 0)) {
+        st->start_time = mov_get_index_entry(st, 0)->timestamp + sc->dts_shift;
         if (sc->ctts_data) {
             st->start_time += sc->ctts_data[0].duration;
         }
@@ -4990,14 +5413,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless the index is resolved from them. */
+    if (!sc->lazy_index.enabled) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
     av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
     av_freep(&sc->sgpd_sync);
 
@@ -5501,6 +5926,12 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    if (sc->lazy_index.enabled) {
+        int ret = mov_lazy_index_expand(c, st);
+        if (ret < 0)
+            return ret;
+    }
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -8671,6 +9102,12 @@ static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom)
                 c->atom_depth --;
                 return err;
             }
+            if (c->moov_from_tail) {
+                /* everything past the mdat has been read already, so stay
+                 * at the start of the media data for the first packet */
+                c->atom_depth --;
+                return 0;
+            }
             if (c->found_moov && c->found_mdat && a.size <= INT64_MAX - start_pos &&
                 ((!(pb->seekable & AVIO_SEEKABLE_NORMAL) || c->fc->flags & AVFMT_FLAG_IGNIDX || c->frag_index.complete) ||
                  start_pos + a.size == avio_size(pb))) {
@@ -8822,6 +9259,9 @@ static void mov_read_chapters(AVFormatContext *s)
         sc = st->priv_data;
         cur_pos = avio_tell(sc->pb);
 
+        if (sc->lazy_index.enabled && mov_lazy_index_expand(mov, st) < 0)
+            continue;
+
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
             if (!st->attached_pic.data && sti->nb_index_entries) {
@@ -9029,6 +9469,7 @@ static void mov_free_stream_context(AVFormatContext *s, AVStream *st)
     av_freep(&sc->open_key_samples);
     av_freep(&sc->display_matrix);
     av_freep(&sc->index_ranges);
+    av_freep(&sc->lazy_index.points);
 
     if (sc->extradata)
         for (int i = 0; i < sc->stsd_count; i++)
@@ -9589,6 +10030,10 @@ static int mov_read_header(AVFormatContext *s)
         AVStream *st = s->streams[i];
         FFStream *const sti = ffstream(st);
         MOVStreamContext *sc = st->priv_data;
+        /* mov_read_packet() clamps the stored entries to the next root atom */
+        if (sc->lazy_index.enabled && mov->next_root_atom &&
+            (err = mov_lazy_index_expand(mov, st)) < 0)
+            return err;
         fix_timescale(mov, sc);
         if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
             st->codecpar->codec_id   == AV_CODEC_ID_AAC) {
@@ -9721,6 +10166,7 @@ static int mov_read_header(AVFormatContext *s)
             break;
         }
     }
+    /* streams with a lazy index are not taken into account */
     ff_configure_buffers_for_index(s, AV_TIME_BASE);
 
     for (i = 0; i < mov->frag_index.nb_items; i++)
@@ -9739,10 +10185,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int no_interleave = !mov->interleaved_read || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL);
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        AVIndexEntry *current_sample;
+        if (msc->pb && (current_sample = mov_get_index_entry(avst, msc->current_sample))) {
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             uint64_t dtsdiff = best_dts > dts ? best_dts - (uint64_t)dts : ((uint64_t)dts - best_dts);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
@@ -9868,8 +10313,8 @@ static int mov_finalize_packet(AVFormatContext *s, AVStream *st, AVIndexEntry *s
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-            ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+        AVIndexEntry *next_sample = mov_get_index_entry(st, sc->current_sample);
+        int64_t next_dts = next_sample ? next_sample->timestamp : st->duration;
 
         if (next_dts >= pkt->dts)
             pkt->duration = next_dts - pkt->dts;
@@ -10069,7 +10514,6 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
 static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
@@ -10078,7 +10522,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_get_index_entry(st, sample)->timestamp;
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -10095,7 +10539,6 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int sample, time_sample, ret;
     unsigned int i;
 
@@ -10108,9 +10551,15 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        AVIndexEntry *first;
+
+        if (sc->lazy_index.enabled)
+            sample = mov_lazy_index_search(st, timestamp, flags);
+        else
+            sample = av_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        first = mov_get_index_entry(st, 0);
+        if (sample < 0 && first && timestamp < first->timestamp)
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -10157,9 +10606,8 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    int64_t first_ts = mov_get_index_entry(st, 0)->timestamp;
+    int64_t ts = mov_get_index_entry(st, sample)->timestamp;
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -10190,7 +10638,7 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
 
     if (mc->seek_individually) {
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        int64_t seek_timestamp = mov_get_index_entry(st, sample)->timestamp;
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -10246,6 +10694,14 @@ static const AVOption mov_options[] = {
         0, 1, FLAGS},
     {"ignore_chapters", "", OFFSET(ignore_chapters), AV_OPT_TYPE_BOOL, {.i64 = 0},
         0, 1, FLAGS},
+    {"lazy_index",
+        "Resolve index entries from the sample tables on demand instead of building the whole index",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
+    {"moov_tail_request",
+        "Read a trailing moov on a second connection instead of seeking over the media data",
+        OFFSET(moov_tail_request), AV_OPT_TYPE_BOOL, {.i64 = 0},
+        0, 1, FLAGS},
     {"use_mfra_for",
         "use mfra for fragment timestamps",
         OFFSET(use_mfra_for), AV_OPT_TYPE_INT, {.i64 = FF_MOV_FLAG_MFRA_AUTO},
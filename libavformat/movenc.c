@@ -79,6 +79,7 @@ static const AVOption options[] = {
     { "encryption_key", "The media encryption key (hex)", offsetof(MOVMuxContext, encryption_key), AV_OPT_TYPE_BINARY, .flags = AV_OPT_FLAG_ENCODING_PARAM },
     { "encryption_kid", "The media encryption key identifier (hex)", offsetof(MOVMuxContext, encryption_kid), AV_OPT_TYPE_BINARY, .flags = AV_OPT_FLAG_ENCODING_PARAM },
     { "encryption_scheme",    "Configures the encryption scheme, allowed values are none, cenc-aes-ctr", offsetof(MOVMuxContext, encryption_scheme_str),   AV_OPT_TYPE_STRING, {.str = NULL}, .flags = AV_OPT_FLAG_ENCODING_PARAM },
+    { "faststart_reserve", "Reserve space for the moov atom in front of the media data to avoid the faststart second pass", offsetof(MOVMuxContext, faststart_reserve), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "frag_duration", "Maximum fragment duration", offsetof(MOVMuxContext, max_fragment_duration), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
     { "frag_interleave", "Interleave samples within fragments (max number of consecutive samples, lower is tighter interleaving, but with more overhead)", offsetof(MOVMuxContext, frag_interleave), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "frag_size", "Maximum fragment size", offsetof(MOVMuxContext, max_fragment_size), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
@@ -5829,6 +5830,85 @@ static void mov_parse_truehd_frame(AVPacket *pkt, MOVTrack *trk)
     return;
 }
 
+/* Packets at least this large are referenced rather than copied into the fragment */
+#define MOV_MDAT_REF_MIN_SIZE 4096
+
+static int64_t mov_track_mdat_size(const MOVTrack *track)
+{
+    return track->mdat_slices_size + (track->mdat_buf ? avio_tell(track->mdat_buf) : 0);
+}
+
+static int mov_add_mdat_slice(MOVTrack *track, AVBufferRef *buf, const uint8_t *data, int size)
+{
+    MOVMdatSlice *slices = av_fast_realloc(track->mdat_slices, &track->mdat_slices_capacity,
+                                           (track->nb_mdat_slices + 1) * sizeof(*slices));
+    if (!slices) {
+        av_buffer_unref(&buf);
+        return AVERROR(ENOMEM);
+    }
+    track->mdat_slices = slices;
+    slices[track->nb_mdat_slices++] = (MOVMdatSlice){ buf, data, size };
+    track->mdat_slices_size += size;
+    return 0;
+}
+
+/*
+ * Queue the packet payload for the mdat of the next fragment by reference.
+ * Whatever was written to the track's dynamic buffer before it is moved to
+ * a slice of its own to keep the data in order.
+ */
+static int mov_add_mdat_packet(MOVTrack *track, const AVPacket *pkt, int size)
+{
+    AVBufferRef *buf;
+    int ret;
+
+    if (avio_tell(track->mdat_buf) > 0) {
+        uint8_t *data;
+        int data_size = avio_close_dyn_buf(track->mdat_buf, &data);
+
+        track->mdat_buf = NULL;
+        buf = av_buffer_create(data, data_size, NULL, NULL, 0);
+        if (!buf) {
+            av_free(data);
+            return AVERROR(ENOMEM);
+        }
+        if ((ret = mov_add_mdat_slice(track, buf, data, data_size)) < 0)
+            return ret;
+        if ((ret = avio_open_dyn_buf(&track->mdat_buf)) < 0)
+            return ret;
+    }
+
+    buf = av_buffer_ref(pkt->buf);
+    if (!buf)
+        return AVERROR(ENOMEM);
+    return mov_add_mdat_slice(track, buf, pkt->data, size);
+}
+
+static void mov_free_mdat_slices(MOVTrack *track)
+{
+    for (int i = 0; i < track->nb_mdat_slices; i++)
+        av_buffer_unref(&track->mdat_slices[i].buf);
+    track->nb_mdat_slices   = 0;
+    track->mdat_slices_size = 0;
+}
+
+static void mov_write_track_mdat(AVIOContext *pb, MOVTrack *track)
+{
+    uint8_t *buf;
+    int buf_size;
+
+    for (int i = 0; i < track->nb_mdat_slices; i++)
+        avio_write(pb, track->mdat_slices[i].data, track->mdat_slices[i].size);
+    mov_free_mdat_slices(track);
+
+    if (!track->mdat_buf)
+        return;
+    buf_size = avio_close_dyn_buf(track->mdat_buf, &buf);
+    track->mdat_buf = NULL;
+    avio_write(pb, buf, buf_size);
+    av_free(buf);
+}
+
 static int mov_flush_fragment_interleaving(AVFormatContext *s, MOVTrack *track)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -6062,8 +6142,7 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
         }
         if (!track->entry)
             continue;
-        if (track->mdat_buf)
-            mdat_size += avio_tell(track->mdat_buf);
+        mdat_size += mov_track_mdat_size(track);
         if (first_track < 0)
             first_track = i;
     }
@@ -6083,7 +6162,7 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
         if (mov->flags & FF_MOV_FLAG_SEPARATE_MOOF) {
             if (!track->entry)
                 continue;
-            mdat_size = avio_tell(track->mdat_buf);
+            mdat_size = mov_track_mdat_size(track);
             moof_tracks = i;
         } else {
             write_moof = i == first_track;
@@ -6103,16 +6182,13 @@ static int mov_flush_fragment(AVFormatContext *s, int force)
         track->entries_flushed = 0;
         track->end_reliable = 0;
         if (!mov->frag_interleave) {
-            if (!track->mdat_buf)
-                continue;
-            buf_size = avio_close_dyn_buf(track->mdat_buf, &buf);
-            track->mdat_buf = NULL;
-        } else {
-            if (!mov->mdat_buf)
-                continue;
-            buf_size = avio_close_dyn_buf(mov->mdat_buf, &buf);
-            mov->mdat_buf = NULL;
+            mov_write_track_mdat(s->pb, track);
+            continue;
         }
+        if (!mov->mdat_buf)
+            continue;
+        buf_size = avio_close_dyn_buf(mov->mdat_buf, &buf);
+        mov->mdat_buf = NULL;
 
         avio_write(s->pb, buf, buf_size);
         av_free(buf);
@@ -6402,6 +6478,11 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
             if (ret) {
                 goto err;
             }
+        } else if (pb == trk->mdat_buf && !mov->frag_interleave &&
+                   pkt->buf && size >= MOV_MDAT_REF_MIN_SIZE) {
+            if ((ret = mov_add_mdat_packet(trk, pkt, size)) < 0)
+                goto err;
+            pb = trk->mdat_buf;
         } else {
             avio_write(pb, pkt->data, size);
         }
@@ -6419,6 +6500,8 @@ int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     trk->cluster[trk->entry].pos              = avio_tell(pb) - size;
+    if (pb == trk->mdat_buf)
+        trk->cluster[trk->entry].pos         += trk->mdat_slices_size;
     trk->cluster[trk->entry].samples_in_chunk = samples_in_chunk;
     trk->cluster[trk->entry].chunkNum         = 0;
     trk->cluster[trk->entry].size             = size;
@@ -7067,6 +7150,8 @@ static void mov_free(AVFormatContext *s)
 
         ff_mov_cenc_free(&track->cenc);
         ffio_free_dyn_buf(&track->mdat_buf);
+        mov_free_mdat_slices(track);
+        av_freep(&track->mdat_slices);
 
         ffio_free_dyn_buf(&track->iamf_buf);
         if (track->iamf)
@@ -7646,6 +7731,9 @@ static int mov_init(AVFormatContext *s)
              track->timescale = 10000000;
         }
 
+        if (st->duration > 0)
+            mov->expected_duration = FFMAX(mov->expected_duration,
+                                           av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q));
         avpriv_set_pts_info(st, 64, 1, track->timescale);
 
         if (mov->encryption_scheme == MOV_ENC_CENC_AES_CTR) {
@@ -7662,6 +7750,65 @@ static int mov_init(AVFormatContext *s)
     return 0;
 }
 
+/* Rough atom costs for estimating the moov size of a faststart file */
+#define MOV_RESERVE_HEADER_SIZE 4096 ///< mvhd, iods, udta and meta
+#define MOV_RESERVE_TRACK_SIZE  1024 ///< per-track atoms up to stbl, plus the extradata
+#define MOV_RESERVE_SAMPLE_SIZE   18 ///< stsz, co64 and amortized stsc/stts entries
+#define MOV_RESERVE_VIDEO_SIZE     2 ///< amortized stss/sdtp entries
+#define MOV_RESERVE_CTTS_SIZE      8 ///< ctts entry for reordered video
+
+/*
+ * Estimate the size of the final moov from the stream duration hints, so
+ * that it can be written in place in front of the mdat. Returns 0 if
+ * there is no hint to base the estimate on.
+ */
+static int64_t mov_estimate_moov_size(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int64_t size = MOV_RESERVE_HEADER_SIZE;
+
+    if (mov->expected_duration <= 0)
+        return 0;
+
+    for (int i = 0; i < mov->nb_tracks; i++) {
+        MOVTrack *track = &mov->tracks[i];
+        AVCodecParameters *par = track->par;
+        AVRational rate = { 1, 1 };
+        int64_t nb_samples, sample_size = MOV_RESERVE_SAMPLE_SIZE;
+
+        size += MOV_RESERVE_TRACK_SIZE + (par ? par->extradata_size : 0);
+        if (!track->st || !par)
+            continue;
+
+        switch (par->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            if (track->st->avg_frame_rate.num > 0 && track->st->avg_frame_rate.den > 0)
+                rate = track->st->avg_frame_rate;
+            else if (track->st->r_frame_rate.num > 0 && track->st->r_frame_rate.den > 0)
+                rate = track->st->r_frame_rate;
+            else
+                rate = (AVRational){ 60, 1 };
+            sample_size += MOV_RESERVE_VIDEO_SIZE;
+            if (par->video_delay)
+                sample_size += MOV_RESERVE_CTTS_SIZE;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (par->sample_rate > 0)
+                rate = (AVRational){ par->sample_rate, par->frame_size > 0 ? par->frame_size : 1024 };
+            break;
+        }
+        nb_samples = av_rescale_q_rnd(mov->expected_duration, AV_TIME_BASE_Q, av_inv_q(rate),
+                                      AV_ROUND_UP);
+        if (nb_samples > (INT64_MAX - size) / sample_size)
+            return 0;
+        size += nb_samples * sample_size;
+    }
+
+    /* leave some headroom for variable frame rates and durations */
+    size += size / 8;
+    return size > INT32_MAX ? 0 : size;
+}
+
 static int mov_write_header(AVFormatContext *s)
 {
     AVIOContext *pb = s->pb;
@@ -7756,8 +7903,21 @@ static int mov_write_header(AVFormatContext *s)
             !mov->max_fragment_duration && !mov->max_fragment_size)
             mov->flags |= FF_MOV_FLAG_FRAG_KEYFRAME;
     } else if (mov->mode != MODE_AVIF) {
-        if (mov->flags & FF_MOV_FLAG_FASTSTART)
+        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             mov->reserved_header_pos = avio_tell(pb);
+            if (mov->faststart_reserve && !(mov->flags & FF_MOV_FLAG_RTP_HINT) &&
+                (pb->seekable & AVIO_SEEKABLE_NORMAL))
+                mov->faststart_reserved = mov_estimate_moov_size(s);
+            if (mov->faststart_reserved) {
+                av_log(s, AV_LOG_VERBOSE, "Reserving %"PRId64" bytes for the moov atom\n",
+                       mov->faststart_reserved);
+                avio_wb32(pb, mov->faststart_reserved);
+                ffio_wfourcc(pb, "free");
+                ffio_fill(pb, 0, mov->faststart_reserved - 8);
+            } else if (mov->faststart_reserve) {
+                av_log(s, AV_LOG_WARNING, "No stream duration known, cannot reserve space for the moov atom\n");
+            }
+        }
         mov_write_mdat_tag(pb, mov);
     }
 
@@ -7976,6 +8136,28 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
+        if (mov->faststart_reserved) {
+            int moov_size = get_moov_size(s);
+            if (moov_size < 0)
+                return moov_size;
+            if (moov_size == mov->faststart_reserved ||
+                moov_size <= mov->faststart_reserved - 8) {
+                av_log(s, AV_LOG_INFO, "Reserved moov space used: %d of %"PRId64" bytes, no second pass needed\n",
+                       moov_size, mov->faststart_reserved);
+                avio_seek(pb, mov->reserved_header_pos, SEEK_SET);
+                if ((res = mov_write_moov_tag(pb, mov, s)) < 0)
+                    return res;
+                if (moov_size < mov->faststart_reserved) {
+                    avio_wb32(pb, mov->faststart_reserved - moov_size);
+                    ffio_wfourcc(pb, "free");
+                }
+                avio_seek(pb, moov_pos, SEEK_SET);
+                return 0;
+            }
+            /* the reserved free atom simply stays behind the moov */
+            av_log(s, AV_LOG_INFO, "Reserved moov space exceeded: %d of %"PRId64" bytes, falling back to a second pass\n",
+                   moov_size, mov->faststart_reserved);
+        }
         if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
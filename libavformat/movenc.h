@@ -83,6 +83,12 @@ typedef struct MOVFragmentInfo {
     int size;
 } MOVFragmentInfo;
 
+typedef struct MOVMdatSlice {
+    AVBufferRef   *buf;
+    const uint8_t *data;
+    int            size;
+} MOVMdatSlice;
+
 typedef struct MOVTrack {
     int         mode;
     int         entry;
@@ -140,6 +146,10 @@ typedef struct MOVTrack {
     AVPacket *cover_image;
 
     AVIOContext *mdat_buf;
+    MOVMdatSlice *mdat_slices;      ///< fragment data preceding mdat_buf, referenced instead of copied
+    int         nb_mdat_slices;
+    unsigned    mdat_slices_capacity;
+    int64_t     mdat_slices_size;
     int64_t     data_offset;
     int         frag_discont;
     int         entries_flushed;
@@ -221,6 +231,9 @@ typedef struct MOVMuxContext {
 
     int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
     int64_t reserved_header_pos;
+    int faststart_reserve;
+    int64_t faststart_reserved; ///< size of the free atom reserved for the moov, 0 if none
+    int64_t expected_duration;  ///< longest stream duration hint, in AV_TIME_BASE units
 
     char *major_brand;
 
@@ -2871,8 +2871,10 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
         }
 
         // stop find_stream_info from waiting for more streams
-        // when all programs have received a PMT
-        if (ts->stream->ctx_flags & AVFMTCTX_NOHEADER && ts->scan_all_pmts <= 0) {
+        // when all programs have received a PMT, also when scanning all
+        // PMTs if the caller asked for fast probing
+        if (ts->stream->ctx_flags & AVFMTCTX_NOHEADER &&
+            (ts->scan_all_pmts <= 0 || ts->stream->flags & AVFMT_FLAG_FAST_PROBE)) {
             int i;
             for (i = 0; i < ts->nb_prg; i++) {
                 if (!ts->prg[i].pmt_found)
@@ -2888,6 +2890,16 @@ static int handle_packet(MpegTSContext *ts, const uint8_t *packet, int64_t pos)
         int ret;
         // Note: The position here points actually behind the current packet.
         if (tss->type == MPEGTS_PES) {
+            PESContext *pes = tss->u.pes_filter.opaque;
+            /* nobody wants this stream, so do not even assemble its PES */
+            if (pes->st && pes->st->discard == AVDISCARD_ALL &&
+                (!pes->sub_st || pes->sub_st->discard == AVDISCARD_ALL)) {
+                if (pes->state != MPEGTS_SKIP) {
+                    reset_pes_packet_state(pes);
+                    pes->state = MPEGTS_SKIP;
+                }
+                return 0;
+            }
             if ((ret = tss->u.pes_filter.pes_cb(tss, p, p_end - p, is_start,
                                                 pos - ts->raw_packet_size)) < 0)
                 return ret;
@@ -2973,12 +2985,27 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Count the packets at the start of the I/O buffer that carry a sync byte,
+ * so that they can be handled in place without going through read_packet().
+ */
+static int count_buffered_packets(AVIOContext *pb, int raw_packet_size)
+{
+    const uint8_t *p = pb->buf_ptr;
+    int i, nb = (pb->buf_end - pb->buf_ptr) / raw_packet_size;
+
+    for (i = 0; i < nb && p[0] == 0x47; i++)
+        p += raw_packet_size;
+    return i;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
     uint8_t packet[TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
     const uint8_t *data;
     int64_t packet_num;
+    int nb_buffered = 0;
     int ret = 0;
 
     if (avio_tell(s->pb) != ts->last_pos) {
@@ -3014,6 +3041,19 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        if (!nb_buffered && !s->pb->write_flag)
+            nb_buffered = count_buffered_packets(s->pb, ts->raw_packet_size);
+        if (nb_buffered) {
+            /* same as read_packet() and finished_reading_packet() */
+            data = s->pb->buf_ptr;
+            s->pb->buf_ptr += ts->raw_packet_size;
+            nb_buffered--;
+            ret = handle_packet(ts, data, avio_tell(s->pb) - ts->raw_packet_size + TS_PACKET_SIZE);
+            if (ret != 0)
+                break;
+            continue;
+        }
+
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -92,6 +92,7 @@ typedef struct MpegTSWrite {
     int64_t first_pcr;
     int first_dts_checked;
     int64_t next_pcr;
+    int in_lookahead;
     int mux_rate; ///< set to 1 when VBR
     int pes_payload_size;
     int64_t total_size;
@@ -117,6 +118,7 @@ typedef struct MpegTSWrite {
 #define MPEGTS_FLAG_DISCONT         0x10
 #define MPEGTS_FLAG_NIT             0x20
 #define MPEGTS_FLAG_OMIT_RAI        0x40
+#define MPEGTS_FLAG_CBR_LOOKAHEAD   0x80
     int flags;
     int copyts;
     int tables_version;
@@ -253,6 +255,7 @@ typedef struct MpegTSWriteStream {
     int64_t payload_pts;
     int64_t payload_dts;
     int payload_flags;
+    int payload_stream_id;
     uint8_t *payload;
     AVFormatContext *amux;
     int data_st_warning;
@@ -260,6 +263,13 @@ typedef struct MpegTSWriteStream {
     int64_t pcr_period; /* PCR period in PCR time base */
     int64_t last_pcr;
 
+    /* PCR interval statistics, in PCR time base */
+    int64_t pcr_written;
+    int64_t pcr_count;
+    int64_t pcr_interval_min;
+    int64_t pcr_interval_max;
+    int64_t pcr_late;
+
     /* For Opus */
     int opus_queued_samples;
     int opus_pending_trim_start;
@@ -965,6 +975,22 @@ static int64_t get_pcr(const MpegTSWrite *ts)
            ts->first_pcr;
 }
 
+static void update_pcr_stats(const MpegTSWrite *ts, MpegTSWriteStream *ts_st, int64_t pcr)
+{
+    if (ts_st->pcr_count++) {
+        int64_t interval = pcr - ts_st->pcr_written;
+        /* in CBR mode a PCR can only be placed with packet granularity */
+        int64_t slack = ts->mux_rate > 1 ? av_rescale(TS_PACKET_SIZE, 8 * PCR_TIME_BASE, ts->mux_rate) : 0;
+        if (ts_st->pcr_count == 2 || interval < ts_st->pcr_interval_min)
+            ts_st->pcr_interval_min = interval;
+        if (interval > ts_st->pcr_interval_max)
+            ts_st->pcr_interval_max = interval;
+        if (ts_st->pcr_period && interval > ts_st->pcr_period + slack)
+            ts_st->pcr_late++;
+    }
+    ts_st->pcr_written = pcr;
+}
+
 static void write_packet(AVFormatContext *s, const uint8_t *packet)
 {
     MpegTSWrite *ts = s->priv_data;
@@ -1389,6 +1415,7 @@ static void mpegts_insert_pcr_only(AVFormatContext *s, AVStream *st)
     }
 
     /* PCR coded into 6 bytes */
+    update_pcr_stats(ts, ts_st, get_pcr(ts));
     q += write_pcr_bits(q, get_pcr(ts));
 
     /* stuffing bytes */
@@ -1474,6 +1501,47 @@ static int get_pes_stream_id(AVFormatContext *s, AVStream *st, int stream_id, in
     }
 }
 
+static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
+                             const uint8_t *payload, int payload_size,
+                             int64_t pts, int64_t dts, int key, int stream_id);
+
+/* Use the slots the current stream would fill with null packets for
+ * queued audio payloads of other streams that are already due. */
+static int write_due_payload(AVFormatContext *s, AVStream *cur, int64_t pcr)
+{
+    MpegTSWrite *ts = s->priv_data;
+    int64_t delay = av_rescale(s->max_delay, 90000, AV_TIME_BASE);
+    MpegTSWriteStream *ts_st, *due = NULL;
+    AVStream *due_st = NULL;
+
+    if (ts->in_lookahead)
+        return 0;
+
+    for (int i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        ts_st = st->priv_data;
+        if (st == cur || st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO ||
+            !ts_st->payload_size || ts_st->payload_dts == AV_NOPTS_VALUE ||
+            ts_st->payload_dts - pcr / 300 > delay)
+            continue;
+        if (!due || ts_st->payload_dts < due->payload_dts) {
+            due    = ts_st;
+            due_st = st;
+        }
+    }
+    if (!due)
+        return 0;
+
+    ts->in_lookahead = 1;
+    mpegts_write_pes(s, due_st, due->payload, due->payload_size,
+                     due->payload_pts, due->payload_dts,
+                     due->payload_flags & AV_PKT_FLAG_KEY, due->payload_stream_id);
+    ts->in_lookahead = 0;
+    due->payload_size = 0;
+    due->opus_queued_samples = 0;
+    return 1;
+}
+
 /* Add a PES header to the front of the payload, and segment into an integer
  * number of TS packets. The final TS packet is padded using an oversized
  * adaptation header to exactly fill the last TS packet.
@@ -1551,7 +1619,8 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
                 /* pcr insert gets priority over null packet insert */
                 if (write_pcr)
                     mpegts_insert_pcr_only(s, st);
-                else
+                else if (!(ts->flags & MPEGTS_FLAG_CBR_LOOKAHEAD) ||
+                         !write_due_payload(s, st, pcr))
                     mpegts_insert_null_packet(s);
                 /* recalculate write_pcr and possibly retransmit si_info */
                 continue;
@@ -1595,6 +1664,7 @@ static void mpegts_write_pes(AVFormatContext *s, AVStream *st,
             // add 11, pcr references the last byte of program clock reference base
             if (dts != AV_NOPTS_VALUE && dts < pcr / 300)
                 av_log(s, AV_LOG_WARNING, "dts < pcr, TS is invalid\n");
+            update_pcr_stats(ts, ts_st, pcr);
             extend_af(buf, write_pcr_bits(q, pcr));
             q = get_ts_payload_start(buf);
         }
@@ -2219,6 +2289,7 @@ static int mpegts_write_packet_internal(AVFormatContext *s, AVPacket *pkt)
         ts_st->payload_pts   = pts;
         ts_st->payload_dts   = dts;
         ts_st->payload_flags = pkt->flags;
+        ts_st->payload_stream_id = stream_id;
     }
 
     memcpy(ts_st->payload + ts_st->payload_size, buf, size);
@@ -2270,6 +2341,18 @@ static int mpegts_write_end(AVFormatContext *s)
     if (s->pb)
         mpegts_write_flush(s);
 
+    for (int i = 0; i < s->nb_streams; i++) {
+        MpegTSWriteStream *ts_st = s->streams[i]->priv_data;
+        if (ts_st->pcr_count < 2)
+            continue;
+        av_log(s, ts_st->pcr_interval_max > PCR_TIME_BASE / 10 ? AV_LOG_WARNING : AV_LOG_VERBOSE,
+               "pid=%i: %"PRId64" PCRs, interval %.3f-%.3f ms, %"PRId64" longer than %.3f ms\n",
+               ts_st->pid, ts_st->pcr_count,
+               ts_st->pcr_interval_min * 1000.0 / PCR_TIME_BASE,
+               ts_st->pcr_interval_max * 1000.0 / PCR_TIME_BASE,
+               ts_st->pcr_late, ts_st->pcr_period * 1000.0 / PCR_TIME_BASE);
+    }
+
     return 0;
 }
 
@@ -2375,6 +2458,8 @@ static const AVOption options[] = {
       0, AV_OPT_TYPE_CONST, { .i64 = MPEGTS_FLAG_NIT}, 0, INT_MAX, ENC, .unit = "mpegts_flags" },
     { "omit_rai", "Disable writing of random access indicator",
       0, AV_OPT_TYPE_CONST, { .i64 = MPEGTS_FLAG_OMIT_RAI }, 0, INT_MAX, ENC, .unit = "mpegts_flags" },
+    { "cbr_lookahead", "Fill stuffing slots with due payloads of other streams in CBR mode",
+      0, AV_OPT_TYPE_CONST, { .i64 = MPEGTS_FLAG_CBR_LOOKAHEAD }, 0, INT_MAX, ENC, .unit = "mpegts_flags" },
     { "mpegts_copyts", "don't offset dts/pts", OFFSET(copyts), AV_OPT_TYPE_BOOL, { .i64 = -1 }, -1, 1, ENC },
     { "tables_version", "set PAT, PMT, SDT and NIT version", OFFSET(tables_version), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 31, ENC },
     { "omit_video_pes_length", "Omit the PES packet length for video packets",
@@ -157,6 +157,11 @@ static int io_close2_default(AVFormatContext *s, AVIOContext *pb)
     return avio_close(pb);
 }
 
+int ff_format_io_is_default(const AVFormatContext *s)
+{
+    return s->io_open == io_open_default && s->io_close2 == io_close2_default;
+}
+
 AVFormatContext *avformat_alloc_context(void)
 {
     FFFormatContext *const si = av_mallocz(sizeof(*si));
@@ -308,11 +308,79 @@ int ff_rtmp_packet_read_internal(URLContext *h, RTMPPacket *p, int chunk_size,
     }
 }
 
+/**
+ * Size of the on-stack buffer small pieces of an outgoing message are
+ * gathered in, so that headers and short chunks go out in one write.
+ */
+#define RTMP_WRITE_BUFFER_SIZE 4096
+
+typedef struct RTMPWriteBuffer {
+    URLContext *h;
+    int len;
+    uint8_t data[RTMP_WRITE_BUFFER_SIZE];
+} RTMPWriteBuffer;
+
+static int rtmp_write_flush(RTMPWriteBuffer *wb)
+{
+    int ret = 0;
+
+    if (wb->len)
+        ret = ffurl_write(wb->h, wb->data, wb->len);
+    wb->len = 0;
+    return ret < 0 ? ret : 0;
+}
+
+/**
+ * Queue one piece of a message. Pieces that fit are gathered in the buffer,
+ * larger ones top it up and the rest is written straight from the source.
+ */
+static int rtmp_write_append(RTMPWriteBuffer *wb, const uint8_t *buf, int size)
+{
+    int ret, copy;
+
+    if (wb->len + size <= sizeof(wb->data)) {
+        memcpy(wb->data + wb->len, buf, size);
+        wb->len += size;
+        return 0;
+    }
+
+    copy = sizeof(wb->data) - wb->len;
+    memcpy(wb->data + wb->len, buf, copy);
+    wb->len += copy;
+    if ((ret = rtmp_write_flush(wb)) < 0)
+        return ret;
+    buf  += copy;
+    size -= copy;
+
+    if (size < sizeof(wb->data)) {
+        memcpy(wb->data, buf, size);
+        wb->len = size;
+        return 0;
+    }
+    ret = ffurl_write(wb->h, buf, size);
+    return ret < 0 ? ret : 0;
+}
+
+static void rtmp_put_basic_header(uint8_t **p, int channel_id, int mode)
+{
+    if (channel_id < 64) {
+        bytestream_put_byte(p, channel_id | (mode << 6));
+    } else if (channel_id < 64 + 256) {
+        bytestream_put_byte(p, 0          | (mode << 6));
+        bytestream_put_byte(p, channel_id - 64);
+    } else {
+        bytestream_put_byte(p, 1          | (mode << 6));
+        bytestream_put_le16(p, channel_id - 64);
+    }
+}
+
 int ff_rtmp_packet_write(URLContext *h, RTMPPacket *pkt,
                          int chunk_size, RTMPPacket **prev_pkt_ptr,
                          int *nb_prev_pkt)
 {
     uint8_t pkt_hdr[16], *p = pkt_hdr;
+    uint8_t cont_hdr[7], *q = cont_hdr;
+    RTMPWriteBuffer wb;
     int mode = RTMP_PS_TWELVEBYTES;
     int off = 0;
     int written = 0;
@@ -352,15 +420,7 @@ int ff_rtmp_packet_write(URLContext *h, RTMPPacket *pkt,
         }
     }
 
-    if (pkt->channel_id < 64) {
-        bytestream_put_byte(&p, pkt->channel_id | (mode << 6));
-    } else if (pkt->channel_id < 64 + 256) {
-        bytestream_put_byte(&p, 0               | (mode << 6));
-        bytestream_put_byte(&p, pkt->channel_id - 64);
-    } else {
-        bytestream_put_byte(&p, 1               | (mode << 6));
-        bytestream_put_le16(&p, pkt->channel_id - 64);
-    }
+    rtmp_put_basic_header(&p, pkt->channel_id, mode);
     if (mode != RTMP_PS_ONEBYTE) {
         bytestream_put_be24(&p, pkt->ts_field);
         if (mode != RTMP_PS_FOURBYTES) {
@@ -380,34 +440,32 @@ int ff_rtmp_packet_write(URLContext *h, RTMPPacket *pkt,
     prev_pkt[pkt->channel_id].ts_field   = pkt->ts_field;
     prev_pkt[pkt->channel_id].extra      = pkt->extra;
 
-    // FIXME:
-    // Writing packets is currently not optimized to minimize system calls.
-    // Since system calls flush on exit which we cannot change in a system-independant way.
-    // We should fix this behavior and by writing packets in a single or in as few as possible system calls.
-    // Protocols like TCP and RTMP should benefit from this when enabling TCP_NODELAY.
+    // The header of the continuation chunks is the same for the whole
+    // message, so build it once.
+    rtmp_put_basic_header(&q, pkt->channel_id, RTMP_PS_ONEBYTE);
+    if (pkt->ts_field == 0xFFFFFF)
+        bytestream_put_be32(&q, timestamp);
 
-    if ((ret = ffurl_write(h, pkt_hdr, p - pkt_hdr)) < 0)
+    // Gather the headers and small chunks into as few writes as possible;
+    // chunks larger than the buffer are written directly from the payload.
+    wb.h   = h;
+    wb.len = 0;
+    if ((ret = rtmp_write_append(&wb, pkt_hdr, p - pkt_hdr)) < 0)
         return ret;
     written = p - pkt_hdr + pkt->size;
     while (off < pkt->size) {
         int towrite = FFMIN(chunk_size, pkt->size - off);
-        if ((ret = ffurl_write(h, pkt->data + off, towrite)) < 0)
+        if ((ret = rtmp_write_append(&wb, pkt->data + off, towrite)) < 0)
             return ret;
         off += towrite;
         if (off < pkt->size) {
-            uint8_t marker = 0xC0 | pkt->channel_id;
-            if ((ret = ffurl_write(h, &marker, 1)) < 0)
+            if ((ret = rtmp_write_append(&wb, cont_hdr, q - cont_hdr)) < 0)
                 return ret;
-            written++;
-            if (pkt->ts_field == 0xFFFFFF) {
-                uint8_t ts_header[4];
-                AV_WB32(ts_header, timestamp);
-                if ((ret = ffurl_write(h, ts_header, 4)) < 0)
-                    return ret;
-                written += 4;
-            }
+            written += q - cont_hdr;
         }
     }
+    if ((ret = rtmp_write_flush(&wb)) < 0)
+        return ret;
     return written;
 }
 
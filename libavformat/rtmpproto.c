@@ -3059,19 +3059,43 @@ static int rtmp_write(URLContext *s, const uint8_t *buf, int size)
                 rt->prev_pkt[1][channel].channel_id = 0;
             }
 
-            //this can be a big packet, it's better to send it right here
+            // the payload is only buffered if it is not contiguous in buf
             if ((ret = ff_rtmp_packet_create(&rt->out_pkt, channel,
-                                             pkttype, ts, pktsize)) < 0)
+                                             pkttype, ts, 0)) < 0)
                 return ret;
 
             rt->out_pkt.extra = rt->stream_id;
-            rt->flv_data = rt->out_pkt.data;
+            rt->flv_data = NULL;
         }
 
-        copy = FFMIN(rt->flv_size - rt->flv_off, size_temp);
-        bytestream_get_buffer(&buf_temp, rt->flv_data + rt->flv_off, copy);
-        rt->flv_off += copy;
-        size_temp   -= copy;
+        if (!rt->flv_data && size_temp >= rt->flv_size &&
+            rt->out_pkt.type != RTMP_PT_NOTIFY) {
+            // The whole tag is in the caller's buffer, chunk it from there
+            // instead of copying it into out_pkt first.
+            rt->out_pkt.data = (uint8_t *)buf_temp;
+            rt->out_pkt.size = rt->flv_size;
+            ret = ff_rtmp_packet_write(rt->stream, &rt->out_pkt, rt->out_chunk_size,
+                                       &rt->prev_pkt[1], &rt->nb_prev_pkt[1]);
+            rt->out_pkt.data = NULL;
+            rt->out_pkt.size = 0;
+            if (ret < 0)
+                return ret;
+            buf_temp    += rt->flv_size;
+            size_temp   -= rt->flv_size;
+            rt->flv_off  = rt->flv_size;
+        } else {
+            if (!rt->flv_data) {
+                if ((ret = av_reallocp(&rt->out_pkt.data, rt->flv_size)) < 0)
+                    return ret;
+                rt->out_pkt.size = rt->flv_size;
+                rt->flv_data     = rt->out_pkt.data;
+            }
+
+            copy = FFMIN(rt->flv_size - rt->flv_off, size_temp);
+            bytestream_get_buffer(&buf_temp, rt->flv_data + rt->flv_off, copy);
+            rt->flv_off += copy;
+            size_temp   -= copy;
+        }
 
         if (rt->flv_off == rt->flv_size) {
             rt->skip_bytes = 4;
@@ -3103,7 +3127,9 @@ static int rtmp_write(URLContext *s, const uint8_t *buf, int size)
                 }
             }
 
-            if ((ret = rtmp_send_packet(rt, &rt->out_pkt, 0)) < 0)
+            // unless it was already sent from the caller's buffer
+            if (rt->flv_data &&
+                (ret = rtmp_send_packet(rt, &rt->out_pkt, 0)) < 0)
                 return ret;
             rt->flv_size = 0;
             rt->flv_off = 0;
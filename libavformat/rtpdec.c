@@ -36,6 +36,11 @@
 
 #define MIN_FEEDBACK_INTERVAL 200000 /* 200 ms in us */
 
+#define RTP_QUEUE_MIN_SLOTS       64
+#define RTP_QUEUE_MAX_SIZE        (1 << 15)
+#define RTP_JITTER_MIN_DEPTH      8
+#define RTP_JITTER_ADAPT_INTERVAL 256
+
 static const RTPDynamicProtocolHandler l24_dynamic_handler = {
     .enc_name   = "L24",
     .codec_type = AVMEDIA_TYPE_AUDIO,
@@ -440,23 +445,18 @@ static int find_missing_packets(RTPDemuxContext *s, uint16_t *first_missing,
 {
     int i;
     uint16_t next_seq = s->seq + 1;
-    RTPPacket *pkt = s->queue;
 
-    if (!pkt || pkt->seq == next_seq)
+    if (!s->queue_len || s->queue_first == next_seq)
         return 0;
 
     *missing_mask = 0;
     for (i = 1; i <= 16; i++) {
         uint16_t missing_seq = next_seq + i;
-        while (pkt) {
-            int16_t diff = pkt->seq - missing_seq;
-            if (diff >= 0)
-                break;
-            pkt = pkt->next;
-        }
-        if (!pkt)
+        const RTPPacket *pkt = &s->queue[missing_seq & s->queue_mask];
+        int16_t diff = s->highest_seq - missing_seq;
+        if (diff < 0)
             break;
-        if (pkt->seq == missing_seq)
+        if (pkt->buf && pkt->seq == missing_seq)
             continue;
         *missing_mask |= 1 << (i - 1);
     }
@@ -584,11 +584,25 @@ RTPDemuxContext *ff_rtp_parse_open(AVFormatContext *s1, AVStream *st,
     s->first_rtcp_ntp_time = AV_NOPTS_VALUE;
     s->ic                  = s1;
     s->st                  = st;
-    s->queue_size          = queue_size;
+    s->queue_size          = FFMIN(queue_size, RTP_QUEUE_MAX_SIZE);
+    s->queue_depth         = s->queue_size;
 
     av_log(s->ic, AV_LOG_VERBOSE, "setting jitter buffer size to %d\n",
            s->queue_size);
 
+    if (s->queue_size > 1) {
+        /* The ring covers twice the maximum depth in sequence numbers, so
+         * that gaps left by lost packets don't make the slots collide. */
+        unsigned slots = FFMAX(1U << av_ceil_log2(2 * s->queue_size),
+                               RTP_QUEUE_MIN_SLOTS);
+        s->queue = av_calloc(slots, sizeof(*s->queue));
+        if (!s->queue) {
+            av_free(s);
+            return NULL;
+        }
+        s->queue_mask = slots - 1;
+    }
+
     rtp_init_statistics(&s->statistics, 0);
     if (st) {
         switch (st->codecpar->codec_id) {
@@ -604,6 +618,7 @@ RTPDemuxContext *ff_rtp_parse_open(AVFormatContext *s1, AVStream *st,
                 av_log(s1, AV_LOG_ERROR,
                        "Error creating opus extradata: %s\n",
                        av_err2str(ret));
+                av_free(s->queue);
                 av_free(s);
                 return NULL;
             }
@@ -777,41 +792,44 @@ static int rtp_parse_packet_internal(RTPDemuxContext *s, AVPacket *pkt,
     return rv;
 }
 
-void ff_rtp_reset_packet_queue(RTPDemuxContext *s)
+static void flush_packet_queue(RTPDemuxContext *s)
 {
-    while (s->queue) {
-        RTPPacket *next = s->queue->next;
-        av_freep(&s->queue->buf);
-        av_freep(&s->queue);
-        s->queue = next;
+    for (unsigned i = 0; s->queue_len && i <= s->queue_mask; i++) {
+        if (s->queue[i].buf) {
+            av_buffer_unref(&s->queue[i].buf);
+            s->queue_len--;
+        }
     }
-    s->seq       = 0;
     s->queue_len = 0;
-    s->prev_ret  = 0;
 }
 
-static int enqueue_packet(RTPDemuxContext *s, uint8_t *buf, int len)
+void ff_rtp_reset_packet_queue(RTPDemuxContext *s)
 {
-    uint16_t seq   = AV_RB16(buf + 2);
-    RTPPacket **cur = &s->queue, *packet;
+    flush_packet_queue(s);
+    s->seq       = 0;
+    s->prev_ret  = 0;
+}
 
-    /* Find the correct place in the queue to insert the packet */
-    while (*cur) {
-        int16_t diff = seq - (*cur)->seq;
-        if (diff < 0)
-            break;
-        cur = &(*cur)->next;
+static int enqueue_packet(RTPDemuxContext *s, AVBufferRef **bufptr, int len)
+{
+    uint16_t seq   = AV_RB16((*bufptr)->data + 2);
+    RTPPacket *packet = &s->queue[seq & s->queue_mask];
+
+    /* Everything queued lies within queue_mask sequence numbers after
+     * s->seq, so an occupied slot can only hold this very packet. */
+    if (packet->buf) {
+        s->jitter_stats.duplicate++;
+        return AVERROR(EAGAIN);
     }
 
-    packet = av_mallocz(sizeof(*packet));
-    if (!packet)
-        return AVERROR(ENOMEM);
     packet->recvtime = av_gettime_relative();
     packet->seq      = seq;
     packet->len      = len;
-    packet->buf      = buf;
-    packet->next     = *cur;
-    *cur = packet;
+    packet->buf      = *bufptr;
+    *bufptr          = NULL;
+
+    if (!s->queue_len || (int16_t)(seq - s->queue_first) < 0)
+        s->queue_first = seq;
     s->queue_len++;
 
     return 0;
@@ -819,45 +837,76 @@ static int enqueue_packet(RTPDemuxContext *s, uint8_t *buf, int len)
 
 static int has_next_packet(RTPDemuxContext *s)
 {
-    return s->queue && s->queue->seq == (uint16_t) (s->seq + 1);
+    return s->queue_len > 0 && s->queue_first == (uint16_t) (s->seq + 1);
 }
 
 int64_t ff_rtp_queued_packet_time(RTPDemuxContext *s)
 {
-    return s->queue ? s->queue->recvtime : 0;
+    return s->queue_len > 0 ? s->queue[s->queue_first & s->queue_mask].recvtime : 0;
 }
 
 static int rtp_parse_queued_packet(RTPDemuxContext *s, AVPacket *pkt)
 {
     int rv;
-    RTPPacket *next;
+    RTPPacket *packet;
 
     if (s->queue_len <= 0)
         return -1;
 
+    packet = &s->queue[s->queue_first & s->queue_mask];
     if (!has_next_packet(s)) {
-        int pkt_missed  = s->queue->seq - s->seq - 1;
+        int pkt_missed = (uint16_t)(packet->seq - s->seq - 1);
 
-        if (pkt_missed < 0)
-            pkt_missed += UINT16_MAX;
+        s->jitter_stats.lost += pkt_missed;
         av_log(s->ic, AV_LOG_WARNING,
                "RTP: missed %d packets\n", pkt_missed);
     }
 
     /* Parse the first packet in the queue, and dequeue it */
-    rv   = rtp_parse_packet_internal(s, pkt, s->queue->buf, s->queue->len);
-    next = s->queue->next;
-    av_freep(&s->queue->buf);
-    av_freep(&s->queue);
-    s->queue = next;
-    s->queue_len--;
+    rv = rtp_parse_packet_internal(s, pkt, packet->buf->data, packet->len);
+    av_buffer_unref(&packet->buf);
+    if (--s->queue_len > 0) {
+        do {
+            s->queue_first++;
+        } while (!s->queue[s->queue_first & s->queue_mask].buf);
+    }
     return rv;
 }
 
+/**
+ * Track how far packets arrive out of order and adapt the depth of the
+ * reordering queue to it: grow at once when a packet shows up further
+ * behind than the queue would have waited for, and shrink back towards
+ * twice the recently observed distance otherwise.
+ */
+static void update_queue_depth(RTPDemuxContext *s, uint16_t seq)
+{
+    int16_t distance = s->highest_seq - seq;
+
+    if (distance > 0 && distance <= s->queue_mask) {
+        s->jitter_stats.reordered++;
+        s->jitter_stats.max_reorder = FFMAX(s->jitter_stats.max_reorder, distance);
+        s->reorder_peak = FFMAX(s->reorder_peak, distance);
+        if (2 * distance > s->queue_depth)
+            s->queue_depth = FFMIN(2 * distance, s->queue_size);
+    } else {
+        s->highest_seq = seq;
+    }
+
+    if (++s->adapt_count >= RTP_JITTER_ADAPT_INTERVAL) {
+        int target = av_clip(2 * s->reorder_peak, RTP_JITTER_MIN_DEPTH,
+                             s->queue_size);
+        s->queue_depth  = s->queue_depth > target ?
+                          (s->queue_depth + target) / 2 : target;
+        s->reorder_peak = 0;
+        s->adapt_count  = 0;
+    }
+}
+
 static int rtp_parse_one_packet(RTPDemuxContext *s, AVPacket *pkt,
-                                uint8_t **bufptr, int len)
+                                AVBufferRef **bufptr, int len)
 {
-    uint8_t *buf = bufptr ? *bufptr : NULL;
+    uint8_t *buf = bufptr && *bufptr ? (*bufptr)->data : NULL;
     int flags = 0;
     uint32_t timestamp;
     int rv = 0;
@@ -900,14 +949,21 @@ static int rtp_parse_one_packet(RTPDemuxContext *s, AVPacket *pkt,
         rtcp_update_jitter(&s->statistics, timestamp, arrival_ts);
     }
 
-    if ((s->seq == 0 && !s->queue) || s->queue_size <= 1) {
-        /* First packet, or no reordering */
+    if (s->queue_size <= 1) {
+        /* No reordering */
+        return rtp_parse_packet_internal(s, pkt, buf, len);
+    } else if (s->seq == 0 && !s->queue_len) {
+        /* First packet */
+        s->highest_seq = AV_RB16(buf + 2);
         return rtp_parse_packet_internal(s, pkt, buf, len);
     } else {
         uint16_t seq = AV_RB16(buf + 2);
         int16_t diff = seq - s->seq;
+
+        update_queue_depth(s, seq);
         if (diff < 0) {
             /* Packet older than the previously emitted one, drop */
+            s->jitter_stats.late++;
             av_log(s->ic, AV_LOG_WARNING,
                    "RTP: dropping old packet received too late\n");
             return -1;
@@ -915,15 +971,25 @@ static int rtp_parse_one_packet(RTPDemuxContext *s, AVPacket *pkt,
             /* Correct packet */
             rv = rtp_parse_packet_internal(s, pkt, buf, len);
             return rv;
+        } else if (diff > s->queue_mask) {
+            /* Too far ahead to fit in the ring; the sender most likely
+             * restarted, so give up on what is queued and resync. */
+            if (s->queue_len) {
+                av_log(s->ic, AV_LOG_WARNING,
+                       "RTP: sequence number jumped by %d, "
+                       "dropping %d queued packets\n", diff, s->queue_len);
+                s->jitter_stats.lost += s->queue_len;
+                flush_packet_queue(s);
+            }
+            return rtp_parse_packet_internal(s, pkt, buf, len);
         } else {
             /* Still missing some packet, enqueue this one. */
-            rv = enqueue_packet(s, buf, len);
+            rv = enqueue_packet(s, bufptr, len);
             if (rv < 0)
-                return rv;
-            *bufptr = NULL;
+                return rv == AVERROR(EAGAIN) ? -1 : rv;
             /* Return the first enqueued packet if the queue is full,
              * even if we're missing something */
-            if (s->queue_len >= s->queue_size) {
+            if (s->queue_len >= s->queue_depth) {
                 av_log(s->ic, AV_LOG_WARNING, "jitter buffer full\n");
                 return rtp_parse_queued_packet(s, pkt);
             }
@@ -942,10 +1008,10 @@ static int rtp_parse_one_packet(RTPDemuxContext *s, AVPacket *pkt,
  * (use buf as NULL to read the next). -1 if no packet (error or no more packet).
  */
 int ff_rtp_parse_packet(RTPDemuxContext *s, AVPacket *pkt,
-                        uint8_t **bufptr, int len)
+                        AVBufferRef **bufptr, int len)
 {
     int rv;
-    if (s->srtp_enabled && bufptr && ff_srtp_decrypt(&s->srtp, *bufptr, &len) < 0)
+    if (s->srtp_enabled && bufptr && ff_srtp_decrypt(&s->srtp, (*bufptr)->data, &len) < 0)
         return -1;
     rv = rtp_parse_one_packet(s, pkt, bufptr, len);
     s->prev_ret = rv;
@@ -956,7 +1022,22 @@ int ff_rtp_parse_packet(RTPDemuxContext *s, AVPacket *pkt,
 
 void ff_rtp_parse_close(RTPDemuxContext *s)
 {
+    if (s->queue) {
+        const RTPJitterStatistics *js = &s->jitter_stats;
+        int64_t jitter = s->statistics.jitter >> 4;
+
+        if (s->st)
+            jitter = av_rescale_q(jitter, s->st->time_base, (AVRational){ 1, 1000 });
+        av_log(s->ic, AV_LOG_VERBOSE,
+               "RTP SSRC %08x: %"PRIu32" received, %"PRIu64" lost, "
+               "%"PRIu64" late, %"PRIu64" duplicate, %"PRIu64" reordered "
+               "(max distance %d), jitter %"PRId64" ms, queue depth %d/%d\n",
+               s->ssrc, s->statistics.received, js->lost, js->late,
+               js->duplicate, js->reordered, js->max_reorder, jitter,
+               s->queue_depth, s->queue_size);
+    }
     ff_rtp_reset_packet_queue(s);
+    av_freep(&s->queue);
     ff_srtp_free(&s->srtp);
     av_free(s);
 }
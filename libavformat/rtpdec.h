@@ -23,6 +23,7 @@
 #ifndef AVFORMAT_RTPDEC_H
 #define AVFORMAT_RTPDEC_H
 
+#include "libavutil/buffer.h"
 #include "libavcodec/codec_id.h"
 #include "libavcodec/packet.h"
 #include "avformat.h"
@@ -48,7 +49,7 @@ void ff_rtp_parse_set_dynamic_protocol(RTPDemuxContext *s, PayloadContext *ctx,
 void ff_rtp_parse_set_crypto(RTPDemuxContext *s, const char *suite,
                              const char *params);
 int ff_rtp_parse_packet(RTPDemuxContext *s, AVPacket *pkt,
-                        uint8_t **buf, int len);
+                        AVBufferRef **buf, int len);
 void ff_rtp_parse_close(RTPDemuxContext *s);
 int64_t ff_rtp_queued_packet_time(RTPDemuxContext *s);
 void ff_rtp_reset_packet_queue(RTPDemuxContext *s);
@@ -138,13 +139,21 @@ struct RTPDynamicProtocolHandler {
 };
 
 typedef struct RTPPacket {
-    uint16_t seq;
-    uint8_t *buf;
+    AVBufferRef *buf; ///< Receive buffer holding the packet, NULL if the slot is free
     int len;
     int64_t recvtime;
-    struct RTPPacket *next;
+    uint16_t seq;
 } RTPPacket;
 
+/** Jitter buffer statistics, logged when the parse context is closed */
+typedef struct RTPJitterStatistics {
+    uint64_t lost;          ///< packets skipped over when giving up on a gap
+    uint64_t late;          ///< packets dropped because they arrived too late
+    uint64_t duplicate;     ///< packets dropped because they were already queued
+    uint64_t reordered;     ///< packets that arrived after a higher sequence number
+    int max_reorder;        ///< largest reordering distance seen, in packets
+} RTPJitterStatistics;
+
 struct RTPDemuxContext {
     AVFormatContext *ic;
     AVStream *st;
@@ -167,9 +176,16 @@ struct RTPDemuxContext {
 
     /** Fields for packet reordering @{ */
     int prev_ret;     ///< The return value of the actual parsing of the previous packet
-    RTPPacket* queue; ///< A sorted queue of buffered packets not yet returned
+    RTPPacket* queue; ///< Ring of buffered packets not yet returned, indexed by seq & queue_mask
+    unsigned queue_mask; ///< Number of ring slots minus one
     int queue_len;    ///< The number of packets in queue
     int queue_size;   ///< The size of queue, or 0 if reordering is disabled
+    int queue_depth;  ///< Current adaptive depth of the queue, at most queue_size
+    uint16_t queue_first; ///< Lowest sequence number in queue, if queue_len > 0
+    uint16_t highest_seq; ///< Highest sequence number received so far
+    int reorder_peak; ///< Largest reordering distance in the current adaptation interval
+    int adapt_count;  ///< Packets received in the current adaptation interval
+    RTPJitterStatistics jitter_stats;
     /*@}*/
 
     /* rtcp sender statistics receive */
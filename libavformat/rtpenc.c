@@ -19,15 +19,20 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config_components.h"
+
 #include "avformat.h"
+#include "avio_internal.h"
 #include "mpegts.h"
 #include "internal.h"
 #include "mux.h"
+#include "url.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/random_seed.h"
 #include "libavutil/opt.h"
 
 #include "rtpenc.h"
+#include "rtpproto.h"
 
 static const AVOption options[] = {
     FF_RTP_FLAG_OPTS(RTPMuxContext, flags),
@@ -93,6 +98,26 @@ static int is_supported(enum AVCodecID id)
     }
 }
 
+/**
+ * Let a batching udp or rtp protocol queue the RTP packets of a frame.
+ * rtp_flush_batch() sends them at the end of every frame.
+ */
+static void rtp_enable_batch(AVFormatContext *s1)
+{
+    URLContext *h = ffio_geturlcontext(s1->pb);
+
+    if (!h)
+        return;
+#if CONFIG_RTP_PROTOCOL
+    if (!strcmp(h->prot->name, "rtp"))
+        ff_rtp_enable_batched_send(h);
+#endif
+#if CONFIG_UDP_PROTOCOL
+    if (!strcmp(h->prot->name, "udp"))
+        ff_udp_enable_batched_send(h);
+#endif
+}
+
 static int rtp_write_header(AVFormatContext *s1)
 {
     RTPMuxContext *s = s1->priv_data;
@@ -109,6 +134,7 @@ static int rtp_write_header(AVFormatContext *s1)
 
         return -1;
     }
+    rtp_enable_batch(s1);
 
     if (s->payload_type < 0) {
         /* Re-validate non-dynamic payload types */
@@ -517,7 +543,7 @@ static int rtp_send_ilbc(AVFormatContext *s1, const uint8_t *buf, int size)
     return 0;
 }
 
-static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
+static int rtp_send_packet(AVFormatContext *s1, AVPacket *pkt)
 {
     RTPMuxContext *s = s1->priv_data;
     AVStream *st = s1->streams[0];
@@ -647,6 +673,35 @@ static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
     return 0;
 }
 
+/**
+ * Hand the RTP packets of a frame, queued by a batching udp or rtp
+ * protocol, to the kernel at once, so that batching adds no latency.
+ */
+static int rtp_flush_batch(AVFormatContext *s1)
+{
+    URLContext *h = ffio_geturlcontext(s1->pb);
+
+    if (!h)
+        return 0;
+#if CONFIG_RTP_PROTOCOL
+    if (!strcmp(h->prot->name, "rtp"))
+        return ff_rtp_flush(h);
+#endif
+#if CONFIG_UDP_PROTOCOL
+    if (!strcmp(h->prot->name, "udp"))
+        return ff_udp_flush(h);
+#endif
+    return 0;
+}
+
+static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
+{
+    int ret = rtp_send_packet(s1, pkt);
+    int err = rtp_flush_batch(s1);
+
+    return ret < 0 ? ret : err;
+}
+
 static int rtp_write_trailer(AVFormatContext *s1)
 {
     RTPMuxContext *s = s1->priv_data;
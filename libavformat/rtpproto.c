@@ -61,6 +61,8 @@ typedef struct RTPContext {
     char *fec_options_str;
     int64_t rw_timeout;
     char *localaddr;
+    int batch_size;
+    int gso;
 } RTPContext;
 
 #define OFFSET(x) offsetof(RTPContext, x)
@@ -81,6 +83,8 @@ static const AVOption options[] = {
     { "block",              "Block list",                                                       OFFSET(block),           AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "fec",                "FEC",                                                              OFFSET(fec_options_str), AV_OPT_TYPE_STRING, { .str = NULL },               .flags = E },
     { "localaddr",          "Local address",                                                    OFFSET(localaddr),       AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch_size",         "Number of RTP packets to send per system call",                    OFFSET(batch_size),      AV_OPT_TYPE_INT,    { .i64 = 1 },      1, 1024,    .flags = E },
+    { "gso",                "Send batched RTP packets with UDP segmentation offload",           OFFSET(gso),             AV_OPT_TYPE_BOOL,   { .i64 = 0 },      0, 1,       .flags = E },
     { NULL }
 };
 
@@ -212,6 +216,8 @@ static void build_udp_url(RTPContext *s,
  *         'sources=ip[,ip]'  : list allowed source IP addresses
  *         'block=ip[,ip]'    : list disallowed source IP addresses
  *         'write_to_source=0/1' : send packets to the source address of the latest received packet
+ *         'batch_size=n'     : send up to n RTP packets per system call
+ *         'gso=0/1'          : send batched RTP packets with UDP segmentation offload
  *         'dscp=n'           : set DSCP value to n (QoS)
  * deprecated option:
  *         'localport=n'      : set the local port to n
@@ -271,6 +277,12 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "dscp", p)) {
             s->dscp = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "batch_size", p)) {
+            s->batch_size = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "gso", p)) {
+            s->gso = strtol(buf, NULL, 10);
+        }
         if (av_find_info_tag(buf, sizeof(buf), "timeout", p)) {
             s->rw_timeout = strtol(buf, NULL, 10);
         }
@@ -326,6 +338,11 @@ static int rtp_open(URLContext *h, const char *uri, int flags)
         build_udp_url(s, buf, sizeof(buf),
                       hostname, s->localaddr, rtp_port, s->local_rtpport,
                       sources, block);
+        /* Only the media packets are batched, RTCP is sent right away. */
+        if (s->batch_size > 1)
+            url_add_option(buf, sizeof(buf), "batch_size=%d", s->batch_size);
+        if (s->gso)
+            url_add_option(buf, sizeof(buf), "gso=1");
         if (ffurl_open_whitelist(&s->rtp_hd, buf, flags, &h->interrupt_callback,
                                  NULL, h->protocol_whitelist, h->protocol_blacklist, h) < 0)
             goto fail;
@@ -541,6 +558,19 @@ int ff_rtp_get_local_rtp_port(URLContext *h)
     return ff_udp_get_local_port(s->rtp_hd);
 }
 
+void ff_rtp_enable_batched_send(URLContext *h)
+{
+    RTPContext *s = h->priv_data;
+    if (s->rtp_hd)
+        ff_udp_enable_batched_send(s->rtp_hd);
+}
+
+int ff_rtp_flush(URLContext *h)
+{
+    RTPContext *s = h->priv_data;
+    return s->rtp_hd ? ff_udp_flush(s->rtp_hd) : 0;
+}
+
 /**
  * Return the local rtcp port used by the RTP connection
  * @param h media file context
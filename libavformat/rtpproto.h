@@ -27,4 +27,15 @@ int ff_rtp_set_remote_url(URLContext *h, const char *uri);
 
 int ff_rtp_get_local_rtp_port(URLContext *h);
 
+/**
+ * Queue RTP packets for batched sending on a batch_size > 1 connection,
+ * see ff_udp_enable_batched_send().
+ */
+void ff_rtp_enable_batched_send(URLContext *h);
+
+/**
+ * Send the RTP packets queued by a batching (batch_size > 1) connection.
+ */
+int ff_rtp_flush(URLContext *h);
+
 #endif /* AVFORMAT_RTPPROTO_H */
@@ -821,7 +821,9 @@ void ff_rtsp_close_streams(AVFormatContext *s)
     if (CONFIG_RTPDEC && rt->ts)
         avpriv_mpegts_parse_close(rt->ts);
     av_freep(&rt->p);
-    av_freep(&rt->recvbuf);
+    av_buffer_unref(&rt->recvbuf_ref);
+    av_buffer_pool_uninit(&rt->recvbuf_pool);
+    rt->recvbuf = NULL;
 }
 
 int ff_rtsp_open_transport_ctx(AVFormatContext *s, RTSPStream *rtsp_st)
@@ -2256,10 +2258,16 @@ redo:
     }
 
     /* read next RTP packet */
-    if (!rt->recvbuf) {
-        rt->recvbuf = av_malloc(RECVBUF_SIZE);
-        if (!rt->recvbuf)
+    if (!rt->recvbuf_ref) {
+        if (!rt->recvbuf_pool) {
+            rt->recvbuf_pool = av_buffer_pool_init(RECVBUF_SIZE, NULL);
+            if (!rt->recvbuf_pool)
+                return AVERROR(ENOMEM);
+        }
+        rt->recvbuf_ref = av_buffer_pool_get(rt->recvbuf_pool);
+        if (!rt->recvbuf_ref)
             return AVERROR(ENOMEM);
+        rt->recvbuf = rt->recvbuf_ref->data;
     }
 
     len = read_packet(s, &rtsp_st, first_queue_st, wait_end);
@@ -2277,7 +2285,7 @@ redo:
     if (rt->transport == RTSP_TRANSPORT_RDT) {
         ret = ff_rdt_parse_packet(rtsp_st->transport_priv, pkt, &rt->recvbuf, len);
     } else if (rt->transport == RTSP_TRANSPORT_RTP) {
-        ret = ff_rtp_parse_packet(rtsp_st->transport_priv, pkt, &rt->recvbuf, len);
+        ret = ff_rtp_parse_packet(rtsp_st->transport_priv, pkt, &rt->recvbuf_ref, len);
         if (rtsp_st->feedback) {
             AVIOContext *pb = NULL;
             if (rt->lower_transport == RTSP_LOWER_TRANSPORT_CUSTOM)
@@ -345,6 +345,10 @@ typedef struct RTSPState {
 
     /** Reusable buffer for receiving packets */
     uint8_t* recvbuf;
+    /** Reference owning recvbuf, taken over by the RTP reordering queue
+     * when the packet needs to be held back */
+    AVBufferRef *recvbuf_ref;
+    AVBufferPool *recvbuf_pool;
 
     /**
      * A mask with all requested transport methods
@@ -721,6 +721,7 @@ void ff_read_frame_flush(AVFormatContext *s)
 {
     FFFormatContext *const si = ffformatcontext(s);
 
+    ff_parse_workers_flush(s);
     ff_flush_packet_queue(s);
 
     /* Reset read state for each stream. */
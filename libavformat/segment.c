@@ -31,6 +31,7 @@
 #include "avformat.h"
 #include "internal.h"
 #include "mux.h"
+#include "url.h"
 
 #include "libavutil/avassert.h"
 #include "libavutil/internal.h"
@@ -39,6 +40,8 @@
 #include "libavutil/avstring.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/mathematics.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 #include "libavutil/time.h"
 #include "libavutil/timecode.h"
 #include "libavutil/time_internal.h"
@@ -67,6 +70,22 @@ typedef enum {
 #define SEGMENT_LIST_FLAG_CACHE 1
 #define SEGMENT_LIST_FLAG_LIVE  2
 
+typedef enum {
+    SEGMENT_IO_OPEN,    ///< open the next segment ahead of time
+    SEGMENT_IO_CLOSE,   ///< flush and close a finished segment
+    SEGMENT_IO_DISCARD, ///< close and delete an unused pre-opened segment
+    SEGMENT_IO_LIST,    ///< write a rendered segment list update
+} SegmentIOType;
+
+typedef struct SegmentIOJob {
+    SegmentIOType type;
+    AVIOContext *pb;
+    char *url;
+    uint8_t *buf;
+    int size;
+    int rewrite;        ///< replace the whole list instead of appending
+} SegmentIOJob;
+
 typedef struct SegmentContext {
     const AVClass *class;  /**< Class for private options. */
     int segment_idx;       ///< index of the segment file to write, starting from 0
@@ -126,6 +145,21 @@ typedef struct SegmentContext {
     SegmentListEntry cur_entry;
     SegmentListEntry *segment_list_entries;
     SegmentListEntry *segment_list_entries_end;
+
+    int async_io;          ///< pre-open and close segments on a separate thread
+#if HAVE_THREADS
+    pthread_t io_thread;
+    int io_thread_started;
+    AVThreadMessageQueue *io_queue;
+    pthread_mutex_t io_lock;
+    pthread_cond_t io_cond;
+    int io_sync_initialized;
+    int io_err;            ///< first error of an asynchronous operation
+    char *preopen_url;     ///< name of the pre-opened next segment
+    AVIOContext *preopen_pb;
+    int preopen_ret;
+    int preopen_pending;
+#endif
 } SegmentContext;
 
 static void print_csv_escaped_str(AVIOContext *ctx, const char *str)
@@ -184,6 +218,11 @@ static int segment_mux_init(AVFormatContext *s)
     return 0;
 }
 
+static int segment_get_filename(AVFormatContext *s, char *buf, int buf_size, int idx)
+{
+    return av_get_frame_filename(buf, buf_size, s->url, idx);
+}
+
 static int set_segment_filename(AVFormatContext *s)
 {
     SegmentContext *seg = s->priv_data;
@@ -204,8 +243,7 @@ static int set_segment_filename(AVFormatContext *s)
             av_log(oc, AV_LOG_ERROR, "Could not get segment filename with strftime\n");
             return AVERROR(EINVAL);
         }
-    } else if (av_get_frame_filename(buf, sizeof(buf),
-                                     s->url, seg->segment_idx) < 0) {
+    } else if (segment_get_filename(s, buf, sizeof(buf), seg->segment_idx) < 0) {
         av_log(oc, AV_LOG_ERROR, "Invalid segment filename template '%s'\n", s->url);
         return AVERROR(EINVAL);
     }
@@ -228,49 +266,29 @@ static int set_segment_filename(AVFormatContext *s)
     return 0;
 }
 
-static int segment_start(AVFormatContext *s, int write_header)
+static void segment_list_print_header(AVFormatContext *s, AVIOContext *pb)
 {
     SegmentContext *seg = s->priv_data;
-    AVFormatContext *oc = seg->avf;
-    int err = 0;
 
-    if (write_header) {
-        avformat_free_context(oc);
-        seg->avf = NULL;
-        if ((err = segment_mux_init(s)) < 0)
-            return err;
-        oc = seg->avf;
-    }
-
-    seg->segment_idx++;
-    if ((seg->segment_idx_wrap) && (seg->segment_idx % seg->segment_idx_wrap == 0))
-        seg->segment_idx_wrap_nb++;
-
-    if ((err = set_segment_filename(s)) < 0)
-        return err;
+    if (seg->list_type == LIST_TYPE_M3U8 && seg->segment_list_entries) {
+        SegmentListEntry *entry;
+        double max_duration = 0;
 
-    if ((err = s->io_open(s, &oc->pb, oc->url, AVIO_FLAG_WRITE, NULL)) < 0) {
-        av_log(s, AV_LOG_ERROR, "Failed to open segment '%s'\n", oc->url);
-        return err;
-    }
-    if (!seg->individual_header_trailer)
-        oc->pb->seekable = 0;
+        avio_printf(pb, "#EXTM3U\n");
+        avio_printf(pb, "#EXT-X-VERSION:3\n");
+        avio_printf(pb, "#EXT-X-MEDIA-SEQUENCE:%d\n", seg->segment_list_entries->index);
+        avio_printf(pb, "#EXT-X-ALLOW-CACHE:%s\n",
+                    seg->list_flags & SEGMENT_LIST_FLAG_CACHE ? "YES" : "NO");
 
-    if (oc->oformat->priv_class && oc->priv_data)
-        av_opt_set(oc->priv_data, "mpegts_flags", "+resend_headers", 0);
+        av_log(s, AV_LOG_VERBOSE, "EXT-X-MEDIA-SEQUENCE:%d\n",
+               seg->segment_list_entries->index);
 
-    if (write_header) {
-        AVDictionary *options = NULL;
-        av_dict_copy(&options, seg->format_options, 0);
-        av_dict_set(&options, "fflags", "-autobsf", 0);
-        err = avformat_write_header(oc, &options);
-        av_dict_free(&options);
-        if (err < 0)
-            return err;
+        for (entry = seg->segment_list_entries; entry; entry = entry->next)
+            max_duration = FFMAX(max_duration, entry->end_time - entry->start_time);
+        avio_printf(pb, "#EXT-X-TARGETDURATION:%"PRId64"\n", (int64_t)ceil(max_duration));
+    } else if (seg->list_type == LIST_TYPE_FFCONCAT) {
+        avio_printf(pb, "ffconcat version 1.0\n");
     }
-
-    seg->segment_frame_count = 0;
-    return 0;
 }
 
 static int segment_list_open(AVFormatContext *s)
@@ -285,25 +303,7 @@ static int segment_list_open(AVFormatContext *s)
         return ret;
     }
 
-    if (seg->list_type == LIST_TYPE_M3U8 && seg->segment_list_entries) {
-        SegmentListEntry *entry;
-        double max_duration = 0;
-
-        avio_printf(seg->list_pb, "#EXTM3U\n");
-        avio_printf(seg->list_pb, "#EXT-X-VERSION:3\n");
-        avio_printf(seg->list_pb, "#EXT-X-MEDIA-SEQUENCE:%d\n", seg->segment_list_entries->index);
-        avio_printf(seg->list_pb, "#EXT-X-ALLOW-CACHE:%s\n",
-                    seg->list_flags & SEGMENT_LIST_FLAG_CACHE ? "YES" : "NO");
-
-        av_log(s, AV_LOG_VERBOSE, "EXT-X-MEDIA-SEQUENCE:%d\n",
-               seg->segment_list_entries->index);
-
-        for (entry = seg->segment_list_entries; entry; entry = entry->next)
-            max_duration = FFMAX(max_duration, entry->end_time - entry->start_time);
-        avio_printf(seg->list_pb, "#EXT-X-TARGETDURATION:%"PRId64"\n", (int64_t)ceil(max_duration));
-    } else if (seg->list_type == LIST_TYPE_FFCONCAT) {
-        avio_printf(seg->list_pb, "ffconcat version 1.0\n");
-    }
+    segment_list_print_header(s, seg->list_pb);
 
     return ret;
 }
@@ -343,6 +343,344 @@ static void segment_list_print_entry(AVIOContext      *list_ioctx,
     }
 }
 
+#if HAVE_THREADS
+static int segment_list_write(AVFormatContext *s, const uint8_t *buf, int size,
+                              int rewrite)
+{
+    SegmentContext *seg = s->priv_data;
+    AVIOContext *pb = NULL;
+    int ret;
+
+    if (!rewrite) {
+        avio_write(seg->list_pb, buf, size);
+        avio_flush(seg->list_pb);
+        return seg->list_pb->error;
+    }
+
+    ret = s->io_open(s, &pb, seg->temp_list_filename, AVIO_FLAG_WRITE, NULL);
+    if (ret < 0) {
+        av_log(s, AV_LOG_ERROR, "Failed to open segment list '%s'\n", seg->list);
+        return ret;
+    }
+    avio_write(pb, buf, size);
+    ret = ff_format_io_close(s, &pb);
+    if (ret >= 0 && seg->use_rename)
+        ret = ff_rename(seg->temp_list_filename, seg->list, s);
+    return ret;
+}
+
+static void *segment_io_thread(void *arg)
+{
+    AVFormatContext *s = arg;
+    SegmentContext *seg = s->priv_data;
+    SegmentIOJob job;
+    int ret;
+
+    ff_thread_setname("segment-io");
+
+    while (av_thread_message_queue_recv(seg->io_queue, &job, 0) >= 0) {
+        switch (job.type) {
+        case SEGMENT_IO_OPEN:
+            ret = s->io_open(s, &job.pb, seg->preopen_url, AVIO_FLAG_WRITE, NULL);
+            pthread_mutex_lock(&seg->io_lock);
+            seg->preopen_pb      = job.pb;
+            seg->preopen_ret     = ret;
+            seg->preopen_pending = 0;
+            pthread_cond_broadcast(&seg->io_cond);
+            pthread_mutex_unlock(&seg->io_lock);
+            /* A failed pre-open is retried synchronously by segment_start(). */
+            ret = 0;
+            break;
+        case SEGMENT_IO_CLOSE:
+            ret = ff_format_io_close(s, &job.pb);
+            if (ret < 0)
+                av_log(s, AV_LOG_ERROR, "Failure occurred when closing a segment\n");
+            break;
+        case SEGMENT_IO_DISCARD:
+            ff_format_io_close(s, &job.pb);
+            ret = ffurl_delete(job.url);
+            if (ret < 0)
+                av_log(s, AV_LOG_VERBOSE, "Could not delete unused segment '%s'\n",
+                       job.url);
+            ret = 0;
+            break;
+        case SEGMENT_IO_LIST:
+            ret = segment_list_write(s, job.buf, job.size, job.rewrite);
+            break;
+        default:
+            av_assert0(0);
+        }
+
+        if (ret < 0) {
+            pthread_mutex_lock(&seg->io_lock);
+            if (!seg->io_err)
+                seg->io_err = ret;
+            pthread_mutex_unlock(&seg->io_lock);
+        }
+        av_freep(&job.url);
+        av_freep(&job.buf);
+    }
+
+    return NULL;
+}
+
+static void segment_io_free_job(void *msg)
+{
+    SegmentIOJob *job = msg;
+
+    av_freep(&job->url);
+    av_freep(&job->buf);
+}
+
+static int segment_io_start(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&seg->io_queue, 16, sizeof(SegmentIOJob));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(seg->io_queue, segment_io_free_job);
+
+    if ((ret = pthread_mutex_init(&seg->io_lock, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&seg->io_cond, NULL))) {
+        pthread_mutex_destroy(&seg->io_lock);
+        return AVERROR(ret);
+    }
+    seg->io_sync_initialized = 1;
+
+    if ((ret = pthread_create(&seg->io_thread, NULL, segment_io_thread, s))) {
+        av_log(s, AV_LOG_ERROR, "Failed to start I/O thread: %s\n",
+               av_err2str(AVERROR(ret)));
+        return AVERROR(ret);
+    }
+    seg->io_thread_started = 1;
+    return 0;
+}
+
+static int segment_io_queue(AVFormatContext *s, SegmentIOJob *job)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret;
+
+    pthread_mutex_lock(&seg->io_lock);
+    ret = seg->io_err;
+    pthread_mutex_unlock(&seg->io_lock);
+
+    if (ret >= 0)
+        ret = av_thread_message_queue_send(seg->io_queue, job, 0);
+    if (ret < 0)
+        segment_io_free_job(job);
+    return ret;
+}
+
+static void segment_io_wait_preopen(SegmentContext *seg)
+{
+    pthread_mutex_lock(&seg->io_lock);
+    while (seg->preopen_pending)
+        pthread_cond_wait(&seg->io_cond, &seg->io_lock);
+    pthread_mutex_unlock(&seg->io_lock);
+}
+
+/* Hand the pre-opened output back for closing and deletion. */
+static void segment_discard_preopened(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+
+    if (seg->preopen_pb) {
+        SegmentIOJob job = { .type = SEGMENT_IO_DISCARD, .pb = seg->preopen_pb };
+
+        av_log(s, AV_LOG_DEBUG, "Discarding pre-opened segment '%s'\n",
+               seg->preopen_url);
+        seg->preopen_pb = NULL;
+        job.url = seg->preopen_url;
+        seg->preopen_url = NULL;
+        if (segment_io_queue(s, &job) < 0)
+            ff_format_io_close(s, &job.pb);
+    }
+    av_freep(&seg->preopen_url);
+}
+
+/* Start opening the output of the segment following the current one. */
+static void segment_preopen_next(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+    SegmentIOJob job = { .type = SEGMENT_IO_OPEN };
+    int idx = seg->segment_idx + 1;
+    const char *proto;
+    char buf[1024];
+
+    /* strftime names depend on the time the segment is started, and
+     * with wrapping the next name usually belongs to an older segment,
+     * which must not be truncated before it is actually replaced. */
+    if (!seg->io_thread_started || seg->use_strftime || seg->segment_idx_wrap ||
+        seg->preopen_url)
+        return;
+
+    /* Only new local files: an unused output is deleted again, which
+     * remote destinations may not support or may already have published. */
+    if (segment_get_filename(s, buf, sizeof(buf), idx) < 0)
+        return;
+    proto = avio_find_protocol_name(buf);
+    if (!proto || strcmp(proto, "file") || avio_check(buf, 0) >= 0)
+        return;
+    if (!(seg->preopen_url = av_strdup(buf)))
+        return;
+
+    seg->preopen_pending = 1;
+    if (segment_io_queue(s, &job) < 0) {
+        seg->preopen_pending = 0;
+        av_freep(&seg->preopen_url);
+    }
+}
+
+static int segment_take_preopened(AVFormatContext *s, AVIOContext **pb)
+{
+    SegmentContext *seg = s->priv_data;
+    int ret = 0;
+
+    if (!seg->preopen_url)
+        return 0;
+
+    segment_io_wait_preopen(seg);
+    if (seg->preopen_pb && !strcmp(seg->preopen_url, seg->avf->url)) {
+        *pb = seg->preopen_pb;
+        seg->preopen_pb = NULL;
+        ret = 1;
+    }
+    segment_discard_preopened(s);
+    return ret;
+}
+
+static int segment_close_async(AVFormatContext *s, AVIOContext **pb)
+{
+    SegmentContext *seg = s->priv_data;
+    SegmentIOJob job = { .type = SEGMENT_IO_CLOSE, .pb = *pb };
+    int ret;
+
+    if (!seg->io_thread_started || !*pb)
+        return 0;
+
+    *pb = NULL;
+    if ((ret = segment_io_queue(s, &job)) < 0)
+        ff_format_io_close(s, &job.pb);
+    return ret;
+}
+
+static int segment_list_update_async(AVFormatContext *s, int rewrite, int is_last)
+{
+    SegmentContext *seg = s->priv_data;
+    SegmentIOJob job = { .type = SEGMENT_IO_LIST, .rewrite = rewrite };
+    AVIOContext *dyn;
+    int ret;
+
+    if ((ret = avio_open_dyn_buf(&dyn)) < 0)
+        return ret;
+    if (rewrite) {
+        SegmentListEntry *entry;
+
+        segment_list_print_header(s, dyn);
+        for (entry = seg->segment_list_entries; entry; entry = entry->next)
+            segment_list_print_entry(dyn, seg->list_type, entry, s);
+        if (seg->list_type == LIST_TYPE_M3U8 && is_last)
+            avio_printf(dyn, "#EXT-X-ENDLIST\n");
+    } else {
+        segment_list_print_entry(dyn, seg->list_type, &seg->cur_entry, s);
+    }
+    job.size = avio_close_dyn_buf(dyn, &job.buf);
+    if (!job.buf)
+        return AVERROR(ENOMEM);
+
+    return segment_io_queue(s, &job);
+}
+
+/* Wait for all pending operations and stop the I/O thread. */
+static int segment_io_stop(AVFormatContext *s)
+{
+    SegmentContext *seg = s->priv_data;
+
+    if (!seg->io_thread_started)
+        return 0;
+
+    segment_io_wait_preopen(seg);
+    segment_discard_preopened(s);
+
+    av_thread_message_queue_set_err_recv(seg->io_queue, AVERROR_EOF);
+    pthread_join(seg->io_thread, NULL);
+    seg->io_thread_started = 0;
+
+    return seg->io_err;
+}
+#else
+static void segment_preopen_next(AVFormatContext *s)
+{
+}
+
+static int segment_take_preopened(AVFormatContext *s, AVIOContext **pb)
+{
+    return 0;
+}
+
+static int segment_close_async(AVFormatContext *s, AVIOContext **pb)
+{
+    return 0;
+}
+
+static int segment_io_stop(AVFormatContext *s)
+{
+    return 0;
+}
+#endif
+
+static int segment_start(AVFormatContext *s, int write_header)
+{
+    SegmentContext *seg = s->priv_data;
+    AVFormatContext *oc = seg->avf;
+    int err = 0;
+
+    if (write_header) {
+        avformat_free_context(oc);
+        seg->avf = NULL;
+        if ((err = segment_mux_init(s)) < 0)
+            return err;
+        oc = seg->avf;
+    }
+
+    seg->segment_idx++;
+    if ((seg->segment_idx_wrap) && (seg->segment_idx % seg->segment_idx_wrap == 0))
+        seg->segment_idx_wrap_nb++;
+
+    if ((err = set_segment_filename(s)) < 0)
+        return err;
+
+    if (segment_take_preopened(s, &oc->pb)) {
+        av_log(s, AV_LOG_DEBUG, "Using pre-opened segment '%s'\n", oc->url);
+    } else if ((err = s->io_open(s, &oc->pb, oc->url, AVIO_FLAG_WRITE, NULL)) < 0) {
+        av_log(s, AV_LOG_ERROR, "Failed to open segment '%s'\n", oc->url);
+        return err;
+    }
+    if (!seg->individual_header_trailer)
+        oc->pb->seekable = 0;
+
+    if (oc->oformat->priv_class && oc->priv_data)
+        av_opt_set(oc->priv_data, "mpegts_flags", "+resend_headers", 0);
+
+    if (write_header) {
+        AVDictionary *options = NULL;
+        av_dict_copy(&options, seg->format_options, 0);
+        av_dict_set(&options, "fflags", "-autobsf", 0);
+        err = avformat_write_header(oc, &options);
+        av_dict_free(&options);
+        if (err < 0)
+            return err;
+    }
+
+    seg->segment_frame_count = 0;
+    segment_preopen_next(s);
+    return 0;
+}
+
 static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
 {
     SegmentContext *seg = s->priv_data;
@@ -366,6 +704,13 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
         av_log(s, AV_LOG_ERROR, "Failure occurred when ending segment '%s'\n",
                oc->url);
 
+    /* Queue the close before any list update mentioning this segment. */
+    if (seg->async_io) {
+        int err2 = segment_close_async(s, &oc->pb);
+        if (err2 < 0)
+            ret = err2;
+    }
+
     if (seg->list) {
         if (seg->list_size || seg->list_type == LIST_TYPE_M3U8) {
             SegmentListEntry *entry = av_mallocz(sizeof(*entry));
@@ -391,15 +736,28 @@ static int segment_end(AVFormatContext *s, int write_trailer, int is_last)
                 av_freep(&entry);
             }
 
-            if ((ret = segment_list_open(s)) < 0)
+#if HAVE_THREADS
+            if (seg->io_thread_started) {
+                if ((ret = segment_list_update_async(s, 1, is_last)) < 0)
+                    goto end;
+            } else
+#endif
+            {
+                if ((ret = segment_list_open(s)) < 0)
+                    goto end;
+                for (entry = seg->segment_list_entries; entry; entry = entry->next)
+                    segment_list_print_entry(seg->list_pb, seg->list_type, entry, s);
+                if (seg->list_type == LIST_TYPE_M3U8 && is_last)
+                    avio_printf(seg->list_pb, "#EXT-X-ENDLIST\n");
+                ff_format_io_close(s, &seg->list_pb);
+                if (seg->use_rename)
+                    ff_rename(seg->temp_list_filename, seg->list, s);
+            }
+#if HAVE_THREADS
+        } else if (seg->io_thread_started) {
+            if ((ret = segment_list_update_async(s, 0, is_last)) < 0)
                 goto end;
-            for (entry = seg->segment_list_entries; entry; entry = entry->next)
-                segment_list_print_entry(seg->list_pb, seg->list_type, entry, s);
-            if (seg->list_type == LIST_TYPE_M3U8 && is_last)
-                avio_printf(seg->list_pb, "#EXT-X-ENDLIST\n");
-            ff_format_io_close(s, &seg->list_pb);
-            if (seg->use_rename)
-                ff_rename(seg->temp_list_filename, seg->list, s);
+#endif
         } else {
             segment_list_print_entry(seg->list_pb, seg->list_type, &seg->cur_entry, s);
             avio_flush(seg->list_pb);
@@ -646,6 +1004,15 @@ static void seg_free(AVFormatContext *s)
     SegmentContext *seg = s->priv_data;
     SegmentListEntry *cur;
 
+    segment_io_stop(s);
+#if HAVE_THREADS
+    av_thread_message_queue_free(&seg->io_queue);
+    if (seg->io_sync_initialized) {
+        pthread_mutex_destroy(&seg->io_lock);
+        pthread_cond_destroy(&seg->io_cond);
+        seg->io_sync_initialized = 0;
+    }
+#endif
     ff_format_io_close(s, &seg->list_pb);
     if (seg->avf) {
         if (seg->is_nullctx)
@@ -734,9 +1101,26 @@ static int seg_init(AVFormatContext *s)
         } else {
             const char *proto = avio_find_protocol_name(seg->list);
             seg->use_rename = proto && !strcmp(proto, "file");
+            snprintf(seg->temp_list_filename, sizeof(seg->temp_list_filename),
+                     seg->use_rename ? "%s.tmp" : "%s", seg->list);
         }
     }
 
+    if (seg->async_io) {
+#if HAVE_THREADS
+        /* The I/O thread calls io_open and io_close2 concurrently with
+         * the muxing thread, which custom callbacks need not support. */
+        if (!ff_format_io_is_default(s))
+            av_log(s, AV_LOG_WARNING, "segment_async_io is not supported with "
+                   "custom I/O callbacks, segments are opened synchronously\n");
+        else if ((ret = segment_io_start(s)) < 0)
+            return ret;
+#else
+        av_log(s, AV_LOG_ERROR, "segment_async_io requires threading support\n");
+        return AVERROR(ENOSYS);
+#endif
+    }
+
     if (seg->list_type == LIST_TYPE_EXT)
         av_log(s, AV_LOG_WARNING, "'ext' list type option is deprecated in favor of 'csv'\n");
 
@@ -842,6 +1226,7 @@ static int seg_write_header(AVFormatContext *s)
             oc->pb->seekable = 0;
     }
 
+    segment_preopen_next(s);
     return 0;
 }
 
@@ -993,7 +1378,7 @@ static int seg_write_trailer(struct AVFormatContext *s)
 {
     SegmentContext *seg = s->priv_data;
     AVFormatContext *oc = seg->avf;
-    int ret;
+    int ret, ret2;
 
     if (!oc)
         return 0;
@@ -1008,6 +1393,8 @@ static int seg_write_trailer(struct AVFormatContext *s)
     } else {
         ret = segment_end(s, 1, 1);
     }
+    if ((ret2 = segment_io_stop(s)) < 0 && ret >= 0)
+        ret = ret2;
     return ret;
 }
 
@@ -1074,6 +1461,7 @@ static const AVOption options[] = {
     { "reset_timestamps", "reset timestamps at the beginning of each segment", OFFSET(reset_timestamps), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E },
     { "initial_offset", "set initial timestamp offset", OFFSET(initial_offset), AV_OPT_TYPE_DURATION, {.i64 = 0}, -INT64_MAX, INT64_MAX, E },
     { "write_empty_segments", "allow writing empty 'filler' segments", OFFSET(write_empty), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E },
+    { "segment_async_io", "open the next segment in advance and close finished ones in the background", OFFSET(async_io), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, E },
     { NULL },
 };
 
@@ -18,8 +18,12 @@
  * License along with FFmpeg; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
+
+#define _DEFAULT_SOURCE /* Needed for SO_ZEROCOPY with recent glibc */
+
 #include "avformat.h"
 #include "libavutil/avassert.h"
+#include "libavutil/mem.h"
 #include "libavutil/parseutils.h"
 #include "libavutil/opt.h"
 #include "libavutil/time.h"
@@ -31,6 +35,26 @@
 #if HAVE_POLL_H
 #include <poll.h>
 #endif
+#if HAVE_LINUX_ERRQUEUE_H
+#include <linux/errqueue.h>
+#endif
+
+#if HAVE_LINUX_ERRQUEUE_H && HAVE_POLL_H && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define TCP_HAVE_ZEROCOPY 1
+#else
+#define TCP_HAVE_ZEROCOPY 0
+#endif
+
+/* maximum number of zero-copy sends waiting for their completion */
+#define TCP_ZEROCOPY_MAX_PENDING 1024
+/* how long to wait for outstanding zero-copy sends on close, in microseconds */
+#define TCP_ZEROCOPY_DRAIN_TIMEOUT 1000000
+
+typedef struct TCPZeroCopyBuffer {
+    AVBufferRef *buf;
+    uint32_t id;
+    int done;
+} TCPZeroCopyBuffer;
 
 typedef struct TCPContext {
     const AVClass *class;
@@ -45,6 +69,16 @@ typedef struct TCPContext {
     int send_buffer_size;
     int tcp_nodelay;
     int64_t open_time;
+    int zerocopy;
+    int zerocopy_min_size;
+    int zc_enabled;
+    int zc_copied_route;  ///< the kernel copies zero-copy sends anyway
+    uint32_t zc_next_id;
+    TCPZeroCopyBuffer *zc_pending;
+    unsigned int zc_pending_alloc;
+    int zc_nb_pending;
+    int64_t zc_sends;
+    int64_t zc_copied;
 #if !HAVE_WINSOCK2_H
     int tcp_mss;
 #endif /* !HAVE_WINSOCK2_H */
@@ -62,6 +96,8 @@ static const AVOption options[] = {
     { "send_buffer_size", "Socket send buffer size (in bytes)",                OFFSET(send_buffer_size), AV_OPT_TYPE_INT, { .i64 = -1 },         -1, INT_MAX, .flags = D|E },
     { "recv_buffer_size", "Socket receive buffer size (in bytes)",             OFFSET(recv_buffer_size), AV_OPT_TYPE_INT, { .i64 = -1 },         -1, INT_MAX, .flags = D|E },
     { "tcp_nodelay", "Use TCP_NODELAY to disable nagle's algorithm",           OFFSET(tcp_nodelay), AV_OPT_TYPE_BOOL, { .i64 = 0 },             0, 1, .flags = D|E },
+    { "zerocopy",    "Send refcounted buffers without copying them (MSG_ZEROCOPY)", OFFSET(zerocopy), AV_OPT_TYPE_BOOL, { .i64 = 0 },          0, 1, .flags = E },
+    { "zerocopy_min_size", "Minimum write size to send without copying",       OFFSET(zerocopy_min_size), AV_OPT_TYPE_INT, { .i64 = 16384 },  0, INT_MAX, .flags = E },
 #if !HAVE_WINSOCK2_H
     { "tcp_mss",     "Maximum segment size for outgoing TCP packets",          OFFSET(tcp_mss),     AV_OPT_TYPE_INT, { .i64 = -1 },         -1, INT_MAX, .flags = D|E },
 #endif /* !HAVE_WINSOCK2_H */
@@ -137,6 +173,113 @@ static int customize_fd(void *ctx, int fd, int family)
     return 0;
 }
 
+#if TCP_HAVE_ZEROCOPY
+static void tcp_zerocopy_complete(URLContext *h, uint32_t lo, uint32_t hi, int copied)
+{
+    TCPContext *s = h->priv_data;
+    int i, done = 0;
+
+    for (i = 0; i < s->zc_nb_pending; i++) {
+        TCPZeroCopyBuffer *zb = &s->zc_pending[i];
+        if ((uint32_t)(zb->id - lo) <= (uint32_t)(hi - lo))
+            zb->done = 1;
+    }
+
+    if (copied) {
+        s->zc_copied += hi - lo + 1;
+        /* The kernel had to copy the data anyway (e.g. loopback or a
+         * device without scatter-gather), which is more expensive than
+         * a plain send, so stop asking for it. */
+        if (!s->zc_copied_route) {
+            av_log(h, AV_LOG_VERBOSE, "Zero-copy send not supported on this route, disabling it\n");
+            s->zc_copied_route = 1;
+        }
+    }
+
+    while (done < s->zc_nb_pending && s->zc_pending[done].done)
+        av_buffer_unref(&s->zc_pending[done++].buf);
+    if (done) {
+        s->zc_nb_pending -= done;
+        memmove(s->zc_pending, s->zc_pending + done,
+                s->zc_nb_pending * sizeof(*s->zc_pending));
+    }
+}
+
+/* release the buffers the kernel reported as sent */
+static void tcp_zerocopy_reap(URLContext *h)
+{
+    TCPContext *s = h->priv_data;
+    char control[128];
+
+    while (s->zc_nb_pending) {
+        struct msghdr msg = { 0 };
+        struct cmsghdr *cmsg;
+
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            struct sock_extended_err *serr;
+
+            if (!(cmsg->cmsg_level == SOL_IP   && cmsg->cmsg_type == IP_RECVERR) &&
+                !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+                continue;
+            serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+            if (serr->ee_errno || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                continue;
+            tcp_zerocopy_complete(h, serr->ee_info, serr->ee_data,
+                                  serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);
+        }
+    }
+}
+
+/* wait for the outstanding zero-copy sends before the buffers are released */
+static void tcp_zerocopy_drain(URLContext *h)
+{
+    TCPContext *s = h->priv_data;
+    int64_t timeout = h->rw_timeout > 0 ? h->rw_timeout : TCP_ZEROCOPY_DRAIN_TIMEOUT;
+    int64_t deadline = av_gettime_relative() + timeout;
+
+    tcp_zerocopy_reap(h);
+    while (s->zc_nb_pending && av_gettime_relative() < deadline) {
+        /* completions are signalled as POLLERR */
+        struct pollfd p = { .fd = s->fd, .events = 0 };
+        if (poll(&p, 1, 10) < 0 && ff_neterrno() != AVERROR(EINTR))
+            break;
+        tcp_zerocopy_reap(h);
+    }
+    /* The kernel keeps sending from these pages after the socket is
+     * closed and no completion can be read any more, so the buffers must
+     * never be reused: leak their references instead of releasing them. */
+    if (s->zc_nb_pending)
+        av_log(h, AV_LOG_WARNING, "%d zero-copy sends still pending on close, "
+               "keeping their buffers\n", s->zc_nb_pending);
+    av_log(h, AV_LOG_DEBUG, "%"PRId64" zero-copy sends, %"PRId64" copied by the kernel\n",
+           s->zc_sends, s->zc_copied);
+
+    s->zc_nb_pending = 0;
+    av_freep(&s->zc_pending);
+    s->zc_pending_alloc = 0;
+}
+#endif
+
+static void tcp_zerocopy_setup(URLContext *h)
+{
+#if TCP_HAVE_ZEROCOPY
+    TCPContext *s = h->priv_data;
+    int one = 1;
+
+    if (setsockopt(s->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+        ff_log_net_error(h, AV_LOG_WARNING, "setsockopt(SO_ZEROCOPY)");
+        return;
+    }
+    s->zc_enabled = 1;
+#else
+    av_log(h, AV_LOG_WARNING, "Zero-copy send is not supported on this platform\n");
+#endif
+}
+
 /* return non zero if error */
 static int tcp_open(URLContext *h, const char *uri, int flags)
 {
@@ -192,6 +335,9 @@ static int tcp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "tcp_nodelay", p)) {
             s->tcp_nodelay = strtol(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "zerocopy", p)) {
+            s->zerocopy = strtol(buf, NULL, 10);
+        }
     }
     if (s->rw_timeout >= 0) {
         s->open_timeout =
@@ -259,6 +405,8 @@ static int tcp_open(URLContext *h, const char *uri, int flags)
 
     h->is_streamed = 1;
     s->fd = fd;
+    if (s->zerocopy && (h->flags & AVIO_FLAG_WRITE))
+        tcp_zerocopy_setup(h);
 
     freeaddrinfo(ai);
     return 0;
@@ -318,10 +466,66 @@ static int tcp_write(URLContext *h, const uint8_t *buf, int size)
         if (ret)
             return ret;
     }
+#if TCP_HAVE_ZEROCOPY
+    if (s->zc_nb_pending)
+        tcp_zerocopy_reap(h);
+#endif
     ret = send(s->fd, buf, size, MSG_NOSIGNAL);
     return ret < 0 ? ff_neterrno() : ret;
 }
 
+static int tcp_write_buffer(URLContext *h, const uint8_t *buf, int size,
+                            AVBufferRef *ref)
+{
+#if TCP_HAVE_ZEROCOPY
+    TCPContext *s = h->priv_data;
+    TCPZeroCopyBuffer *zb;
+    int ret;
+
+    if (s->zc_nb_pending)
+        tcp_zerocopy_reap(h);
+    if (!s->zc_enabled || s->zc_copied_route || size < s->zerocopy_min_size ||
+        s->zc_nb_pending >= TCP_ZEROCOPY_MAX_PENDING)
+        return tcp_write(h, buf, size);
+
+    if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+        ret = ff_network_wait_fd_timeout(s->fd, 1, h->rw_timeout, &h->interrupt_callback);
+        if (ret)
+            return ret;
+    }
+
+    zb = av_fast_realloc(s->zc_pending, &s->zc_pending_alloc,
+                         (s->zc_nb_pending + 1) * sizeof(*s->zc_pending));
+    if (!zb)
+        return AVERROR(ENOMEM);
+    s->zc_pending = zb;
+    zb = &s->zc_pending[s->zc_nb_pending];
+    zb->buf = av_buffer_ref(ref);
+    if (!zb->buf)
+        return AVERROR(ENOMEM);
+
+    ret = send(s->fd, buf, size, MSG_NOSIGNAL | MSG_ZEROCOPY);
+    if (ret < 0) {
+        ret = ff_neterrno();
+        av_buffer_unref(&zb->buf);
+        /* out of option memory for pinned pages, copy this one */
+        if (ret == AVERROR(ENOBUFS)) {
+            ret = send(s->fd, buf, size, MSG_NOSIGNAL);
+            return ret < 0 ? ff_neterrno() : ret;
+        }
+        return ret;
+    }
+    /* every successful send gets a notification id */
+    zb->id   = s->zc_next_id++;
+    zb->done = 0;
+    s->zc_nb_pending++;
+    s->zc_sends++;
+    return ret;
+#else
+    return tcp_write(h, buf, size);
+#endif
+}
+
 static int tcp_shutdown(URLContext *h, int flags)
 {
     TCPContext *s = h->priv_data;
@@ -345,6 +549,10 @@ static int tcp_close(URLContext *h)
     int64_t duration = time_end_ms - s->open_time;
     av_log(s, AV_LOG_INFO, "%"PRId64" ms - tcp_close: %s\n", duration, h->filename);
 
+#if TCP_HAVE_ZEROCOPY
+    if (s->zc_enabled)
+        tcp_zerocopy_drain(h);
+#endif
     closesocket(s->fd);
     return 0;
 }
@@ -381,6 +589,7 @@ const URLProtocol ff_tcp_protocol = {
     .url_accept          = tcp_accept,
     .url_read            = tcp_read,
     .url_write           = tcp_write,
+    .url_write_buffer    = tcp_write_buffer,
     .url_close           = tcp_close,
     .url_get_file_handle = tcp_get_file_handle,
     .url_get_short_seek  = tcp_get_window_size,
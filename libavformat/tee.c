@@ -23,6 +23,8 @@
 #include "libavutil/avutil.h"
 #include "libavutil/avstring.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 #include "libavcodec/bsf.h"
 #include "internal.h"
 #include "avformat.h"
@@ -36,6 +38,21 @@ typedef enum {
 
 #define DEFAULT_SLAVE_FAILURE_POLICY ON_SLAVE_FAILURE_ABORT
 
+typedef enum {
+    ON_QUEUE_FULL_BLOCK = 1,
+    ON_QUEUE_FULL_DROP  = 2
+} SlaveQueueFullPolicy;
+
+typedef enum {
+    TEE_WRITE_PACKET,
+    TEE_FLUSH_OUTPUT
+} TeeMessageType;
+
+typedef struct TeeMessage {
+    TeeMessageType type;
+    AVPacket pkt;
+} TeeMessage;
+
 typedef struct {
     AVFormatContext *avf;
     AVBSFContext **bsfs; ///< bitstream filters per stream
@@ -48,6 +65,20 @@ typedef struct {
      * disabled output streams are set to -1 */
     int *stream_map;
     int header_written;
+
+    int use_thread;
+    int thread_queue_size;
+    SlaveQueueFullPolicy on_full;
+#if HAVE_THREADS
+    pthread_t thread;
+    AVThreadMessageQueue *queue;
+    int thread_started;
+    int thread_ret;
+#endif
+    /** per output stream: drop packets until the next keyframe */
+    uint8_t *drop_until_key;
+    int64_t nb_dropped;
+    int max_queued;
 } TeeSlave;
 
 typedef struct TeeContext {
@@ -57,6 +88,8 @@ typedef struct TeeContext {
     TeeSlave *slaves;
     int use_fifo;
     AVDictionary *fifo_options;
+    int use_thread;
+    int thread_queue_size;
 } TeeContext;
 
 static const char *const slave_delim     = "|";
@@ -69,6 +102,10 @@ static const AVOption options[] = {
          OFFSET(use_fifo), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
         {"fifo_options", "fifo pseudo-muxer options", OFFSET(fifo_options),
          AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, AV_OPT_FLAG_ENCODING_PARAM},
+        {"use_thread", "Run each slave muxer in its own thread",
+         OFFSET(use_thread), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
+        {"thread_queue_size", "Number of packets queued for each slave thread",
+         OFFSET(thread_queue_size), AV_OPT_TYPE_INT, {.i64 = 64}, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
         {NULL}
 };
 
@@ -115,6 +152,185 @@ static int parse_slave_fifo_options(const char *fifo_options, TeeSlave *tee_slav
     return av_dict_parse_string(&tee_slave->fifo_options, fifo_options, "=", ":", 0);
 }
 
+static int parse_slave_thread_policy(const char *use_thread, TeeSlave *tee_slave)
+{
+    if (av_match_name(use_thread, "true,y,yes,enable,enabled,on,1")) {
+        tee_slave->use_thread = 1;
+    } else if (av_match_name(use_thread, "false,n,no,disable,disabled,off,0")) {
+        tee_slave->use_thread = 0;
+    } else {
+        return AVERROR(EINVAL);
+    }
+    return 0;
+}
+
+static int parse_slave_thread_queue_size(const char *queue_size, TeeSlave *tee_slave)
+{
+    char *end;
+    long size = strtol(queue_size, &end, 10);
+
+    if (*end || size < 1 || size > INT_MAX)
+        return AVERROR(EINVAL);
+    tee_slave->thread_queue_size = size;
+    return 0;
+}
+
+static int parse_slave_queue_full_policy(const char *opt, TeeSlave *tee_slave)
+{
+    if (!av_strcasecmp("block", opt)) {
+        tee_slave->on_full = ON_QUEUE_FULL_BLOCK;
+        return 0;
+    } else if (!av_strcasecmp("drop", opt)) {
+        tee_slave->on_full = ON_QUEUE_FULL_DROP;
+        return 0;
+    }
+    return AVERROR(EINVAL);
+}
+
+/**
+ * Pass a packet through the bitstream filters of a slave output stream
+ * and write the result to the slave. Takes ownership of pkt's reference.
+ */
+static int tee_slave_write_packet(void *log_ctx, TeeSlave *tee_slave,
+                                  AVPacket *pkt, int s2)
+{
+    AVFormatContext *avf2 = tee_slave->avf;
+    AVBSFContext *bsfs = tee_slave->bsfs[s2];
+    int ret;
+
+    pkt->stream_index = s2;
+    ret = av_bsf_send_packet(bsfs, pkt);
+    if (ret < 0) {
+        av_packet_unref(pkt);
+        av_log(log_ctx, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
+               av_err2str(ret));
+        return ret;
+    }
+
+    while (1) {
+        ret = av_bsf_receive_packet(bsfs, pkt);
+        if (ret == AVERROR(EAGAIN))
+            return 0;
+        else if (ret < 0)
+            return ret;
+
+        av_packet_rescale_ts(pkt, bsfs->time_base_out,
+                             avf2->streams[s2]->time_base);
+        ret = av_interleaved_write_frame(avf2, pkt);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+#if HAVE_THREADS
+static void free_message(void *msg)
+{
+    TeeMessage *tee_msg = msg;
+
+    av_packet_unref(&tee_msg->pkt);
+}
+
+static void *tee_slave_thread(void *arg)
+{
+    TeeSlave *tee_slave = arg;
+    TeeMessage msg;
+    int ret;
+
+    ff_thread_setname("tee-slave");
+
+    while ((ret = av_thread_message_queue_recv(tee_slave->queue, &msg, 0)) >= 0) {
+        if (msg.type == TEE_FLUSH_OUTPUT)
+            ret = av_interleaved_write_frame(tee_slave->avf, NULL);
+        else
+            ret = tee_slave_write_packet(tee_slave->avf, tee_slave, &msg.pkt,
+                                         msg.pkt.stream_index);
+        av_packet_unref(&msg.pkt);
+        if (ret < 0)
+            break;
+    }
+
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    tee_slave->thread_ret = ret;
+    /* Make the next send fail, so that the error reaches the main thread. */
+    av_thread_message_queue_set_err_send(tee_slave->queue, ret < 0 ? ret : AVERROR_EOF);
+    return NULL;
+}
+
+static int start_slave_thread(AVFormatContext *avf, TeeSlave *tee_slave)
+{
+    int ret;
+
+    ret = av_thread_message_queue_alloc(&tee_slave->queue, tee_slave->thread_queue_size,
+                                        sizeof(TeeMessage));
+    if (ret < 0)
+        return ret;
+    av_thread_message_queue_set_free_func(tee_slave->queue, free_message);
+
+    ret = pthread_create(&tee_slave->thread, NULL, tee_slave_thread, tee_slave);
+    if (ret) {
+        av_log(avf, AV_LOG_ERROR, "Failed to start thread: %s\n",
+               av_err2str(AVERROR(ret)));
+        av_thread_message_queue_free(&tee_slave->queue);
+        return AVERROR(ret);
+    }
+    tee_slave->thread_started = 1;
+    return 0;
+}
+
+static int stop_slave_thread(TeeSlave *tee_slave)
+{
+    if (tee_slave->thread_started) {
+        av_thread_message_queue_set_err_recv(tee_slave->queue, AVERROR_EOF);
+        pthread_join(tee_slave->thread, NULL);
+        tee_slave->thread_started = 0;
+    }
+    av_thread_message_queue_free(&tee_slave->queue);
+    return tee_slave->thread_ret;
+}
+
+static int tee_queue_packet(AVFormatContext *avf, TeeSlave *tee_slave,
+                            const AVPacket *pkt, int s2)
+{
+    TeeMessage msg = { .type = pkt ? TEE_WRITE_PACKET : TEE_FLUSH_OUTPUT };
+    int drop = tee_slave->on_full == ON_QUEUE_FULL_DROP;
+    int ret;
+
+    if (pkt) {
+        if (tee_slave->drop_until_key[s2]) {
+            if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+                tee_slave->nb_dropped++;
+                return 0;
+            }
+            tee_slave->drop_until_key[s2] = 0;
+        }
+        ret = av_packet_ref(&msg.pkt, pkt);
+        if (ret < 0)
+            return ret;
+        msg.pkt.stream_index = s2;
+    }
+
+    ret = av_thread_message_queue_send(tee_slave->queue, &msg,
+                                       drop && pkt ? AV_THREAD_MESSAGE_NONBLOCK : 0);
+    if (ret == AVERROR(EAGAIN)) {
+        av_packet_unref(&msg.pkt);
+        if (!tee_slave->nb_dropped++)
+            av_log(avf, AV_LOG_WARNING, "Slave '%s': queue full, dropping packets\n",
+                   tee_slave->avf->url);
+        /* Resume only at a keyframe, so the output remains decodable. */
+        tee_slave->drop_until_key[s2] = 1;
+        return 0;
+    } else if (ret < 0) {
+        av_packet_unref(&msg.pkt);
+        return ret;
+    }
+
+    tee_slave->max_queued = FFMAX(tee_slave->max_queued,
+                                  av_thread_message_queue_nb_elems(tee_slave->queue));
+    return 0;
+}
+#endif
+
 static int close_slave(TeeSlave *tee_slave)
 {
     AVFormatContext *avf;
@@ -126,8 +342,20 @@ static int close_slave(TeeSlave *tee_slave)
     if (!avf)
         return 0;
 
-    if (tee_slave->header_written)
-        ret = av_write_trailer(avf);
+#if HAVE_THREADS
+    if (tee_slave->use_thread) {
+        ret = stop_slave_thread(tee_slave);
+        av_log(avf, tee_slave->nb_dropped ? AV_LOG_WARNING : AV_LOG_VERBOSE,
+               "Slave '%s': at most %d packets queued, %"PRId64" packets dropped\n",
+               avf->url, tee_slave->max_queued, tee_slave->nb_dropped);
+    }
+#endif
+
+    if (tee_slave->header_written) {
+        int ret2 = av_write_trailer(avf);
+        if (ret >= 0)
+            ret = ret2;
+    }
 
     if (tee_slave->bsfs) {
         for (i = 0; i < avf->nb_streams; ++i)
@@ -135,6 +363,7 @@ static int close_slave(TeeSlave *tee_slave)
     }
     av_freep(&tee_slave->stream_map);
     av_freep(&tee_slave->bsfs);
+    av_freep(&tee_slave->drop_until_key);
 
     ff_format_io_close(avf, &avf->pb);
     avformat_free_context(avf);
@@ -161,6 +390,7 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
     char *filename;
     char *format = NULL, *select = NULL, *on_fail = NULL;
     char *use_fifo = NULL, *fifo_options_str = NULL;
+    char *use_thread = NULL, *thread_queue_size = NULL, *on_full = NULL;
     AVFormatContext *avf2 = NULL;
     AVStream *st, *st2;
     int stream_count;
@@ -195,6 +425,23 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
                           av_err2str(ret)););
     PROCESS_OPTION("fifo_options", fifo_options_str,
                    parse_slave_fifo_options(fifo_options_str, tee_slave), ;);
+    PROCESS_OPTION("use_thread", use_thread,
+                   parse_slave_thread_policy(use_thread, tee_slave),
+                   av_log(avf, AV_LOG_ERROR, "Invalid use_thread option value\n"););
+    PROCESS_OPTION("thread_queue_size", thread_queue_size,
+                   parse_slave_thread_queue_size(thread_queue_size, tee_slave),
+                   av_log(avf, AV_LOG_ERROR, "Invalid thread_queue_size option value\n"););
+    PROCESS_OPTION("on_full", on_full,
+                   parse_slave_queue_full_policy(on_full, tee_slave),
+                   av_log(avf, AV_LOG_ERROR, "Invalid on_full option value, "
+                          "valid options are 'block' and 'drop'\n"););
+#if !HAVE_THREADS
+    if (tee_slave->use_thread) {
+        av_log(avf, AV_LOG_ERROR, "use_thread requires threading support\n");
+        ret = AVERROR(ENOSYS);
+        goto end;
+    }
+#endif
     entry = NULL;
     while ((entry = av_dict_get(options, "bsfs", entry, AV_DICT_IGNORE_SUFFIX))) {
         /* trim out strlen("bsfs") characters from key */
@@ -394,6 +641,20 @@ static int open_slave(AVFormatContext *avf, char *slave, TeeSlave *tee_slave)
         goto end;
     }
 
+#if HAVE_THREADS
+    if (tee_slave->use_thread) {
+        tee_slave->drop_until_key = av_calloc(avf2->nb_streams,
+                                              sizeof(*tee_slave->drop_until_key));
+        if (!tee_slave->drop_until_key) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        ret = start_slave_thread(avf, tee_slave);
+        if (ret < 0)
+            goto end;
+    }
+#endif
+
 end:
     av_free(format);
     av_free(select);
@@ -406,8 +667,9 @@ end:
 static void log_slave(TeeSlave *slave, void *log_ctx, int log_level)
 {
     int i;
-    av_log(log_ctx, log_level, "filename:'%s' format:%s\n",
-           slave->avf->url, slave->avf->oformat->name);
+    av_log(log_ctx, log_level, "filename:'%s' format:%s%s\n",
+           slave->avf->url, slave->avf->oformat->name,
+           slave->use_thread ? " threaded" : "");
     for (i = 0; i < slave->avf->nb_streams; i++) {
         AVStream *st = slave->avf->streams[i];
         AVBSFContext *bsf = slave->bsfs[i];
@@ -477,6 +739,9 @@ static int tee_write_header(AVFormatContext *avf)
     for (i = 0; i < nb_slaves; i++) {
 
         tee->slaves[i].use_fifo = tee->use_fifo;
+        tee->slaves[i].use_thread = tee->use_thread;
+        tee->slaves[i].thread_queue_size = tee->thread_queue_size;
+        tee->slaves[i].on_full = ON_QUEUE_FULL_BLOCK;
         ret = av_dict_copy(&tee->slaves[i].fifo_options, tee->fifo_options, 0);
         if (ret < 0)
             goto fail;
@@ -531,20 +796,27 @@ static int tee_write_trailer(AVFormatContext *avf)
 static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
 {
     TeeContext *tee = avf->priv_data;
-    AVFormatContext *avf2;
-    AVBSFContext *bsfs;
+    TeeSlave *tee_slave;
     AVPacket *const pkt2 = ffformatcontext(avf)->pkt;
     int ret_all = 0, ret;
     unsigned i, s;
     int s2;
 
     for (i = 0; i < tee->nb_slaves; i++) {
-        if (!(avf2 = tee->slaves[i].avf))
+        tee_slave = &tee->slaves[i];
+        if (!tee_slave->avf)
             continue;
 
-        /* Flush slave if pkt is NULL*/
-        if (!pkt) {
-            ret = av_interleaved_write_frame(avf2, NULL);
+        if (pkt) {
+            s = pkt->stream_index;
+            s2 = tee_slave->stream_map[s];
+            if (s2 < 0)
+                continue;
+        }
+
+#if HAVE_THREADS
+        if (tee_slave->use_thread) {
+            ret = tee_queue_packet(avf, tee_slave, pkt, s2);
             if (ret < 0) {
                 ret = tee_process_slave_failure(avf, i, ret);
                 if (!ret_all && ret < 0)
@@ -552,46 +824,26 @@ static int tee_write_packet(AVFormatContext *avf, AVPacket *pkt)
             }
             continue;
         }
+#endif
 
-        s = pkt->stream_index;
-        s2 = tee->slaves[i].stream_map[s];
-        if (s2 < 0)
+        /* Flush slave if pkt is NULL*/
+        if (!pkt) {
+            ret = av_interleaved_write_frame(tee_slave->avf, NULL);
+            if (ret < 0) {
+                ret = tee_process_slave_failure(avf, i, ret);
+                if (!ret_all && ret < 0)
+                    ret_all = ret;
+            }
             continue;
+        }
 
         if ((ret = av_packet_ref(pkt2, pkt)) < 0) {
             if (!ret_all)
                 ret_all = ret;
             continue;
         }
-        bsfs = tee->slaves[i].bsfs[s2];
-        pkt2->stream_index = s2;
-
-        ret = av_bsf_send_packet(bsfs, pkt2);
-        if (ret < 0) {
-            av_packet_unref(pkt2);
-            av_log(avf, AV_LOG_ERROR, "Error while sending packet to bitstream filter: %s\n",
-                   av_err2str(ret));
-            ret = tee_process_slave_failure(avf, i, ret);
-            if (!ret_all && ret < 0)
-                ret_all = ret;
-        }
-
-        while(1) {
-            ret = av_bsf_receive_packet(bsfs, pkt2);
-            if (ret == AVERROR(EAGAIN)) {
-                ret = 0;
-                break;
-            } else if (ret < 0) {
-                break;
-            }
-
-            av_packet_rescale_ts(pkt2, bsfs->time_base_out,
-                                 avf2->streams[s2]->time_base);
-            ret = av_interleaved_write_frame(avf2, pkt2);
-            if (ret < 0)
-                break;
-        };
 
+        ret = tee_slave_write_packet(avf, tee_slave, pkt2, s2);
         if (ret < 0) {
             ret = tee_process_slave_failure(avf, i, ret);
             if (!ret_all && ret < 0)
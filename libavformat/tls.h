@@ -55,6 +55,13 @@ typedef struct TLSShared {
 
 int ff_tls_open_underlying(TLSShared *c, URLContext *parent, const char *uri, AVDictionary **options);
 
+/**
+ * Set the interrupt callback of a TLS URLContext and of the transport
+ * connection it runs on, e.g. when handing it over to a new owner.
+ * Implemented by each TLS backend.
+ */
+void ff_tls_set_interrupt_callback(URLContext *h, const AVIOInterruptCB *cb);
+
 void ff_gnutls_init(void);
 void ff_gnutls_deinit(void);
 
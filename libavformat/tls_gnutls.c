@@ -287,6 +287,15 @@ static int tls_get_short_seek(URLContext *h)
     return ffurl_get_short_seek(s->tls_shared.tcp);
 }
 
+void ff_tls_set_interrupt_callback(URLContext *h, const AVIOInterruptCB *cb)
+{
+    TLSContext *s = h->priv_data;
+
+    h->interrupt_callback = *cb;
+    if (s->tls_shared.tcp)
+        s->tls_shared.tcp->interrupt_callback = *cb;
+}
+
 static const AVOption options[] = {
     TLS_COMMON_OPTIONS(TLSContext, tls_shared),
     { NULL }
@@ -26,6 +26,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "libavutil/avassert.h"
@@ -68,6 +69,11 @@
 #include "libavutil/thread.h"
 #endif
 
+#if HAVE_LINUX_NET_TSTAMP_H
+#include <time.h>
+#include <linux/net_tstamp.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
 #define IPV6_DROP_MEMBERSHIP IPV6_LEAVE_GROUP
@@ -77,6 +83,33 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+#define UDP_MAX_BATCH_SIZE 1024
+/* Limit of how far ahead launch times are scheduled with SO_TXTIME */
+#define UDP_TXTIME_HORIZON 1000000
+
+#if HAVE_LINUX_NET_TSTAMP_H && defined(SO_TXTIME)
+#define UDP_HAVE_TXTIME 1
+#else
+#define UDP_HAVE_TXTIME 0
+#endif
+
+#if HAVE_SENDMMSG
+#include <netinet/udp.h>
+#endif
+#if HAVE_SENDMMSG && defined(UDP_SEGMENT)
+#define UDP_HAVE_GSO 1
+#else
+#define UDP_HAVE_GSO 0
+#endif
+/* Kernel limits for one UDP_SEGMENT send */
+#define UDP_MAX_GSO_SEGMENTS 64
+#define UDP_MAX_GSO_SIZE     65507
+
+enum UDPPacing {
+    UDP_PACING_THREAD,
+    UDP_PACING_TXTIME,
+    UDP_PACING_RATE,
+};
 
 typedef struct UDPContext {
     const AVClass *class;
@@ -100,6 +133,10 @@ typedef struct UDPContext {
     int circular_buffer_error;
     int64_t bitrate; /* number of bits to send per second */
     int64_t burst_bits;
+    int pacing;
+    int64_t pacing_start;
+    int64_t pacing_target;
+    int64_t pacing_sent_bits;
     int close_req;
 #if HAVE_PTHREAD_CANCEL
     pthread_t circular_buffer_thread;
@@ -115,6 +152,28 @@ typedef struct UDPContext {
     char *sources;
     char *block;
     IPSourceFilters filters;
+
+    /* Datagrams received or queued for sending with a single
+     * recvmmsg()/sendmmsg() call */
+    int batch_size;
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    struct mmsghdr *batch_msgs;
+    struct iovec *batch_iov;
+    struct sockaddr_storage *batch_addrs;
+    uint8_t *batch_buf;
+    uint8_t *batch_control;
+    int batch_slot_size;
+    int batch_count;
+    int batch_pos;
+    int batch_send;     ///< the caller flushes, queue outgoing datagrams
+#endif
+    int gso;
+#if UDP_HAVE_GSO
+    /* Queued datagrams coalesced into UDP_SEGMENT messages */
+    struct mmsghdr *gso_msgs;
+    uint8_t *gso_control;
+    int *gso_nb_segments;
+#endif
 } UDPContext;
 
 #define OFFSET(x) offsetof(UDPContext, x)
@@ -124,6 +183,10 @@ static const AVOption options[] = {
     { "buffer_size",    "System data size (in bytes)",                     OFFSET(buffer_size),    AV_OPT_TYPE_INT,    { .i64 = -1 },    -1, INT_MAX, .flags = D|E },
     { "bitrate",        "Bits to send per second",                         OFFSET(bitrate),        AV_OPT_TYPE_INT64,  { .i64 = 0  },     0, INT64_MAX, .flags = E },
     { "burst_bits",     "Max length of bursts in bits (when using bitrate)", OFFSET(burst_bits),   AV_OPT_TYPE_INT64,  { .i64 = 0  },     0, INT64_MAX, .flags = E },
+    { "pacing",         "How to enforce bitrate",                          OFFSET(pacing),         AV_OPT_TYPE_INT,    { .i64 = UDP_PACING_THREAD }, 0, UDP_PACING_RATE, .flags = E, .unit = "pacing" },
+    {     "thread",     "send from a timed thread (requires fifo_size)",   0,                      AV_OPT_TYPE_CONST,  { .i64 = UDP_PACING_THREAD }, 0, 0, .flags = E, .unit = "pacing" },
+    {     "txtime",     "let the kernel send each packet at its launch time (SO_TXTIME)", 0,       AV_OPT_TYPE_CONST,  { .i64 = UDP_PACING_TXTIME }, 0, 0, .flags = E, .unit = "pacing" },
+    {     "rate",       "let the kernel limit the socket rate (SO_MAX_PACING_RATE)", 0,            AV_OPT_TYPE_CONST,  { .i64 = UDP_PACING_RATE   }, 0, 0, .flags = E, .unit = "pacing" },
     { "localport",      "Local port",                                      OFFSET(local_port),     AV_OPT_TYPE_INT,    { .i64 = -1 },    -1, INT_MAX, D|E },
     { "local_port",     "Local port",                                      OFFSET(local_port),     AV_OPT_TYPE_INT,    { .i64 = -1 },    -1, INT_MAX, .flags = D|E },
     { "localaddr",      "Local address",                                   OFFSET(localaddr),      AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
@@ -139,6 +202,8 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "batch_size",     "Number of datagrams to receive or send per system call", OFFSET(batch_size), AV_OPT_TYPE_INT, { .i64 = 1 },     1, UDP_MAX_BATCH_SIZE, D|E },
+    { "gso",            "Send runs of equally sized batched datagrams with UDP segmentation offload", OFFSET(gso), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     { NULL }
 };
 
@@ -478,6 +543,299 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+/**
+ * Set up kernel assisted pacing of the output to the configured bitrate,
+ * falling back to the next simpler method if the requested one is not
+ * available.
+ */
+static void udp_setup_kernel_pacing(URLContext *h, int fd)
+{
+    UDPContext *s = h->priv_data;
+
+    if (s->pacing == UDP_PACING_TXTIME) {
+#if UDP_HAVE_TXTIME
+        struct sock_txtime cfg = { .clockid = CLOCK_MONOTONIC };
+
+        if (!av_gettime_relative_is_monotonic()) {
+            av_log(h, AV_LOG_WARNING, "SO_TXTIME pacing requires a monotonic clock\n");
+        } else if (setsockopt(fd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)) < 0) {
+            ff_log_net_error(h, AV_LOG_WARNING, "setsockopt(SO_TXTIME)");
+        } else {
+            s->pacing_start = s->pacing_target = av_gettime_relative();
+            return;
+        }
+#endif
+        s->pacing = UDP_PACING_RATE;
+    }
+
+    if (s->pacing == UDP_PACING_RATE) {
+#ifdef SO_MAX_PACING_RATE
+        unsigned int rate = FFMIN(s->bitrate / 8, UINT_MAX);
+
+        if (setsockopt(fd, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) >= 0)
+            return;
+        ff_log_net_error(h, AV_LOG_WARNING, "setsockopt(SO_MAX_PACING_RATE)");
+#endif
+    }
+
+    av_log(h, AV_LOG_WARNING, "Kernel pacing is not available, using the pacing thread\n");
+    s->pacing = UDP_PACING_THREAD;
+}
+
+#if UDP_HAVE_TXTIME
+/**
+ * Compute the launch time of the next datagram of len bytes, following the
+ * same rate and burst rules as the pacing thread. Blocks if the launch time
+ * is too far ahead to be queued in the kernel.
+ */
+static int64_t udp_txtime_schedule(URLContext *h, int len)
+{
+    UDPContext *s = h->priv_data;
+    int64_t burst_interval = s->burst_bits * 1000000 / s->bitrate;
+    int64_t now = av_gettime_relative();
+    int64_t launch_time = now;
+
+    if (now < s->pacing_target) {
+        launch_time = s->pacing_target;
+        if (launch_time - now > UDP_TXTIME_HORIZON)
+            av_usleep(launch_time - now - UDP_TXTIME_HORIZON);
+    } else if (now - burst_interval > s->pacing_target) {
+        s->pacing_start     = now - burst_interval;
+        s->pacing_sent_bits = 0;
+    }
+    s->pacing_sent_bits += len * 8;
+    s->pacing_target     = s->pacing_start + s->pacing_sent_bits * 1000000 / s->bitrate;
+
+    return launch_time;
+}
+
+static void udp_set_txtime(struct msghdr *msg, uint8_t *control, int64_t launch_time)
+{
+    uint64_t txtime = launch_time * 1000;
+    struct cmsghdr *cm;
+
+    msg->msg_control    = control;
+    msg->msg_controllen = CMSG_SPACE(sizeof(txtime));
+    cm = CMSG_FIRSTHDR(msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_TXTIME;
+    cm->cmsg_len   = CMSG_LEN(sizeof(txtime));
+    memcpy(CMSG_DATA(cm), &txtime, sizeof(txtime));
+}
+#endif
+
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+static int udp_batch_alloc(UDPContext *s, int slot_size)
+{
+    s->batch_msgs  = av_calloc(s->batch_size, sizeof(*s->batch_msgs));
+    s->batch_iov   = av_calloc(s->batch_size, sizeof(*s->batch_iov));
+    s->batch_addrs = av_calloc(s->batch_size, sizeof(*s->batch_addrs));
+    s->batch_buf   = av_malloc_array(s->batch_size, slot_size);
+    if (!s->batch_msgs || !s->batch_iov || !s->batch_addrs || !s->batch_buf)
+        return AVERROR(ENOMEM);
+#if UDP_HAVE_TXTIME
+    if (s->pacing == UDP_PACING_TXTIME) {
+        s->batch_control = av_calloc(s->batch_size, CMSG_SPACE(sizeof(uint64_t)));
+        if (!s->batch_control)
+            return AVERROR(ENOMEM);
+    }
+#endif
+
+    s->batch_slot_size = slot_size;
+    for (int i = 0; i < s->batch_size; i++) {
+        s->batch_iov[i].iov_base = s->batch_buf + i * slot_size;
+        s->batch_msgs[i].msg_hdr.msg_iov    = &s->batch_iov[i];
+        s->batch_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    return 0;
+}
+
+static void udp_batch_free(UDPContext *s)
+{
+#if UDP_HAVE_GSO
+    av_freep(&s->gso_msgs);
+    av_freep(&s->gso_control);
+    av_freep(&s->gso_nb_segments);
+#endif
+    av_freep(&s->batch_control);
+    av_freep(&s->batch_msgs);
+    av_freep(&s->batch_iov);
+    av_freep(&s->batch_addrs);
+    av_freep(&s->batch_buf);
+}
+#endif
+
+#if HAVE_RECVMMSG
+/**
+ * Receive up to batch_size datagrams into the batch slots.
+ * @return number of datagrams received or a negative error code
+ */
+static int udp_batch_recv(UDPContext *s, int flags)
+{
+    int ret;
+
+    for (int i = 0; i < s->batch_size; i++) {
+        struct msghdr *hdr = &s->batch_msgs[i].msg_hdr;
+        hdr->msg_name    = &s->batch_addrs[i];
+        hdr->msg_namelen = sizeof(s->batch_addrs[i]);
+        hdr->msg_flags   = 0;
+        s->batch_iov[i].iov_len = s->batch_slot_size;
+    }
+
+    ret = recvmmsg(s->udp_fd, s->batch_msgs, s->batch_size, flags, NULL);
+    if (ret < 0)
+        return ff_neterrno();
+
+    s->batch_count = ret;
+    s->batch_pos   = 0;
+    return ret;
+}
+#endif
+
+#if UDP_HAVE_GSO
+static int udp_gso_alloc(UDPContext *s)
+{
+    s->gso_msgs        = av_calloc(s->batch_size, sizeof(*s->gso_msgs));
+    s->gso_control     = av_calloc(s->batch_size, CMSG_SPACE(sizeof(uint16_t)));
+    s->gso_nb_segments = av_calloc(s->batch_size, sizeof(*s->gso_nb_segments));
+    if (!s->gso_msgs || !s->gso_control || !s->gso_nb_segments)
+        return AVERROR(ENOMEM);
+    return 0;
+}
+
+/**
+ * Send the queued datagrams, coalescing each run of equally sized ones
+ * (the last of a run may be shorter) into a single UDP_SEGMENT message.
+ * The kernel splits it back into the original datagrams.
+ */
+static int udp_batch_flush_gso(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+    while (s->batch_pos < s->batch_count) {
+        int nb_msgs = 0;
+
+        for (int pos = s->batch_pos; pos < s->batch_count; nb_msgs++) {
+            struct msghdr *hdr = &s->gso_msgs[nb_msgs].msg_hdr;
+            int seg_size = s->batch_iov[pos].iov_len;
+            int total    = seg_size;
+            int n        = 1;
+
+            while (pos + n < s->batch_count && n < UDP_MAX_GSO_SEGMENTS) {
+                int len = s->batch_iov[pos + n].iov_len;
+                if (len > seg_size || total + len > UDP_MAX_GSO_SIZE)
+                    break;
+                total += len;
+                n++;
+                if (len < seg_size)
+                    break;
+            }
+
+            *hdr = s->batch_msgs[pos].msg_hdr;
+            hdr->msg_iov        = &s->batch_iov[pos];
+            hdr->msg_iovlen     = n;
+            hdr->msg_control    = NULL;
+            hdr->msg_controllen = 0;
+            if (n > 1) {
+                uint16_t gso_size = seg_size;
+                struct cmsghdr *cm;
+
+                hdr->msg_control    = s->gso_control + nb_msgs * CMSG_SPACE(sizeof(gso_size));
+                hdr->msg_controllen = CMSG_SPACE(sizeof(gso_size));
+                cm = CMSG_FIRSTHDR(hdr);
+                cm->cmsg_level = IPPROTO_UDP;
+                cm->cmsg_type  = UDP_SEGMENT;
+                cm->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+                memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+            }
+            s->gso_nb_segments[nb_msgs] = n;
+            pos += n;
+        }
+
+        if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+            ret = ff_network_wait_fd(s->udp_fd, 1);
+            if (ret < 0)
+                return ret;
+        }
+        ret = sendmmsg(s->udp_fd, s->gso_msgs, nb_msgs, 0);
+        if (ret < 0)
+            return ff_neterrno();
+        for (int i = 0; i < ret; i++)
+            s->batch_pos += s->gso_nb_segments[i];
+    }
+    s->batch_count = s->batch_pos = 0;
+    return 0;
+}
+#endif
+
+#if HAVE_SENDMMSG
+/**
+ * Send the datagrams queued by udp_write(). On failure, the datagrams not
+ * sent yet stay queued, except the one causing a non-transient error.
+ */
+static int udp_batch_flush(URLContext *h)
+{
+    UDPContext *s = h->priv_data;
+    int ret;
+
+#if UDP_HAVE_GSO
+    if (s->gso_msgs) {
+        ret = udp_batch_flush_gso(h);
+        if (ret != AVERROR(EIO) && ret != AVERROR(EINVAL) &&
+            ret != AVERROR(ENOPROTOOPT) && ret != AVERROR(EOPNOTSUPP))
+            return ret;
+        /* The socket or the route does not support segmentation offload */
+        av_log(h, AV_LOG_WARNING, "UDP segmentation offload failed (%s), "
+               "falling back to sendmmsg()\n", av_err2str(ret));
+        av_freep(&s->gso_msgs);
+        av_freep(&s->gso_control);
+        av_freep(&s->gso_nb_segments);
+    }
+#endif
+
+    while (s->batch_pos < s->batch_count) {
+        if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+            ret = ff_network_wait_fd(s->udp_fd, 1);
+            if (ret < 0)
+                return ret;
+        }
+        ret = sendmmsg(s->udp_fd, s->batch_msgs + s->batch_pos,
+                       s->batch_count - s->batch_pos, 0);
+        if (ret < 0) {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                s->batch_pos++;
+            return ret;
+        }
+        s->batch_pos += ret;
+    }
+    s->batch_count = s->batch_pos = 0;
+    return 0;
+}
+#endif
+
+void ff_udp_enable_batched_send(URLContext *h)
+{
+#if HAVE_SENDMMSG
+    UDPContext *s = h->priv_data;
+
+    if (s->batch_msgs && !(h->flags & AVIO_FLAG_READ))
+        s->batch_send = 1;
+#endif
+}
+
+int ff_udp_flush(URLContext *h)
+{
+#if HAVE_SENDMMSG
+    UDPContext *s = h->priv_data;
+
+    if (s->batch_msgs && !(h->flags & AVIO_FLAG_READ))
+        return udp_batch_flush(h);
+#endif
+    return 0;
+}
+
 #if HAVE_PTHREAD_CANCEL
 static void *circular_buffer_task_rx( void *_URLContext)
 {
@@ -494,6 +852,48 @@ static void *circular_buffer_task_rx( void *_URLContext)
         s->circular_buffer_error = AVERROR(EIO);
         goto end;
     }
+#if HAVE_RECVMMSG
+    while (s->batch_msgs) {
+        int ret;
+
+        pthread_mutex_unlock(&s->mutex);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
+        ret = udp_batch_recv(s, MSG_WAITFORONE);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
+        pthread_mutex_lock(&s->mutex);
+        if (ret < 0) {
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
+                s->circular_buffer_error = ret;
+                goto end;
+            }
+            continue;
+        }
+        for (int i = 0; i < s->batch_count; i++) {
+            int len = s->batch_msgs[i].msg_len;
+            uint8_t hdr[4];
+
+            if (ff_ip_check_source_lists(&s->batch_addrs[i], &s->filters))
+                continue;
+            if (av_fifo_can_write(s->fifo) < len + 4) {
+                if (s->overrun_nonfatal) {
+                    av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                            "Surviving due to overrun_nonfatal option\n");
+                    continue;
+                } else {
+                    av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                            "To avoid, increase fifo_size URL option. "
+                            "To survive in such case, use overrun_nonfatal option\n");
+                    s->circular_buffer_error = AVERROR(EIO);
+                    goto end;
+                }
+            }
+            AV_WL32(hdr, len);
+            av_fifo_write(s->fifo, hdr, 4);
+            av_fifo_write(s->fifo, s->batch_iov[i].iov_base, len);
+        }
+        pthread_cond_signal(&s->cond);
+    }
+#endif
     while(1) {
         int len;
         struct sockaddr_storage addr;
@@ -735,6 +1135,22 @@ static int udp_open(URLContext *h, const char *uri, int flags)
         if (av_find_info_tag(buf, sizeof(buf), "burst_bits", p)) {
             s->burst_bits = strtoll(buf, NULL, 10);
         }
+        if (av_find_info_tag(buf, sizeof(buf), "pacing", p)) {
+            if ((ret = av_opt_set(s, "pacing", buf, 0)) < 0)
+                goto fail;
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "gso", p)) {
+            s->gso = strtol(buf, NULL, 10);
+        }
+        if (av_find_info_tag(buf, sizeof(buf), "batch_size", p)) {
+            s->batch_size = strtol(buf, NULL, 10);
+            if (s->batch_size < 1 || s->batch_size > UDP_MAX_BATCH_SIZE) {
+                av_log(h, AV_LOG_ERROR, "batch_size(%d) should be in range [1,%d]\n",
+                       s->batch_size, UDP_MAX_BATCH_SIZE);
+                ret = AVERROR(EINVAL);
+                goto fail;
+            }
+        }
         if (av_find_info_tag(buf, sizeof(buf), "localaddr", p)) {
             av_freep(&s->localaddr);
             s->localaddr = av_strdup(buf);
@@ -921,6 +1337,34 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 
     s->udp_fd = udp_fd;
 
+    if (is_output && s->bitrate && s->pacing != UDP_PACING_THREAD)
+        udp_setup_kernel_pacing(h, udp_fd);
+
+    /* Datagrams written through the tx thread are sent one by one from the
+     * fifo, so they are never batched. */
+    if (s->batch_size > 1 &&
+        !(HAVE_PTHREAD_CANCEL && is_output && s->bitrate && s->pacing == UDP_PACING_THREAD && s->circular_buffer_size)) {
+        if (!(is_output ? HAVE_SENDMMSG && s->pkt_size > 0 : HAVE_RECVMMSG))
+            av_log(h, AV_LOG_WARNING, "'batch_size' option was set but "
+                   "batched %s is not supported\n", is_output ? "sending" : "receiving");
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+        else if ((ret = udp_batch_alloc(s, is_output ? s->pkt_size : UDP_MAX_PKT_SIZE)) < 0)
+            goto fail;
+#endif
+    }
+    if (s->gso && is_output) {
+        /* All segments of a message share one launch time, so this does
+         * not mix with SO_TXTIME pacing. */
+#if UDP_HAVE_GSO
+        if (s->batch_msgs && !s->batch_control && !s->udplite_coverage) {
+            if ((ret = udp_gso_alloc(s)) < 0)
+                goto fail;
+        } else
+#endif
+            av_log(h, AV_LOG_WARNING, "'gso' option was set but UDP segmentation "
+                   "offload is not supported or needs batch_size without txtime pacing\n");
+    }
+
 #if HAVE_PTHREAD_CANCEL
     /*
       Create thread in case of:
@@ -928,12 +1372,13 @@ static int udp_open(URLContext *h, const char *uri, int flags)
       2. Output and bitrate and circular_buffer_size is set
     */
 
-    if (is_output && s->bitrate && !s->circular_buffer_size) {
+    if (is_output && s->bitrate && s->pacing == UDP_PACING_THREAD && !s->circular_buffer_size) {
         /* Warn user in case of 'circular_buffer_size' is not set */
         av_log(h, AV_LOG_WARNING,"'bitrate' option was set but 'circular_buffer_size' is not, but required\n");
     }
 
-    if ((!is_output && s->circular_buffer_size) || (is_output && s->bitrate && s->circular_buffer_size)) {
+    if ((!is_output && s->circular_buffer_size) ||
+        (is_output && s->bitrate && s->pacing == UDP_PACING_THREAD && s->circular_buffer_size)) {
         /* start the task going */
         s->fifo = av_fifo_alloc2(s->circular_buffer_size, 1, 0);
         if (!s->fifo) {
@@ -973,6 +1418,9 @@ static int udp_open(URLContext *h, const char *uri, int flags)
     if (udp_fd >= 0)
         closesocket(udp_fd);
     av_fifo_freep2(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return ret;
 }
@@ -1038,6 +1486,34 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     }
 #endif
 
+#if HAVE_RECVMMSG
+    if (s->batch_msgs) {
+        while (s->batch_pos >= s->batch_count) {
+            if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
+                ret = ff_network_wait_fd(s->udp_fd, 0);
+                if (ret < 0)
+                    return ret;
+            }
+            ret = udp_batch_recv(s, 0);
+            if (ret < 0)
+                return ret;
+        }
+        while (s->batch_pos < s->batch_count) {
+            int i = s->batch_pos++;
+            if (ff_ip_check_source_lists(&s->batch_addrs[i], &s->filters))
+                continue;
+            ret = s->batch_msgs[i].msg_len;
+            if (ret > size) {
+                av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
+                ret = size;
+            }
+            memcpy(buf, s->batch_iov[i].iov_base, ret);
+            return ret;
+        }
+        return AVERROR(EINTR);
+    }
+#endif
+
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 0);
         if (ret < 0)
@@ -1084,6 +1560,29 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
         pthread_mutex_unlock(&s->mutex);
         return size;
     }
+#endif
+#if HAVE_SENDMMSG
+    if (s->batch_send) {
+        if (s->batch_count == s->batch_size || size > s->batch_slot_size) {
+            ret = udp_batch_flush(h);
+            if (ret < 0)
+                return ret;
+        }
+        if (size <= s->batch_slot_size) {
+            struct msghdr *hdr = &s->batch_msgs[s->batch_count].msg_hdr;
+            hdr->msg_name    = s->is_connected ? NULL : &s->dest_addr;
+            hdr->msg_namelen = s->is_connected ? 0    : s->dest_addr_len;
+#if UDP_HAVE_TXTIME
+            if (s->batch_control)
+                udp_set_txtime(hdr, s->batch_control + s->batch_count * CMSG_SPACE(sizeof(uint64_t)),
+                               udp_txtime_schedule(h, size));
+#endif
+            s->batch_iov[s->batch_count].iov_len = size;
+            memcpy(s->batch_iov[s->batch_count].iov_base, buf, size);
+            s->batch_count++;
+            return size;
+        }
+    }
 #endif
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
         ret = ff_network_wait_fd(s->udp_fd, 1);
@@ -1091,6 +1590,26 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
             return ret;
     }
 
+#if UDP_HAVE_TXTIME
+    if (s->pacing == UDP_PACING_TXTIME && s->bitrate) {
+        union {
+            struct cmsghdr align;
+            uint8_t buf[CMSG_SPACE(sizeof(uint64_t))];
+        } control;
+        struct iovec iov = { .iov_base = (void *)buf, .iov_len = size };
+        struct msghdr msg = {
+            .msg_name    = s->is_connected ? NULL : &s->dest_addr,
+            .msg_namelen = s->is_connected ? 0    : s->dest_addr_len,
+            .msg_iov     = &iov,
+            .msg_iovlen  = 1,
+        };
+
+        udp_set_txtime(&msg, control.buf, udp_txtime_schedule(h, size));
+        ret = sendmsg(s->udp_fd, &msg, 0);
+        return ret < 0 ? ff_neterrno() : ret;
+    }
+#endif
+
     if (!s->is_connected) {
         ret = sendto (s->udp_fd, buf, size, 0,
                       (struct sockaddr *) &s->dest_addr,
@@ -1115,6 +1634,20 @@ static int udp_close(URLContext *h)
     }
 #endif
 
+#if HAVE_SENDMMSG
+    if (s->batch_msgs && !(h->flags & AVIO_FLAG_READ)) {
+        int ret;
+        while ((ret = udp_batch_flush(h)) == AVERROR(EAGAIN) ||
+               ret == AVERROR(EINTR)) {
+            if (ff_check_interrupt(&h->interrupt_callback))
+                break;
+        }
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+            av_log(h, AV_LOG_WARNING, "Failed to send queued datagrams: %s\n",
+                   av_err2str(ret));
+    }
+#endif
+
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr,
                                   (struct sockaddr *)&s->local_addr_storage, h);
@@ -1142,6 +1675,9 @@ static int udp_close(URLContext *h)
 #endif
     closesocket(s->udp_fd);
     av_fifo_freep2(&s->fifo);
+#if HAVE_RECVMMSG || HAVE_SENDMMSG
+    udp_batch_free(s);
+#endif
     ff_ip_reset_filters(&s->filters);
     return 0;
 }
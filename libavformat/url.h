@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -76,6 +77,13 @@ typedef struct URLProtocol {
      */
     int     (*url_read)( URLContext *h, unsigned char *buf, int size);
     int     (*url_write)(URLContext *h, const unsigned char *buf, int size);
+    /**
+     * Write data owned by a refcounted buffer. Same semantics as url_write,
+     * except that the protocol may keep a reference to buf until the data
+     * has actually been transmitted instead of copying it.
+     */
+    int     (*url_write_buffer)(URLContext *h, const unsigned char *data, int size,
+                                AVBufferRef *buf);
     int64_t (*url_seek)( URLContext *h, int64_t pos, int whence);
     int     (*url_close)(URLContext *h);
     int (*url_read_pause)(void *urlcontext, int pause);
@@ -206,6 +214,20 @@ static inline int ffurl_write(URLContext *h, const uint8_t *buf, int size)
     return ffurl_write2(h, buf, size);
 }
 
+/**
+ * Write size bytes from data, which must be owned by buf, to the resource
+ * accessed by h.
+ *
+ * Protocols supporting zero-copy transmission may hold a reference to buf
+ * after returning, so the caller must not modify the data afterwards.
+ * Otherwise, and if buf is NULL, this is equivalent to ffurl_write().
+ *
+ * @return the number of bytes actually written, or a negative value
+ * corresponding to an AVERROR code in case of failure
+ */
+int ffurl_write_buffer(URLContext *h, const uint8_t *data, int size,
+                       AVBufferRef *buf);
+
 int64_t ffurl_seek2(void *urlcontext, int64_t pos, int whence);
 /**
  * Change the position that will be used by the next read/write
@@ -286,6 +308,16 @@ int ff_check_interrupt(AVIOInterruptCB *cb);
 /* udp.c */
 int ff_udp_set_remote_url(URLContext *h, const char *uri);
 int ff_udp_get_local_port(URLContext *h);
+/**
+ * Queue outgoing datagrams for batched sending (batch_size option) instead of
+ * sending them right away. A caller enabling this must call ff_udp_flush()
+ * whenever the queued datagrams have to go out, e.g. after every frame.
+ */
+void ff_udp_enable_batched_send(URLContext *h);
+/**
+ * Send the datagrams queued for batched sending (batch_size option).
+ */
+int ff_udp_flush(URLContext *h);
 
 /**
  * Assemble a URL string from components. This is the reverse operation
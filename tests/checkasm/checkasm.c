@@ -167,6 +167,9 @@ static const struct {
     #if CONFIG_RV34DSP
         { "rv34dsp", checkasm_check_rv34dsp },
     #endif
+    #if CONFIG_STARTCODE
+        { "startcode", checkasm_check_startcode },
+    #endif
     #if CONFIG_SVQ1_ENCODER
         { "svq1enc", checkasm_check_svq1enc },
     #endif
@@ -0,0 +1,68 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "checkasm.h"
+#include "libavcodec/defs.h"
+#include "libavcodec/startcode.h"
+#include "libavutil/mem_internal.h"
+
+#define BUF_SIZE 1024
+
+/* nonzero bytes, with a zero every zero_dist bytes on average (none for 0) */
+static void randomize_buffer(uint8_t *buf, int size, int zero_dist)
+{
+    for (int i = 0; i < size; i++) {
+        buf[i] = rnd() % 255 + 1;
+        if (zero_dist && !(rnd() % zero_dist))
+            buf[i] = 0;
+    }
+}
+
+void checkasm_check_startcode(void)
+{
+    LOCAL_ALIGNED_32(uint8_t, buf, [BUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE]);
+    StartcodeFindCandidateFunc find_candidate = ff_startcode_find_candidate_func();
+    static const int zero_dists[] = { 0, 2, 37, 300 };
+
+    declare_func(int, const uint8_t *buf, int size);
+
+    if (check_func(find_candidate, "startcode_find_candidate")) {
+        for (int i = 0; i < FF_ARRAY_ELEMS(zero_dists); i++) {
+            for (int j = 0; j < 64; j++) {
+                int offset = rnd() % 64;
+                int size   = rnd() % (BUF_SIZE - offset + 1);
+                int ref, new;
+
+                /* the padding may contain zeros too, they must be ignored */
+                randomize_buffer(buf, BUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE,
+                                 zero_dists[i]);
+                ref = call_ref(buf + offset, size);
+                new = call_new(buf + offset, size);
+                if (ref != new) {
+                    fprintf(stderr, "startcode_find_candidate: size %d offset %d, "
+                            "expected %d got %d\n", size, offset, ref, new);
+                    fail();
+                }
+            }
+        }
+        randomize_buffer(buf, BUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+        bench_new(buf, BUF_SIZE);
+    }
+
+    report("startcode_find_candidate");
+}
@@ -617,6 +617,18 @@ concat(){
     fi
 }
 
+seek_index_cache(){
+    file=$1
+    cachefile="${outdir}/${test}.idx"
+    cleanfiles="$cleanfiles $cachefile"
+    rm -f $cachefile
+
+    # the first run builds and stores the index, the second one loads it
+    run libavformat/tests/seek${EXECSUF} $(target_path $file) -index_cache $(target_path $cachefile) || return
+    test -s $cachefile || return
+    run libavformat/tests/seek${EXECSUF} $(target_path $file) -index_cache $(target_path $cachefile)
+}
+
 venc_data(){
     file=$1
     stream=$2
@@ -23,5 +23,10 @@ $(foreach D,$(FATE_CONCAT_DEMUXER_EXTENDED_LAVF),$(eval fate-concat-demuxer-exte
 $(foreach D,$(FATE_CONCAT_DEMUXER_EXTENDED_LAVF),$(eval fate-concat-demuxer-extended-lavf-$(D): CMD = concat $(SRC_PATH)/tests/extended.ffconcat ../lavf/lavf.$(D) md5))
 FATE_CONCAT_DEMUXER += $(FATE_CONCAT_DEMUXER_EXTENDED_LAVF:%=fate-concat-demuxer-extended-lavf-%)
 
+fate-concat-demuxer-prefetch-lavf-ts: fate-lavf-ts
+fate-concat-demuxer-prefetch-lavf-ts: CMD = concat $(SRC_PATH)/tests/simple2.ffconcat ../lavf/lavf.ts "" "-prefetch 2"
+fate-concat-demuxer-prefetch-lavf-ts: REF = $(SRC_PATH)/tests/ref/fate/concat-demuxer-simple2-lavf-ts
+FATE_CONCAT_DEMUXER += $(if $(filter ts,$(FATE_CONCAT_DEMUXER_SIMPLE2_LAVF)),fate-concat-demuxer-prefetch-lavf-ts)
+
 FATE_CONCAT_DEMUXER := $(if $(CONFIG_CONCAT_DEMUXER), $(FATE_CONCAT_DEMUXER))
 FATE_FFPROBE += $(FATE_CONCAT_DEMUXER)
@@ -44,6 +44,25 @@ fate-ffprobe_xsd: CMD = run $(FFPROBE_COMMAND) -noprivate -of xml=q=1:x=1 | \
 	xmllint --schema $(SRC_PATH)/doc/ffprobe.xsd -
 
 FATE_FFPROBE-$(HAVE_XMLLINT) += $(FATE_FFPROBE_SCHEMA-yes)
+
+# -fflags fastprobe must find the same streams and parameters as a full
+# probe, the references are the output without the flag
+FFPROBE_FASTPROBE_COMMAND = ffprobe$(PROGSSUF)$(EXESUF) -bitexact -fflags fastprobe -of flat \
+    -show_entries stream=index,codec_name,codec_type,codec_tag_string,profile,width,height,pix_fmt,sample_aspect_ratio,sample_rate,channels,time_base,start_pts,r_frame_rate,avg_frame_rate
+
+FATE_FFPROBE_FASTPROBE-$(call ALLYES, FLV_DEMUXER) += fate-ffprobe-fastprobe-flv
+fate-ffprobe-fastprobe-flv: fate-lavf-flv
+fate-ffprobe-fastprobe-flv: CMD = run $(FFPROBE_FASTPROBE_COMMAND) $(TARGET_PATH)/tests/data/lavf/lavf.flv
+
+FATE_FFPROBE_FASTPROBE-$(call ALLYES, MATROSKA_DEMUXER) += fate-ffprobe-fastprobe-mkv
+fate-ffprobe-fastprobe-mkv: fate-lavf-mkv
+fate-ffprobe-fastprobe-mkv: CMD = run $(FFPROBE_FASTPROBE_COMMAND) $(TARGET_PATH)/tests/data/lavf/lavf.mkv
+
+FATE_FFPROBE_FASTPROBE-$(call ALLYES, MPEGTS_DEMUXER MPEGVIDEO_PARSER) += fate-ffprobe-fastprobe-ts
+fate-ffprobe-fastprobe-ts: fate-lavf-ts
+fate-ffprobe-fastprobe-ts: CMD = run $(FFPROBE_FASTPROBE_COMMAND) $(TARGET_PATH)/tests/data/lavf/lavf.ts
+
+FATE_FFPROBE-yes += $(filter $(FATE_FFPROBE_FASTPROBE-yes),$(FATE_LAVF_CONTAINER:fate-lavf-%=fate-ffprobe-fastprobe-%))
 FATE_FFPROBE += $(FATE_FFPROBE-yes)
 
 fate-ffprobe: $(FATE_FFPROBE)
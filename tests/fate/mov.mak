@@ -218,6 +218,14 @@ fate-mov-pcm-remux: CMD = md5 -i $(TARGET_PATH)/tests/data/asynth-44100-1.wav -m
 fate-mov-pcm-remux: CMP = oneline
 fate-mov-pcm-remux: REF = e76115bc392d702da38f523216bba165
 
+# Test single pass faststart into the reserved moov space, and the fallback to
+# the second pass when the input is longer than its duration hint
+FATE_MOV_FFMPEG-$(call TRANSCODE, MP2, MOV, WAV_DEMUXER PCM_S16LE_DECODER) \
+                          += fate-mov-faststart-reserve fate-mov-faststart-reserve-fallback
+fate-mov-faststart-reserve fate-mov-faststart-reserve-fallback: tests/data/asynth-44100-1.wav
+fate-mov-faststart-reserve: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-1.wav mov "-c:a mp2 -b:a 32k -movflags +faststart -faststart_reserve 1" "-c copy -t 0.5"
+fate-mov-faststart-reserve-fallback: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-1.wav mov "-c:a mp2 -b:a 32k -movflags +faststart -faststart_reserve 1" "-c copy -t 0.5" "" "" "" "-stream_loop 12"
+
 FATE_MOV_FFMPEG_FFPROBE-$(call TRANSCODE, FLAC, MOV, WAV_DEMUXER PCM_S16LE_DECODER) += fate-mov-mp4-iamf-stereo
 fate-mov-mp4-iamf-stereo: tests/data/asynth-44100-2.wav tests/data/streamgroups/audio_element-stereo tests/data/streamgroups/mix_presentation-stereo
 fate-mov-mp4-iamf-stereo: SRC = $(TARGET_PATH)/tests/data/asynth-44100-2.wav
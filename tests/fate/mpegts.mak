@@ -22,4 +22,25 @@ fate-mpegts-probe-pmt-merge: CMD = run $(PROBE_CODEC_NAME_COMMAND) -merge_pmt_ve
 
 FATE_SAMPLES_FFPROBE += $(FATE_MPEGTS_PROBE-yes)
 
-fate-mpegts: $(FATE_MPEGTS_PROBE-yes)
+#
+# Test CBR muxing with stuffing slots filled by due audio payloads
+#
+MPEGTS_CBR_DEPS = IMAGE2_DEMUXER PGMYUV_DECODER PCM_S16LE_DEMUXER PCM_S16LE_DECODER \
+                  MPEG2VIDEO_ENCODER MP2_ENCODER MPEGTS_MUXER MPEGTS_DEMUXER
+MPEGTS_CBR_OPTS = -c:v mpeg2video -qscale:v 10 -c:a mp2 -b:a 64k -t 1 \
+                  -muxrate 4M -pes_payload_size 4000 -mpegts_flags +cbr_lookahead
+
+FATE_MPEGTS_FFMPEG-$(call ALLYES, $(MPEGTS_CBR_DEPS)) += fate-mpegts-cbr-lookahead
+fate-mpegts-cbr-lookahead: CMD = transcode image2 $(TARGET_PATH)/$(VREF:00.pgm=%02d.pgm) mpegts "$(MPEGTS_CBR_OPTS)" "-c copy" "" "-ar 44100 -f s16le -i $(TARGET_PATH)/$(AREF)" "" "-c:v pgmyuv"
+
+# audio written into stuffing slots must not push the PCRs apart
+FATE_MPEGTS_FFMPEG-$(call ALLYES, $(MPEGTS_CBR_DEPS)) += fate-mpegts-cbr-lookahead-pcr
+fate-mpegts-cbr-lookahead-pcr: CMD = md5 -c:v pgmyuv -f image2 -i $(TARGET_PATH)/$(VREF:00.pgm=%02d.pgm) -ar 44100 -f s16le -i $(TARGET_PATH)/$(AREF) $(MPEGTS_CBR_OPTS) -v verbose -flags +bitexact -fflags +bitexact -f mpegts
+fate-mpegts-cbr-lookahead-pcr: CMP = grep
+fate-mpegts-cbr-lookahead-pcr: REF = pid=256: 51 PCRs, interval 19.176-20.680 ms, 4 longer than 20.000 ms
+
+$(FATE_MPEGTS_FFMPEG-yes): $(AREF) $(VREF)
+
+FATE_FFMPEG += $(FATE_MPEGTS_FFMPEG-yes)
+
+fate-mpegts: $(FATE_MPEGTS_PROBE-yes) $(FATE_MPEGTS_FFMPEG-yes)
@@ -196,6 +196,28 @@ fate-seek-test-iibbibb-neg-ctts-mp4:  CMD = run libavformat/tests/seek$(EXESUF)
 fate-seek-cache-pipe: CMD = cat $(SAMPLES)/gapless/gapless.mp3 | run libavformat/tests/seek$(EXESUF) cache:pipe:0 -read_ahead_limit -1
 fate-seek-mkv-codec-delay:   CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_SAMPLES)/mkv/codec_delay_opus.mkv
 
+# same as fate-seek-lavf-ts, with the video parser running on worker threads
+FATE_SEEK_PARSE_THREADS-$(call ALLYES, MPEGTS_DEMUXER MPEGVIDEO_PARSER) += fate-seek-lavf-ts-parse-threads
+fate-seek-lavf-ts-parse-threads: fate-lavf-ts libavformat/tests/seek$(EXESUF)
+fate-seek-lavf-ts-parse-threads: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.ts -parse_threads 3
+fate-seek-lavf-ts-parse-threads: REF = $(SRC_PATH)/tests/ref/seek/lavf-ts
+FATE_SEEK_PARSE_THREADS := $(if $(filter fate-lavf-ts,$(FATE_LAVF_CONTAINER)),$(FATE_SEEK_PARSE_THREADS-yes))
+
+# same as fate-seek-lavf-mov, with the sample tables resolved on demand;
+# the edit list is applied the simple way, which the lazy index supports
+FATE_SEEK_LAZY_INDEX-$(CONFIG_MOV_DEMUXER) += fate-seek-lavf-mov-lazy-index
+fate-seek-lavf-mov-lazy-index: fate-lavf-mov libavformat/tests/seek$(EXESUF)
+fate-seek-lavf-mov-lazy-index: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/lavf/lavf.mov -lazy_index 1 -advanced_editlist 0
+fate-seek-lavf-mov-lazy-index: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+FATE_SEEK_LAZY_INDEX := $(if $(filter fate-lavf-mov,$(FATE_LAVF_CONTAINER)),$(FATE_SEEK_LAZY_INDEX-yes))
+
+# same as fate-seek-lavf-mkv, with the index cache built by a full scan
+# and then loaded from the cache file
+FATE_SEEK_INDEX_CACHE-$(CONFIG_MATROSKA_DEMUXER) += fate-seek-lavf-mkv-index-cache
+fate-seek-lavf-mkv-index-cache: fate-lavf-mkv libavformat/tests/seek$(EXESUF)
+fate-seek-lavf-mkv-index-cache: CMD = seek_index_cache tests/data/lavf/lavf.mkv
+FATE_SEEK_INDEX_CACHE := $(if $(filter fate-lavf-mkv,$(FATE_LAVF_CONTAINER)),$(FATE_SEEK_INDEX_CACHE-yes))
+
 FATE_SEEK_EXTRA += $(FATE_SEEK_EXTRA-yes)
 
 
@@ -205,6 +227,6 @@ $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 $(subst fate-seek-,fate-,$(FATE_SAMPLES_SEEK) $(FATE_SEEK)): KEEP_FILES ?= 1
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_PARSE_THREADS) $(FATE_SEEK_LAZY_INDEX) $(FATE_SEEK_INDEX_CACHE)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_PARSE_THREADS) $(FATE_SEEK_LAZY_INDEX) $(FATE_SEEK_INDEX_CACHE)